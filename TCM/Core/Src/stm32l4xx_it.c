@@ -23,6 +23,11 @@
 #include "stm32l4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "dI2C.h"
+#include "Power.h"
+#include "dUART.h"
+#include "HRT.h"
+#include "TWheel.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -315,5 +320,46 @@ void OTG_FS_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief This function handles TIM2 global interrupt - HRT counter wrap, delays and timer wheel.
+  */
+void TIM2_IRQHandler(void)
+{
+  HRT_ISR();
+  TWheel_ISR();
+}
+
+/**
+  * @brief This function handles EXTI line3 interrupt - CHRG_STATUS.
+  */
+void EXTI3_IRQHandler(void)
+{
+  Power_ChrgStatusISR();
+}
+
+/**
+  * @brief This function handles I2C3 event interrupt - Power bus.
+  */
+void I2C3_EV_IRQHandler(void)
+{
+  dI2C_EV_ISR(I2C3);
+}
+
+/**
+  * @brief This function handles I2C3 error interrupt - Power bus.
+  */
+void I2C3_ER_IRQHandler(void)
+{
+  dI2C_ER_ISR(I2C3);
+}
+
+/**
+  * @brief This function handles DMA1 channel4 global interrupt - TCM Tx.
+  */
+void DMA1_Channel4_IRQHandler(void)
+{
+  dUART_TxDMA_ISR(dUART_PORT_TCM);
+}
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
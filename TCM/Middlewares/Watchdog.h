@@ -22,15 +22,15 @@ typedef enum {
 	WD_IOTASK,
 	WD_DAQ,
 	WD_CFG,
-	WD_CMDUSB,
-	WD_CMDTCM,
+	WD_COM,
 	WD_COMDATA,
-	WD_EVTUSB,
-	WD_EVTTCM,
 	WD_AxMHOST,
-	WD_AxM1,
-	WD_AxM2,
 	WD_UPDATEAxM,
+	WD_LOG,
+	WD_LOGWR,
+	WD_EXPORT,
+	WD_BBOX,
+	WD_AXMUPD,
 	WD_TASK_N_ENUM,
 }watchdogTask_t;
 
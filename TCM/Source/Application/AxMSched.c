@@ -0,0 +1,294 @@
+/**
+ *  @file AxMSched.c
+ *  @brief AxM poll scheduler
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "AxMSched.h"
+#include "CfgDev.h"
+#include "SrcLoad.h"
+#include "Fusion.h"
+
+/* Macros */
+
+/* Disconnected - discovery, backs off while nothing answers */
+#define AXMSCHED_DISCOVER_TIME      (1000)  // 1 sec
+#define AXMSCHED_DISCOVER_TIME_MAX  (8000)  // 8 secs
+/* Connected, not measured */
+#define AXMSCHED_HOUSEKEEP_TIME     (500)   // 500 msecs
+/* Housekeeping slows down while the other module is measured */
+#define AXMSCHED_HOUSEKEEP_SLOW     (4)
+/* Data rate before configured */
+#define AXMSCHED_DATA_RATE          (10)    // 10 Hz
+#define AXMSCHED_DATA_RATE_MAX      (1000)  // 1 kHz
+
+/* Response timeout bounds */
+#define AXMSCHED_TIMEOUT_MIN        (10)    // 10 msecs
+#define AXMSCHED_TIMEOUT_MAX        (200)   // 200 msecs
+/* Missed responses before disconnected */
+#define AXMSCHED_MAX_MISSES         (3)
+
+/* Types */
+
+/* Module context */
+typedef struct {
+    AxMSched_State_t State;
+    volatile bool Active;           // Measured besides the selected source
+    volatile uint32_t DataPeriod;   // msecs
+    uint32_t DiscoverPeriod;        // msecs
+    TickType_t LastPoll;
+    HRTime_t SentTime;
+    bool Pending;
+    uint32_t Misses;
+    uint32_t LatAvg;                // usecs, 0 till first response
+    uint32_t LatDev;                // usecs
+} AxMSched_Ctx_t;
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static AxMSched_Ctx_t AxMSched_Ctx[AXMSCHED_N_AXM];
+
+/* Private Functions */
+
+/* Get context - module 1, 2 */
+static inline AxMSched_Ctx_t *AxMSched_GetCtx(uint32_t AxM)
+{
+    if ((AxM == 0) || (AxM > AXMSCHED_N_AXM))
+        return NULL;
+    return &AxMSched_Ctx[AxM - 1];
+}
+
+/* Is module measured - selected load source, time aligned stream or requested */
+static bool AxMSched_IsMeasured(uint32_t Idx)
+{
+    uint32_t src = (Idx == 0) ? SRC_LOAD_AUX1 : SRC_LOAD_AUX2;
+
+    return (AxMSched_Ctx[Idx].Active || (CfgDev_Get_SrcLoad() == src) || Fusion_IsSubscribed());
+}
+
+/* Shortest poll period the module keeps up with (msecs) */
+static inline uint32_t AxMSched_LatPeriod(AxMSched_Ctx_t *Ctx)
+{
+    return ((Ctx->LatAvg + (4 * Ctx->LatDev)) + 999) / 1000;
+}
+
+/* Poll period of module (msecs) */
+static uint32_t AxMSched_Period(uint32_t Idx)
+{
+    AxMSched_Ctx_t *ctx = &AxMSched_Ctx[Idx];
+    uint32_t period;
+
+    switch (ctx->State) {
+    case AXMSCHED_ACTIVE:
+        period = MAX(ctx->DataPeriod, AxMSched_LatPeriod(ctx));
+        break;
+
+    case AXMSCHED_IDLE:
+        period = AXMSCHED_HOUSEKEEP_TIME;
+        /* Bus time goes to the measured source */
+        for (uint32_t i = 0; i < AXMSCHED_N_AXM; i++) {
+            if ((i != Idx) && (AxMSched_Ctx[i].State == AXMSCHED_ACTIVE))
+                period *= AXMSCHED_HOUSEKEEP_SLOW;
+        }
+        break;
+
+    default:
+        period = ctx->DiscoverPeriod;
+        break;
+    }
+
+    return period;
+}
+
+/* Public Functions */
+
+/* Init */
+void AxMSched_Init(void)
+{
+    memset(AxMSched_Ctx, 0, sizeof(AxMSched_Ctx));
+
+    TickType_t now = xTaskGetTickCount();
+    for (uint32_t i = 0; i < AXMSCHED_N_AXM; i++) {
+        AxMSched_Ctx[i].State = AXMSCHED_DISCONNECTED;
+        AxMSched_Ctx[i].DataPeriod = 1000 / AXMSCHED_DATA_RATE;
+        AxMSched_Ctx[i].DiscoverPeriod = AXMSCHED_DISCOVER_TIME;
+        /* Discover right away */
+        AxMSched_Ctx[i].LastPoll = now - pdMS_TO_TICKS(AXMSCHED_DISCOVER_TIME);
+    }
+}
+
+/* Set data rate (Hz) of a module */
+StdReturn_t AxMSched_SetDataRate(uint32_t AxM, uint32_t Rate)
+{
+    AxMSched_Ctx_t *ctx = AxMSched_GetCtx(AxM);
+    if ((ctx == NULL) || (Rate == 0) || (Rate > AXMSCHED_DATA_RATE_MAX))
+        return RET_ARGS_NOK;
+
+    ctx->DataPeriod = 1000 / Rate;
+    return RET_OK;
+}
+
+/* Set module as measured - besides the selected load source */
+void AxMSched_SetActive(uint32_t AxM, bool Active)
+{
+    AxMSched_Ctx_t *ctx = AxMSched_GetCtx(AxM);
+    if (ctx != NULL)
+        ctx->Active = Active;
+}
+
+/* Next poll - module (1, 2) or 0 with the ticks to wait */
+uint32_t AxMSched_Next(AxMSched_Poll_t *Poll, TickType_t *Wait)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t minWait = pdMS_TO_TICKS(AXMSCHED_DISCOVER_TIME_MAX);
+    TickType_t maxLate = 0;
+    uint32_t next = 0;
+
+    for (uint32_t i = 0; i < AXMSCHED_N_AXM; i++) {
+        AxMSched_Ctx_t *ctx = &AxMSched_Ctx[i];
+
+        /* Measured source follows the selection once connected */
+        if (ctx->State != AXMSCHED_DISCONNECTED)
+            ctx->State = AxMSched_IsMeasured(i) ? AXMSCHED_ACTIVE : AXMSCHED_IDLE;
+
+        /* One poll in flight per module */
+        if (ctx->Pending)
+            continue;
+
+        TickType_t period = pdMS_TO_TICKS(AxMSched_Period(i));
+        TickType_t elapsed = now - ctx->LastPoll;
+
+        if (elapsed < period) {
+            minWait = MIN(minWait, (period - elapsed));
+            continue;
+        }
+
+        /* Most overdue first, measured source on a tie */
+        TickType_t late = elapsed - period;
+        if ((next == 0) || (late > maxLate) ||
+                ((late == maxLate) && (ctx->State == AXMSCHED_ACTIVE))) {
+            next = i + 1;
+            maxLate = late;
+        }
+    }
+
+    if (next == 0) {
+        *Wait = minWait;
+        return 0;
+    }
+
+    switch (AxMSched_Ctx[next - 1].State) {
+    case AXMSCHED_ACTIVE:
+        *Poll = AXMSCHED_POLL_DATA;
+        break;
+    case AXMSCHED_IDLE:
+        *Poll = AXMSCHED_POLL_HOUSEKEEP;
+        break;
+    default:
+        *Poll = AXMSCHED_POLL_DISCOVER;
+        break;
+    }
+    *Wait = 0;
+    return next;
+}
+
+/* Poll sent */
+void AxMSched_PollSent(uint32_t AxM)
+{
+    AxMSched_Ctx_t *ctx = AxMSched_GetCtx(AxM);
+    if (ctx == NULL)
+        return;
+
+    ctx->LastPoll = xTaskGetTickCount();
+    ctx->SentTime = HRT_GetTick();
+    ctx->Pending = true;
+}
+
+/* Poll done - response or timeout */
+void AxMSched_PollDone(uint32_t AxM, bool Responded)
+{
+    AxMSched_Ctx_t *ctx = AxMSched_GetCtx(AxM);
+    if ((ctx == NULL) || !ctx->Pending)
+        return;
+
+    ctx->Pending = false;
+
+    if (!Responded) {
+        if (++ctx->Misses < AXMSCHED_MAX_MISSES)
+            return;
+        /* Back off discovery while nothing answers */
+        if (ctx->State == AXMSCHED_DISCONNECTED)
+            ctx->DiscoverPeriod = MIN((ctx->DiscoverPeriod * 2), AXMSCHED_DISCOVER_TIME_MAX);
+        ctx->State = AXMSCHED_DISCONNECTED;
+        ctx->LatAvg = 0;
+        ctx->LatDev = 0;
+        return;
+    }
+
+    /* Smoothed latency and deviation - gains 1/8 and 1/4 */
+    uint32_t lat = MAX((HRT_GetTick() - ctx->SentTime), 1);
+    if (ctx->LatAvg == 0) {
+        ctx->LatAvg = lat;
+        ctx->LatDev = lat / 2;
+    } else {
+        uint32_t diff = (lat > ctx->LatAvg) ? (lat - ctx->LatAvg) : (ctx->LatAvg - lat);
+        ctx->LatDev = ctx->LatDev - (ctx->LatDev / 4) + (diff / 4);
+        ctx->LatAvg = ctx->LatAvg - (ctx->LatAvg / 8) + (lat / 8);
+    }
+
+    ctx->Misses = 0;
+    ctx->DiscoverPeriod = AXMSCHED_DISCOVER_TIME;
+    ctx->State = AxMSched_IsMeasured(AxM - 1) ? AXMSCHED_ACTIVE : AXMSCHED_IDLE;
+}
+
+/* Expire polls left unanswered past the timeout */
+void AxMSched_Expire(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    for (uint32_t i = 0; i < AXMSCHED_N_AXM; i++) {
+        AxMSched_Ctx_t *ctx = &AxMSched_Ctx[i];
+        if (ctx->Pending && ((now - ctx->LastPoll) > AxMSched_GetTimeout(i + 1)))
+            AxMSched_PollDone(i + 1, false);
+    }
+}
+
+/* Response timeout (ticks) of a module */
+TickType_t AxMSched_GetTimeout(uint32_t AxM)
+{
+    AxMSched_Ctx_t *ctx = AxMSched_GetCtx(AxM);
+    if ((ctx == NULL) || (ctx->LatAvg == 0))
+        return pdMS_TO_TICKS(AXMSCHED_TIMEOUT_MAX);
+
+    uint32_t timeout = AxMSched_LatPeriod(ctx);
+    timeout = MAX(timeout, AXMSCHED_TIMEOUT_MIN);
+    timeout = MIN(timeout, AXMSCHED_TIMEOUT_MAX);
+    return pdMS_TO_TICKS(timeout);
+}
+
+/* Get module state */
+AxMSched_State_t AxMSched_GetState(uint32_t AxM)
+{
+    AxMSched_Ctx_t *ctx = AxMSched_GetCtx(AxM);
+    if (ctx == NULL)
+        return AXMSCHED_DISCONNECTED;
+    return ctx->State;
+}
+
+/* Get smoothed response latency (usecs) */
+uint32_t AxMSched_GetLatency(uint32_t AxM)
+{
+    AxMSched_Ctx_t *ctx = AxMSched_GetCtx(AxM);
+    if (ctx == NULL)
+        return 0;
+    return ctx->LatAvg;
+}
+
+/******************************** End of File *********************************/
@@ -0,0 +1,58 @@
+/**
+ *  @file AxMSched.h
+ *  @brief AxM poll scheduler
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _AXMSCHED_H_
+#define _AXMSCHED_H_
+
+/* Includes */
+#include "PAL.h"
+#include "RTOS.h"
+
+/* Macros */
+
+/* Modules */
+#define AXMSCHED_N_AXM      (2)
+
+/* Types */
+
+/* Module state */
+typedef enum {
+    AXMSCHED_DISCONNECTED = 0,  // Discovery rate
+    AXMSCHED_IDLE,              // Connected, housekeeping rate
+    AXMSCHED_ACTIVE,            // Source being measured, data rate
+} AxMSched_State_t;
+
+/* Poll type */
+typedef enum {
+    AXMSCHED_POLL_DISCOVER = 0,
+    AXMSCHED_POLL_HOUSEKEEP,
+    AXMSCHED_POLL_DATA,
+} AxMSched_Poll_t;
+
+/* Function Prototypes */
+/* Init */
+void AxMSched_Init(void);
+/* Set data rate (Hz) of a module */
+StdReturn_t AxMSched_SetDataRate(uint32_t AxM, uint32_t Rate);
+/* Set module as measured - besides the selected load source */
+void AxMSched_SetActive(uint32_t AxM, bool Active);
+/* Next poll - module (1, 2) or 0 with the ticks to wait */
+uint32_t AxMSched_Next(AxMSched_Poll_t *Poll, TickType_t *Wait);
+/* Poll sent */
+void AxMSched_PollSent(uint32_t AxM);
+/* Poll done - response or timeout */
+void AxMSched_PollDone(uint32_t AxM, bool Responded);
+/* Expire polls left unanswered past the timeout */
+void AxMSched_Expire(void);
+/* Response timeout (ticks) of a module */
+TickType_t AxMSched_GetTimeout(uint32_t AxM);
+/* Get module state */
+AxMSched_State_t AxMSched_GetState(uint32_t AxM);
+/* Get smoothed response latency (usecs) */
+uint32_t AxMSched_GetLatency(uint32_t AxM);
+
+#endif /* _AXMSCHED_H_ */
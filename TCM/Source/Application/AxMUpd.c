@@ -0,0 +1,465 @@
+/**
+ *  @file AxMUpd.c
+ *  @brief AxM firmware update - windowed transfer
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "AxMUpd.h"
+#include "RTOS.h"
+#include "Tasks.h"
+#include "BufUtil.h"
+
+#include "AxMi.h"
+#include "COM.h"
+
+#include "Error.h"
+#include "Watchdog.h"
+
+#include "ff.h"
+
+/* Macros */
+
+/* Device address of AxM bootloader */
+#define AXMUPD_DEVADDR          (0x01)
+
+/* Chunk not acknowledged - resend */
+#define AXMUPD_ACK_TIMEOUT      (250)   // 250 msecs
+/* Chunk behind a received one - resend, unless sent this recently */
+#define AXMUPD_RESEND_GUARD     (20)    // 20 msecs
+/* Wait for acknowledgements */
+#define AXMUPD_POLL_TIME        (10)    // 10 msecs
+/* Start and finish - AxM erases and verifies flash */
+#define AXMUPD_CTRL_TIMEOUT     (3000)  // 3 secs
+/* Sends of a chunk or a control command before giving up */
+#define AXMUPD_MAX_RETRIES      (8)
+
+/* Progress reported in steps of (%) */
+#define AXMUPD_REPORT_STEP      (5)
+
+/* Frame - header, option, sequence, chunk, chunk CRC and frame CRC */
+#define AXMUPD_FRAME_LEN        (3 + 1 + 4 + AXMUPD_CHUNK_LEN + 2 + 1)
+
+/* Types */
+
+/* Chunk in flight */
+typedef struct {
+    uint32_t Seq;
+    uint32_t Len;
+    TickType_t SentTick;
+    uint32_t Retries;
+    bool Acked;
+    uint8_t Data[AXMUPD_CHUNK_LEN];
+} AxMUpd_Slot_t;
+
+/* Response from AxM */
+typedef struct {
+    uint8_t Opt;
+    uint32_t Arg1;
+    uint32_t Arg2;
+} AxMUpd_Rsp_t;
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static TaskHandle_t xAxMUpdTaskHandle;
+
+static volatile bool UpdActive = false;
+static volatile StdReturn_t UpdResult = RET_OK;
+static volatile uint32_t UpdAxM = 0;
+static volatile uint32_t UpdProgress = 0;
+static uint32_t UpdReported = 0;
+
+/* Latest response - written by COM task */
+static AxMUpd_Rsp_t UpdRsp;
+static SemaphoreHandle_t UpdRspSem;
+
+/* Window - kept for retransmits, slot is sequence modulo window */
+static AxMUpd_Slot_t UpdSlots[AXMUPD_WINDOW_MAX];
+
+static uint8_t UpdTxBuf[AXMUPD_FRAME_LEN];
+static uint8_t UpdRdBuf[AXMUPD_CHUNK_LEN];
+
+/* Image file - opened by AxMUpd_Start, closed by the task */
+static FIL UpdFile;
+static uint32_t UpdImageSize = 0;
+
+/* CRC16 CCITT - nibble table */
+static const uint16_t CRC16Tbl[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+/* Private Functions */
+
+/* CRC16 - chunks and image */
+static uint16_t AxMUpd_CRC16(const uint8_t *Buf, uint32_t Len, uint16_t Crc)
+{
+    for (uint32_t i = 0; i < Len; i++) {
+        Crc = (Crc << 4) ^ CRC16Tbl[((Crc >> 12) ^ (Buf[i] >> 4)) & 0x0F];
+        Crc = (Crc << 4) ^ CRC16Tbl[((Crc >> 12) ^ (Buf[i] & 0x0F)) & 0x0F];
+    }
+    return Crc;
+}
+
+/* Send frame to AxM */
+static StdReturn_t AxMUpd_Tx(uint8_t Opt, uint8_t *Data, uint32_t Len)
+{
+    UpdTxBuf[0] = AXMUPD_DEVADDR;
+    UpdTxBuf[1] = AXMUPD_FUNCCODE;
+    UpdTxBuf[2] = (uint8_t) (1 + Len);
+    UpdTxBuf[3] = Opt;
+    /* Chunks are built in place */
+    if ((Len > 0) && (Data != &UpdTxBuf[4]))
+        memcpy(&UpdTxBuf[4], Data, Len);
+    UpdTxBuf[4 + Len] = GetCRC(UpdTxBuf, (4 + Len));
+
+    if (UpdAxM == 1)
+        return AxMi_Tx(AxMi_AxM1, UpdTxBuf, (5 + Len));
+    return AxMi_Tx(AxMi_AxM2, UpdTxBuf, (5 + Len));
+}
+
+/* Send chunk */
+static StdReturn_t AxMUpd_TxChunk(AxMUpd_Slot_t *Slot)
+{
+    uint8_t *data = &UpdTxBuf[4];
+
+    /* Built in place after the header */
+    SetValUINT32(Slot->Seq, &data[0]);
+    memcpy(&data[4], Slot->Data, Slot->Len);
+    uint16_t crc = AxMUpd_CRC16(Slot->Data, Slot->Len, 0xFFFF);
+    data[4 + Slot->Len] = (uint8_t) crc;
+    data[5 + Slot->Len] = (uint8_t) (crc >> 8);
+
+    Slot->SentTick = xTaskGetTickCount();
+    return AxMUpd_Tx(AXMUPD_OPT_DATA, data, (6 + Slot->Len));
+}
+
+/* Wait for response */
+static bool AxMUpd_Wait(TickType_t Wait, AxMUpd_Rsp_t *Rsp)
+{
+    if (pdFALSE == xSemaphoreTake(UpdRspSem, Wait))
+        return false;
+
+    taskENTER_CRITICAL();
+    *Rsp = UpdRsp;
+    taskEXIT_CRITICAL();
+    return true;
+}
+
+/* Control command - resent till the AxM responds */
+static StdReturn_t AxMUpd_Request(uint8_t Opt, uint8_t *Data, uint32_t Len, AxMUpd_Rsp_t *Rsp)
+{
+    for (uint32_t retry = 0; retry < AXMUPD_MAX_RETRIES; retry++) {
+        WD_Status(WD_AXMUPD, WD_ALIVE);
+
+        /* Drop stale responses */
+        xSemaphoreTake(UpdRspSem, 0);
+        AxMUpd_Tx(Opt, Data, Len);
+
+        TickType_t tickStart = xTaskGetTickCount();
+        while ((xTaskGetTickCount() - tickStart) < pdMS_TO_TICKS(AXMUPD_CTRL_TIMEOUT)) {
+            WD_Status(WD_AXMUPD, WD_ALIVE);
+            if (AxMUpd_Wait(pdMS_TO_TICKS(AXMUPD_POLL_TIME), Rsp) && (Rsp->Opt == Opt))
+                return RET_OK;
+        }
+    }
+    return RET_TIMEDOUT;
+}
+
+/* Report progress to host */
+static void AxMUpd_Report(bool Force)
+{
+    if (!Force && ((UpdProgress - UpdReported) < AXMUPD_REPORT_STEP))
+        return;
+    UpdReported = UpdProgress;
+    COM_SetEvent(COM_PORT_USB, EVT_USB_AXMUPD);
+}
+
+/* Image CRC - verified by AxM before switching */
+static StdReturn_t AxMUpd_ImageCRC(uint32_t ImageSize, AxMUpd_ReadCB_t ReadCB, uint16_t *Crc)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (uint32_t offset = 0; offset < ImageSize; offset += AXMUPD_CHUNK_LEN) {
+        uint32_t len = MIN(AXMUPD_CHUNK_LEN, (ImageSize - offset));
+        if (RET_OK != ReadCB(offset, UpdRdBuf, len))
+            return RET_NOK;
+        crc = AxMUpd_CRC16(UpdRdBuf, len, crc);
+    }
+
+    *Crc = crc;
+    return RET_OK;
+}
+
+/* Transfer chunks - sliding window, selective retransmit */
+static StdReturn_t AxMUpd_Transfer(uint32_t ImageSize, AxMUpd_ReadCB_t ReadCB, uint32_t Base, uint32_t Window)
+{
+    uint32_t nChunks = (ImageSize + AXMUPD_CHUNK_LEN - 1) / AXMUPD_CHUNK_LEN;
+    uint32_t next = Base;
+    AxMUpd_Rsp_t rsp;
+
+    while (Base < nChunks) {
+        WD_Status(WD_AXMUPD, WD_ALIVE);
+
+        /* Fill the window */
+        while ((next < nChunks) && (next < (Base + Window))) {
+            AxMUpd_Slot_t *slot = &UpdSlots[next % AXMUPD_WINDOW_MAX];
+            uint32_t offset = next * AXMUPD_CHUNK_LEN;
+
+            slot->Seq = next;
+            slot->Len = MIN(AXMUPD_CHUNK_LEN, (ImageSize - offset));
+            slot->Retries = 0;
+            slot->Acked = false;
+            if (RET_OK != ReadCB(offset, slot->Data, slot->Len))
+                return RET_NOK;
+            AxMUpd_TxChunk(slot);
+            next++;
+        }
+
+        /* Acknowledgements */
+        if (AxMUpd_Wait(pdMS_TO_TICKS(AXMUPD_POLL_TIME), &rsp) && (rsp.Opt == AXMUPD_OPT_ACK)) {
+            uint32_t cum = rsp.Arg1;
+            uint32_t mask = rsp.Arg2;
+            uint32_t highest = cum;
+
+            /* Ignore stale or out of range */
+            if ((cum >= Base) && (cum <= next)) {
+                Base = cum;
+                for (uint32_t seq = (Base + 1); seq < next; seq++) {
+                    if ((seq - Base - 1) < 32 && (mask & (1UL << (seq - Base - 1)))) {
+                        UpdSlots[seq % AXMUPD_WINDOW_MAX].Acked = true;
+                        highest = seq;
+                    }
+                }
+
+                /* Gaps behind a received chunk were lost - resend now */
+                TickType_t now = xTaskGetTickCount();
+                for (uint32_t seq = Base; seq < highest; seq++) {
+                    AxMUpd_Slot_t *slot = &UpdSlots[seq % AXMUPD_WINDOW_MAX];
+                    if (!slot->Acked && ((now - slot->SentTick) >= pdMS_TO_TICKS(AXMUPD_RESEND_GUARD))) {
+                        if (++slot->Retries > AXMUPD_MAX_RETRIES)
+                            return RET_TIMEDOUT;
+                        AxMUpd_TxChunk(slot);
+                    }
+                }
+
+                UpdProgress = (Base * 100) / nChunks;
+                AxMUpd_Report(false);
+            }
+        }
+
+        /* Timeouts */
+        TickType_t now = xTaskGetTickCount();
+        for (uint32_t seq = Base; seq < next; seq++) {
+            AxMUpd_Slot_t *slot = &UpdSlots[seq % AXMUPD_WINDOW_MAX];
+            if (!slot->Acked && ((now - slot->SentTick) >= pdMS_TO_TICKS(AXMUPD_ACK_TIMEOUT))) {
+                if (++slot->Retries > AXMUPD_MAX_RETRIES)
+                    return RET_TIMEDOUT;
+                AxMUpd_TxChunk(slot);
+            }
+        }
+    }
+
+    return RET_OK;
+}
+
+/* Image reader - from the file opened by AxMUpd_Start */
+static StdReturn_t AxMUpd_FileRead(uint32_t Offset, uint8_t *Buf, uint32_t Len)
+{
+    UINT len;
+
+    if ((FR_OK != f_lseek(&UpdFile, Offset)) || (FR_OK != f_read(&UpdFile, Buf, Len, &len)) || (len != Len))
+        return RET_NOK;
+    return RET_OK;
+}
+
+/* Run update - blocks the AxMUpd task till done */
+static StdReturn_t AxMUpd_Run(uint32_t AxM, uint32_t ImageSize, AxMUpd_ReadCB_t ReadCB)
+{
+    if (((AxM != 1) && (AxM != 2)) || (ImageSize == 0) || (ReadCB == NULL)) {
+        UpdResult = RET_ARGS_NOK;
+        UpdActive = false;
+        return RET_ARGS_NOK;
+    }
+
+    StdReturn_t ret;
+    AxMUpd_Rsp_t rsp;
+    uint16_t imageCRC;
+    uint8_t data[10];
+
+    UpdProgress = 0;
+    UpdReported = 0;
+    AxMUpd_Report(true);
+
+    ret = AxMUpd_ImageCRC(ImageSize, ReadCB, &imageCRC);
+
+    /* AxM returns the first chunk it is missing - resumes an interrupted update of the same image */
+    if (ret == RET_OK) {
+        SetValUINT32(ImageSize, &data[0]);
+        data[4] = (uint8_t) imageCRC;
+        data[5] = (uint8_t) (imageCRC >> 8);
+        data[6] = (uint8_t) AXMUPD_CHUNK_LEN;
+        data[7] = (uint8_t) (AXMUPD_CHUNK_LEN >> 8);
+        data[8] = AXMUPD_WINDOW;
+        ret = AxMUpd_Request(AXMUPD_OPT_START, data, 9, &rsp);
+    }
+
+    if (ret == RET_OK) {
+        uint32_t window = MIN(AXMUPD_WINDOW_MAX, rsp.Arg2);
+        if (window == 0)
+            window = 1;
+        ret = AxMUpd_Transfer(ImageSize, ReadCB, rsp.Arg1, window);
+    }
+
+    /* AxM verifies the image */
+    if (ret == RET_OK) {
+        UpdProgress = 100;
+        ret = AxMUpd_Request(AXMUPD_OPT_FINISH, NULL, 0, &rsp);
+        if ((ret == RET_OK) && (rsp.Arg1 != 0))
+            ret = RET_NOK;
+    }
+
+    UpdResult = ret;
+    UpdActive = false;
+    AxMUpd_Report(true);
+    return ret;
+}
+
+/* AxM Update Process - runs below COM, which hands the AxM responses over */
+static void AxMUpd_Task(void *Args)
+{
+    while (1) {
+
+        /* set watchdog status to asleep */
+        WD_Status(WD_AXMUPD, WD_ASLEEP);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* set watchdog status to alive */
+        WD_Status(WD_AXMUPD, WD_ALIVE);
+
+        AxMUpd_Run(UpdAxM, UpdImageSize, AxMUpd_FileRead);
+        f_close(&UpdFile);
+    }
+}
+
+/* Public Functions */
+
+/* Init */
+void AxMUpd_Init(void)
+{
+    static StaticSemaphore_t xUpdRspSemStruct;
+
+    UpdRspSem = xSemaphoreCreateBinaryStatic(&xUpdRspSemStruct);
+    configASSERT(UpdRspSem);
+
+    UpdActive = false;
+    UpdProgress = 0;
+
+    static StaticTask_t xAxMUpdTaskTCB;
+    static StackType_t uxAxMUpdTaskStack[AXMUPDTASK_STACKSZ];
+
+    xAxMUpdTaskHandle = xTaskCreateStatic(AxMUpd_Task,
+                                           AXMUPDTASK_NAME,
+                                           AXMUPDTASK_STACKSZ,
+                                           NULL,
+                                           AXMUPDTASK_PRIO,
+                                           uxAxMUpdTaskStack,
+                                           &xAxMUpdTaskTCB);
+    if (xAxMUpdTaskHandle == NULL)
+        Error_Handler(ERROR_TASK_CREATE);
+}
+
+/* Start update of AxM from image file */
+StdReturn_t AxMUpd_Start(uint32_t AxM, const char *Path)
+{
+    if (((AxM != 1) && (AxM != 2)) || (Path == NULL))
+        return RET_ARGS_NOK;
+    if (UpdActive)
+        return RET_ENV_NOK;
+
+    if (FR_OK != f_open(&UpdFile, Path, (FA_OPEN_EXISTING | FA_READ)))
+        return RET_HW_NOK;
+
+    UpdImageSize = (uint32_t) f_size(&UpdFile);
+    if (UpdImageSize == 0) {
+        f_close(&UpdFile);
+        return RET_ARGS_NOK;
+    }
+
+    /* Active from here - responses are routed to the update */
+    UpdAxM = AxM;
+    UpdActive = true;
+    xTaskNotifyGive(xAxMUpdTaskHandle);
+    return RET_OK;
+}
+
+/* Is update command */
+bool AxMUpd_IsUpdCmd(uint8_t *CmdBuf, uint32_t CmdLen)
+{
+    return ((CmdLen >= 2) && (CMDBYTE_FUNCCODE == AXMUPD_FUNCCODE));
+}
+
+/* Process update response from AxM */
+CmdStatus_t AxMUpd_Process(uint32_t AxM, uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+    *RspLen = 0;
+
+    /* At least 4 bytes for a message */
+    if (CmdLen < 4)
+        return CMDSTAT_PROCESSING;
+
+    /* Check for entire message */
+    uint32_t msgCnt = CMDBYTE_DATALEN + 4;
+    if (CmdLen < msgCnt)
+        return CMDSTAT_PROCESSING;
+
+    /* Not ours or corrupted - the window recovers it */
+    if (!UpdActive || (AxM != UpdAxM) || (CMDBYTE_DATALEN < 1) ||
+            (CmdBuf[msgCnt - 1] != GetCRC(CmdBuf, msgCnt - 1)))
+        return CMDSTAT_DONE;
+
+    uint8_t *pData = &CMDBYTE_DATA0;
+    AxMUpd_Rsp_t rsp = {pData[0], 0, 0};
+
+    if (CMDBYTE_DATALEN >= 5)
+        rsp.Arg1 = GetArgUINT32(&pData[1]);
+    else if (CMDBYTE_DATALEN >= 2)
+        rsp.Arg1 = pData[1];
+    if (CMDBYTE_DATALEN >= 9)
+        rsp.Arg2 = GetArgUINT32(&pData[5]);
+    else if (CMDBYTE_DATALEN == 6)
+        rsp.Arg2 = pData[5];
+
+    taskENTER_CRITICAL();
+    UpdRsp = rsp;
+    taskEXIT_CRITICAL();
+    xSemaphoreGive(UpdRspSem);
+
+    return CMDSTAT_DONE;
+}
+
+/* Is update running */
+bool AxMUpd_IsActive(void)
+{
+    return UpdActive;
+}
+
+/* Get progress (%) */
+uint32_t AxMUpd_GetProgress(void)
+{
+    return UpdProgress;
+}
+
+/* Get result of the last update */
+StdReturn_t AxMUpd_GetResult(void)
+{
+    return UpdResult;
+}
+
+/******************************** End of File *********************************/
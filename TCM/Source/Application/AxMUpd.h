@@ -0,0 +1,53 @@
+/**
+ *  @file AxMUpd.h
+ *  @brief AxM firmware update - windowed transfer
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _AXMUPD_H_
+#define _AXMUPD_H_
+
+/* Includes */
+#include "PAL.h"
+#include "Cmds.h"
+
+/* Macros */
+
+/* Update command function code */
+#define AXMUPD_FUNCCODE     (0xE2)
+
+/* Update command options */
+#define AXMUPD_OPT_START    (0x00)  // Size, image CRC, chunk length, window - AxM returns resume point
+#define AXMUPD_OPT_DATA     (0x01)  // Sequence, chunk, chunk CRC
+#define AXMUPD_OPT_ACK      (0x02)  // AxM - first missing chunk and bitmap of chunks received past it
+#define AXMUPD_OPT_FINISH   (0x03)  // AxM verifies the image - returns status
+
+/* Chunk length - bytes */
+#define AXMUPD_CHUNK_LEN    (128)
+/* Chunks in flight */
+#define AXMUPD_WINDOW       (8)
+#define AXMUPD_WINDOW_MAX   (16)
+
+/* Types */
+
+/* Image reader - Update module, file offset and length */
+typedef StdReturn_t (*AxMUpd_ReadCB_t)(uint32_t Offset, uint8_t *Buf, uint32_t Len);
+
+/* Function Prototypes */
+/* Init */
+void AxMUpd_Init(void);
+/* Is update command */
+bool AxMUpd_IsUpdCmd(uint8_t *CmdBuf, uint32_t CmdLen);
+/* Process update response from AxM */
+CmdStatus_t AxMUpd_Process(uint32_t AxM, uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen);
+/* Start update of AxM from image file */
+StdReturn_t AxMUpd_Start(uint32_t AxM, const char *Path);
+/* Is update running */
+bool AxMUpd_IsActive(void);
+/* Get progress (%) */
+uint32_t AxMUpd_GetProgress(void);
+/* Get result of the last update */
+StdReturn_t AxMUpd_GetResult(void);
+
+#endif /* _AXMUPD_H_ */
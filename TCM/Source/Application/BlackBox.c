@@ -0,0 +1,294 @@
+/**
+ *  @file BlackBox.c
+ *  @brief Break capture - full rate ring frozen around a trigger
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "BlackBox.h"
+#include "Tasks.h"
+
+#include "Error.h"
+#include "Watchdog.h"
+
+#include "BufUtil.h"
+
+#include "ff.h"
+
+/* Macros */
+
+#define BLACKBOX_MASK       (BLACKBOX_N_SAMP - 1)
+
+/* Staging for file writes - whole records */
+#define BLACKBOX_WRBUF_LEN  (56 * BLACKBOX_REC_LEN)
+#define BLACKBOX_PATH_LEN   (16)
+/* Captures kept per second of trigger time - .BBX, then .BB1 on */
+#define BLACKBOX_N_SEQ      (10)
+
+/* Types */
+
+/* Sample */
+typedef struct {
+    HRTime_t Stamp;
+    float32_t Reading;
+} BlackBox_Samp_t;
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static TaskHandle_t xBlackBoxTaskHandle;
+
+/* Ring - written by the acquisition task only */
+static BlackBox_Samp_t BBoxSamp[BLACKBOX_N_SAMP];
+static uint8_t BBoxSrc[BLACKBOX_N_SAMP];
+static volatile uint32_t BBoxHead = 0;
+
+static volatile BlackBox_State_t BBoxState = BLACKBOX_ARMED;
+/* Requested - a frozen window is written before it applies */
+static volatile bool BBoxEnable = true;
+static volatile uint32_t BBoxTrigIdx = 0;       // Head at trigger - bounds the post samples
+static volatile HRTime_t BBoxTrigStamp = 0;
+static volatile HRTime64_t BBoxTrigTime = 0;
+static volatile uint32_t BBoxCause = 0;
+
+static uint32_t BBoxPre = BLACKBOX_PRE_TIME;
+static uint32_t BBoxPost = BLACKBOX_POST_TIME;
+static uint32_t BBoxCaptures = 0;
+
+static FIL BBoxFile;
+static uint8_t BBoxWrBuf[BLACKBOX_WRBUF_LEN];
+
+/* Private Functions */
+
+/* First sample stamped at or after the trigger - queued samples may trail it */
+static uint32_t BlackBox_TrigStart(uint32_t End)
+{
+    uint32_t start = End;
+
+    /* Back till a sample before the trigger or the oldest sample */
+    while ((start > 0) && ((End - (start - 1)) < BLACKBOX_N_SAMP)) {
+        if ((int32_t)(BBoxSamp[(start - 1) & BLACKBOX_MASK].Stamp - BBoxTrigStamp) < 0)
+            break;
+        start--;
+    }
+    return start;
+}
+
+/* First sample of the pre trigger window */
+static uint32_t BlackBox_PreStart(uint32_t Trig, uint32_t End)
+{
+    uint32_t start = Trig;
+    int32_t pre = (int32_t)(BBoxPre * 1000);
+
+    /* Back till the window, the oldest sample or the post samples */
+    while ((start > 0) && ((End - (start - 1)) < BLACKBOX_N_SAMP)) {
+        if ((int32_t)(BBoxTrigStamp - BBoxSamp[(start - 1) & BLACKBOX_MASK].Stamp) > pre)
+            break;
+        start--;
+    }
+    return start;
+}
+
+/* Create file for the capture - never over an earlier one */
+static bool BlackBox_Create(uint32_t TrigTime)
+{
+    char path[BLACKBOX_PATH_LEN];
+    FRESULT fRes = FR_EXIST;
+
+    for (uint32_t seq = 0; (fRes == FR_EXIST) && (seq < BLACKBOX_N_SEQ); seq++) {
+        if (seq == 0)
+            snprintf(path, sizeof(path), "%08lX.BBX", (unsigned long) TrigTime);
+        else
+            snprintf(path, sizeof(path), "%08lX.BB%lu", (unsigned long) TrigTime, (unsigned long) seq);
+        fRes = f_open(&BBoxFile, path, (FA_CREATE_NEW | FA_WRITE));
+    }
+    return (fRes == FR_OK);
+}
+
+/* Write window to a new file - named by the time of trigger */
+static bool BlackBox_Write(uint32_t Start, uint32_t Trig, uint32_t End)
+{
+    UINT written;
+    uint32_t len = 0;
+    uint32_t trigTime = HRT_ToWallClock(BBoxTrigTime, NULL);
+
+    if (!BlackBox_Create(trigTime))
+        return false;
+
+    SetValUINT32(BLACKBOX_MAGIC, &BBoxWrBuf[0]);
+    SetValUINT16(BLACKBOX_VERSION, &BBoxWrBuf[4]);
+    SetValUINT16(BLACKBOX_HDR_LEN, &BBoxWrBuf[6]);
+    SetValUINT16(BLACKBOX_REC_LEN, &BBoxWrBuf[8]);
+    SetValUINT16(0, &BBoxWrBuf[10]);
+    SetValUINT32(BBoxCause, &BBoxWrBuf[12]);
+    SetValUINT32(BBoxTrigStamp, &BBoxWrBuf[16]);
+    SetValUINT32(trigTime, &BBoxWrBuf[20]);
+    SetValUINT32((Trig - Start), &BBoxWrBuf[24]);   // Samples before trigger
+    SetValUINT32((End - Start), &BBoxWrBuf[28]);
+    len = BLACKBOX_HDR_LEN;
+
+    bool ok = true;
+    for (uint32_t i = Start; ok && (i != End); i++) {
+        uint8_t *rec = &BBoxWrBuf[len];
+        SetValUINT32(BBoxSamp[i & BLACKBOX_MASK].Stamp, &rec[0]);
+        rec[4] = BBoxSrc[i & BLACKBOX_MASK];
+        SetValFLT32(BBoxSamp[i & BLACKBOX_MASK].Reading, &rec[5]);
+        len += BLACKBOX_REC_LEN;
+
+        if (((len + BLACKBOX_REC_LEN) > BLACKBOX_WRBUF_LEN) || ((i + 1) == End)) {
+            WD_Status(WD_BBOX, WD_ALIVE);
+            ok = (FR_OK == f_write(&BBoxFile, BBoxWrBuf, len, &written)) && (written == len);
+            len = 0;
+        }
+    }
+    if (ok && (len > 0))
+        ok = (FR_OK == f_write(&BBoxFile, BBoxWrBuf, len, &written)) && (written == len);
+
+    if (FR_OK != f_close(&BBoxFile))
+        ok = false;
+    return ok;
+}
+
+/* Capture Process - persists frozen windows, below logging */
+static void BlackBox_Task(void *Args)
+{
+    while (1) {
+
+        /* set watchdog status to asleep */
+        WD_Status(WD_BBOX, WD_ASLEEP);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* set watchdog status to alive */
+        WD_Status(WD_BBOX, WD_ALIVE);
+
+        if (BBoxState != BLACKBOX_FROZEN)
+            continue;
+
+        uint32_t end = BBoxHead;
+        uint32_t trig = BlackBox_TrigStart(end);
+        uint32_t start = BlackBox_PreStart(trig, end);
+        if (BlackBox_Write(start, trig, end))
+            BBoxCaptures++;
+        else
+            Error_Handler(ERROR_LOG_WRITE);
+
+        /* Ring refills from here, unless disabled meanwhile */
+        taskENTER_CRITICAL();
+        BBoxState = BBoxEnable ? BLACKBOX_ARMED : BLACKBOX_DISABLED;
+        taskEXIT_CRITICAL();
+    }
+}
+
+/* Public Functions */
+
+/* Init */
+void BlackBox_Init(void)
+{
+    static StaticTask_t xBlackBoxTaskTCB;
+    static StackType_t uxBlackBoxTaskStack[BBOXTASK_STACKSZ];
+
+    xBlackBoxTaskHandle = xTaskCreateStatic(BlackBox_Task,
+                                             BBOXTASK_NAME,
+                                             BBOXTASK_STACKSZ,
+                                             NULL,
+                                             BBOXTASK_PRIO,
+                                             uxBlackBoxTaskStack,
+                                             &xBlackBoxTaskTCB);
+    if (xBlackBoxTaskHandle == NULL)
+        Error_Handler(ERROR_TASK_CREATE);
+}
+
+/* Enable capture */
+void BlackBox_Enable(bool Enable)
+{
+    taskENTER_CRITICAL();
+    BBoxEnable = Enable;
+    /* Window being written finishes first, the task applies the request after it.
+     * Enabling leaves an armed or triggered capture running */
+    if (!Enable && (BBoxState != BLACKBOX_FROZEN))
+        BBoxState = BLACKBOX_DISABLED;
+    else if (Enable && (BBoxState == BLACKBOX_DISABLED))
+        BBoxState = BLACKBOX_ARMED;
+    taskEXIT_CRITICAL();
+}
+
+/* Is capture enabled */
+bool BlackBox_IsEnabled(void)
+{
+    return BBoxEnable;
+}
+
+/* Set pre and post trigger window (msecs) */
+StdReturn_t BlackBox_SetWindow(uint32_t Pre, uint32_t Post)
+{
+    if ((Post == 0) || ((Pre + Post) > 60000))
+        return RET_ARGS_NOK;
+    if (BBoxState >= BLACKBOX_POST)
+        return RET_ENV_NOK;
+
+    BBoxPre = Pre;
+    BBoxPost = Post;
+    return RET_OK;
+}
+
+/* Get pre and post trigger window (msecs) */
+void BlackBox_GetWindow(uint32_t *Pre, uint32_t *Post)
+{
+    *Pre = BBoxPre;
+    *Post = BBoxPost;
+}
+
+/* Put full rate sample - Stamp taken at acquisition */
+void BlackBox_Put(uint32_t Src, float32_t Reading, HRTime64_t Stamp)
+{
+    BlackBox_State_t state = BBoxState;
+    if ((state == BLACKBOX_DISABLED) || (state == BLACKBOX_FROZEN))
+        return;
+
+    HRTime_t now = (HRTime_t) Stamp;
+    uint32_t idx = BBoxHead & BLACKBOX_MASK;
+    BBoxSamp[idx].Stamp = now;
+    BBoxSamp[idx].Reading = Reading;
+    BBoxSrc[idx] = (uint8_t) Src;
+    BBoxHead++;
+
+    /* Post window done, or the ring would overwrite the trigger */
+    if ((state == BLACKBOX_POST) &&
+            (((int32_t)(now - BBoxTrigStamp) >= (int32_t)(BBoxPost * 1000)) || ((BBoxHead - BBoxTrigIdx) >= (BLACKBOX_N_SAMP - 1)))) {
+        BBoxState = BLACKBOX_FROZEN;
+        xTaskNotifyGive(xBlackBoxTaskHandle);
+    }
+}
+
+/* Trigger capture - Cause is the event mask, safe from ISR */
+void BlackBox_Trigger(uint32_t Cause)
+{
+    /* One capture at a time - later triggers fall in its post window */
+    if (BBoxState != BLACKBOX_ARMED)
+        return;
+
+    BBoxTrigIdx = BBoxHead;
+    BBoxTrigTime = HRT_GetTick64();
+    BBoxTrigStamp = (HRTime_t) BBoxTrigTime;
+    BBoxCause = Cause;
+    BBoxState = BLACKBOX_POST;
+}
+
+/* Get state */
+BlackBox_State_t BlackBox_GetState(void)
+{
+    return BBoxState;
+}
+
+/* Get captures written */
+uint32_t BlackBox_GetCaptures(void)
+{
+    return BBoxCaptures;
+}
+
+/******************************** End of File *********************************/
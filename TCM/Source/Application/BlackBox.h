@@ -0,0 +1,60 @@
+/**
+ *  @file BlackBox.h
+ *  @brief Break capture - full rate ring frozen around a trigger
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _BLACKBOX_H_
+#define _BLACKBOX_H_
+
+/* Includes */
+#include "PAL.h"
+
+/* Macros */
+
+/* Ring of full rate samples - power of 2 */
+#define BLACKBOX_N_SAMP     (16384)
+
+/* Capture window defaults */
+#define BLACKBOX_PRE_TIME   (2000)  // 2 secs
+#define BLACKBOX_POST_TIME  (1000)  // 1 sec
+
+/* Capture file - header, then records. Named by trigger time, a capture in the same
+ * second goes to .BB1 to .BB9 */
+#define BLACKBOX_MAGIC      (0x4B4D4354)    // "TCMK"
+#define BLACKBOX_VERSION    (1)
+#define BLACKBOX_HDR_LEN    (32)
+#define BLACKBOX_REC_LEN    (9)             // [Stamp u32 usecs][Src][Reading f32]
+
+/* Types */
+
+/* States */
+typedef enum {
+    BLACKBOX_DISABLED = 0,
+    BLACKBOX_ARMED,         // Filling the ring
+    BLACKBOX_POST,          // Triggered - filling the post window
+    BLACKBOX_FROZEN,        // Window being written to card
+} BlackBox_State_t;
+
+/* Function Prototypes */
+/* Init */
+void BlackBox_Init(void);
+/* Enable capture */
+void BlackBox_Enable(bool Enable);
+/* Is capture enabled */
+bool BlackBox_IsEnabled(void);
+/* Set pre and post trigger window (msecs) */
+StdReturn_t BlackBox_SetWindow(uint32_t Pre, uint32_t Post);
+/* Get pre and post trigger window (msecs) */
+void BlackBox_GetWindow(uint32_t *Pre, uint32_t *Post);
+/* Put full rate sample - Stamp taken at acquisition */
+void BlackBox_Put(uint32_t Src, float32_t Reading, HRTime64_t Stamp);
+/* Trigger capture - Cause is the event mask, safe from ISR */
+void BlackBox_Trigger(uint32_t Cause);
+/* Get state */
+BlackBox_State_t BlackBox_GetState(void);
+/* Get captures written */
+uint32_t BlackBox_GetCaptures(void);
+
+#endif /* _BLACKBOX_H_ */
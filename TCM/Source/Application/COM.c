@@ -17,6 +17,15 @@
 #include "USBi.h"
 #include "TCMi.h"
 #include "AxMi.h"
+#include "dUART.h"
+#include "TCMLink.h"
+#include "Fusion.h"
+#include "AxMUpd.h"
+#include "AxMSched.h"
+#include "ExportBulk.h"
+#include "BlackBox.h"
+#include "LogBin.h"
+#include "TWheel.h"
 
 #include "IO.h"
 #include "Watchdog.h"
@@ -28,331 +37,601 @@
 /* Rx/Tx Len */
 #define COM_RXBUF_LEN (256)
 #define COM_TXBUF_LEN (256)
+/* Bytes taken from a queue per pass */
+#define COM_RXSTAGE_LEN (64)
 
 /* COM receive timeout */
 #define COM_RX_TIMEOUT (10) // 10 msecs
 /* COM transmit timeout */
 #define COM_TX_TIMEOUT (100) // 100 msecs
-
-/* COM - TCM Tx lock threshold - around 0.5 secs */
-#define COM_TCM_TX_LOCK (5)
+/* Scheduler poll period, when nothing notifies */
+#define COM_POLL_TIME (2) // 2 msecs
+/* Data task wake up, while time aligned records are subscribed */
+#define COMDAT_FUSION_WAIT (10) // 10 msecs
 
 /* Types */
 
+/* Port context */
+typedef struct {
+    const COM_PortOps_t *Ops;
+    uint8_t RxBuf[COM_RXBUF_LEN];
+    uint32_t RxLen;
+    uint8_t TxBuf[COM_TXBUF_LEN];
+    uint32_t TxLen;
+    TWheel_Timer_t RxTmr;   // Receive timeout, from the last byte
+    TWheel_Timer_t IdleTmr; // Idle call period
+    volatile bool RxTimedOut;
+    volatile bool IdleDue;
+    bool RxQuiet;
+    volatile uint32_t Events;
+} COM_PortCtx_t;
+
 /* Externs */
 
 /* Function Declarations */
+static StdReturn_t COMUSB_TxData(uint8_t *Data, uint32_t Size);
+static bool COMUSB_IsTxReady(void);
+static uint32_t COMUSB_RxSpan(uint8_t **Data);
+static void COMUSB_RxConsume(uint32_t Len);
+static CmdStatus_t COMUSB_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen);
+static void COMUSB_Event(uint32_t Evt, uint8_t *RspBuf, uint32_t *RspLen);
+static void COMUSB_Idle(uint8_t *RspBuf, uint32_t *RspLen);
+static StdReturn_t COMTCM_TxData(uint8_t *Data, uint32_t Size);
+static bool COMTCM_IsTxReady(void);
+static uint32_t COMTCM_RxSpan(uint8_t **Data);
+static void COMTCM_RxConsume(uint32_t Len);
+static CmdStatus_t COMTCM_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen);
+static void COMTCM_Poll(void);
+static uint32_t COMAxM1_RxSpan(uint8_t **Data);
+static void COMAxM1_RxConsume(uint32_t Len);
+static StdReturn_t COMAxM1_TxData(uint8_t *Data, uint32_t Size);
+static CmdStatus_t COMAxM1_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen);
+static uint32_t COMAxM2_RxSpan(uint8_t **Data);
+static void COMAxM2_RxConsume(uint32_t Len);
+static StdReturn_t COMAxM2_TxData(uint8_t *Data, uint32_t Size);
+static CmdStatus_t COMAxM2_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen);
+static void COMAxM_Poll(void);
 
 /* Global Variables */
 
 /* Static Variables */
-/* USB Tx/Rx */
-static uint8_t COMUSB_RxBuf[COM_RXBUF_LEN];
-static uint8_t COMUSB_TxBuf[COM_TXBUF_LEN];
-static uint32_t COMUSB_RxLen = 0;
-static uint32_t COMUSB_TxLen = 0;
-static bool COMUSBRxInProgress = false;
-
-/* TCM Tx/Rx */
-static uint8_t COMTCM_RxBuf[COM_RXBUF_LEN];
-static uint8_t COMTCM_TxBuf[COM_TXBUF_LEN];
-static uint32_t COMTCM_RxLen = 0;
-static uint32_t COMTCM_TxLen = 0;
-
+/* Ports */
+static COM_PortCtx_t COM_Ports[COM_PORT_N_ENUM];
+
+/* USB Tx start - a completion not signalled within the Tx timeout is taken as lost */
+static volatile TickType_t COMUSB_TxTick = 0;
+
+/* Data Tx - two buffers, USB sends the last one in place till it completes */
+static uint8_t COMDAT_TxBuf[2][COM_TXBUF_LEN];
+static uint32_t COMDAT_TxLen = 0;
+static uint32_t COMDAT_TxIdx = 0;
+
+/* TCM Rx staging - drained from CmdTCMQ */
+static uint8_t COMTCM_RxStage[COM_RXSTAGE_LEN];
+static uint32_t COMTCM_RxStageLen = 0;
+
+/* USB port */
+static const COM_PortOps_t COMUSB_Ops = {
+    .RxSpan     = COMUSB_RxSpan,
+    .RxConsume  = COMUSB_RxConsume,
+    .Tx         = COMUSB_TxData,
+    .IsTxReady  = COMUSB_IsTxReady,
+    .Process    = COMUSB_Process,
+    .Event      = COMUSB_Event,
+    .Idle       = COMUSB_Idle,
+    .Poll       = NULL,
+};
+
+/* TCM port */
+static const COM_PortOps_t COMTCM_Ops = {
+    .RxSpan     = COMTCM_RxSpan,
+    .RxConsume  = COMTCM_RxConsume,
+    .Tx         = COMTCM_TxData,
+    .IsTxReady  = COMTCM_IsTxReady,
+    .Process    = COMTCM_Process,
+    .Event      = CmdTCM_Tx_Event,
+    .Idle       = NULL,
+    .Poll       = COMTCM_Poll,
+};
+
+/* AxM ports - parsed directly on the Rx DMA ring */
+static const COM_PortOps_t COMAxM1_Ops = {
+    .RxSpan     = COMAxM1_RxSpan,
+    .RxConsume  = COMAxM1_RxConsume,
+    .Tx         = COMAxM1_TxData,
+    .IsTxReady  = NULL,
+    .Process    = COMAxM1_Process,
+    .Event      = NULL,
+    .Idle       = NULL,
+    .Poll       = COMAxM_Poll,
+};
+static const COM_PortOps_t COMAxM2_Ops = {
+    .RxSpan     = COMAxM2_RxSpan,
+    .RxConsume  = COMAxM2_RxConsume,
+    .Tx         = COMAxM2_TxData,
+    .IsTxReady  = NULL,
+    .Process    = COMAxM2_Process,
+    .Event      = NULL,
+    .Idle       = NULL,
+    .Poll       = COMAxM_Poll,
+};
 
 /* Private Functions */
 
-/* Reset USB */
-static inline void COMUSB_ResetRx(void)
+/** USB **/
+
+/* USB Tx function */
+static StdReturn_t COMUSB_TxData(uint8_t *Data, uint32_t Size)
 {
-    COMUSB_RxLen = 0;
-    COMUSBRxInProgress = false;
+	if (pdTRUE == xSemaphoreTake(COMUSBSem, (TickType_t) COM_TX_TIMEOUT)) {
+		COMUSB_TxTick = xTaskGetTickCount();
+		return USBi_Tx(Data, Size);
+	}
+
+	/* If sem is not signalled from ISR, signal it and acquire it from here */
+	/* This is not the best place to do it, but keep it here for now */
+	xSemaphoreGive(COMUSBSem);
+	if (pdTRUE == xSemaphoreTake(COMUSBSem, (TickType_t) 0)) {
+		COMUSB_TxTick = xTaskGetTickCount();
+		return USBi_Tx(Data, Size);
+	}
+
+	return RET_TIMEDOUT;
 }
-static inline void COMUSB_ResetTx(void)
+
+/* USB Tx ready - USBi sends from the buffer in place, so it is free once the last transfer completed */
+static bool COMUSB_IsTxReady(void)
 {
-	COMUSB_TxLen = 0;
+	if (uxSemaphoreGetCount(COMUSBSem) > 0)
+		return true;
+
+	/* Lost completion - Tx recovers the semaphore */
+	return ((xTaskGetTickCount() - COMUSB_TxTick) >= pdMS_TO_TICKS(COM_TX_TIMEOUT));
 }
 
-/* Reset TCM */
-static inline void COMTCM_ResetRxTx(void)
+/* USB Rx span */
+static uint32_t COMUSB_RxSpan(uint8_t **Data)
 {
-    COMTCM_RxLen = 0;
-    COMTCM_TxLen = 0;
+	return USBi_RxSpan(Data);
 }
-static inline void COMTCM_ResetRx(void)
+
+/* USB Rx consume */
+static void COMUSB_RxConsume(uint32_t Len)
 {
-    COMTCM_RxLen = 0;
+	USBi_RxConsume(Len);
 }
-static inline void COMTCM_ResetTx(void)
+
+/* USB commands */
+static CmdStatus_t COMUSB_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
 {
-	COMTCM_TxLen = 0;
+	CmdStatus_t cmdStatus = CmdUSB_Process(CmdBuf, CmdLen, RspBuf, RspLen);
+
+	/* Set active, if we have a command */
+	if (cmdStatus == CMDSTAT_DONE)
+		Sys_SetCommActive();
+
+	return cmdStatus;
 }
 
-/* USB Tx function */
-static void COMUSB_TxData(uint8_t *Data, uint32_t Size)
+/* USB events */
+static void COMUSB_Event(uint32_t Evt, uint8_t *RspBuf, uint32_t *RspLen)
 {
-	if (pdTRUE == xSemaphoreTake(COMUSBSem, (TickType_t) COM_TX_TIMEOUT)) {
-		USBi_Tx(Data, Size);
-		COMUSB_ResetTx();
+	if (COM_IsASCIIMode()) {
+		/* Only export data in ASCII mode */
+		if (Evt & (EVT_USB_EXP_ADATA | EVT_USB_EXP_ADATA_H))
+			CmdUSB_Tx_Event(Evt, RspBuf, RspLen);
 	} else {
-		/* If sem is not signalled from ISR, signal it and acquire it from here */
-		/* This is not the best place to do it, but keep it here for now */
-		xSemaphoreGive(COMUSBSem);
-		if (pdTRUE == xSemaphoreTake(COMUSBSem, (TickType_t) 0)) {
-			USBi_Tx(Data, Size);
-			COMUSB_ResetTx();
-		}
+		if (Evt & EVT_USB_MASKALL)
+			CmdUSB_Tx_Event(Evt, RspBuf, RspLen);
 	}
 }
 
-/* Communication Process - Commands */
-static void COM_CMDUSBTask(void *Args)
+/* USB idle - DF2 streaming */
+static void COMUSB_Idle(uint8_t *RspBuf, uint32_t *RspLen)
 {
-    uint8_t newByte;
-    CmdStatus_t cmdStatus;
+	if (CmdUSB_IsDF2DataStreaming()) {
+		CmdUSB_SetDF2Reading(RspBuf, RspLen);
+		Sys_SetCommActive();
+	}
+}
 
-    /* Wait till Config notifies completion */
-    uint32_t notifiedValue;
-    xTaskNotifyWait(UINT_MIN, UINT_MAX, &notifiedValue, portMAX_DELAY);
+/** TCM **/
 
-    /* Release Tx Lock semaphore */
-    xSemaphoreGive(COMUSBSem);
+/* TCM Tx function */
+static StdReturn_t COMTCM_TxData(uint8_t *Data, uint32_t Size)
+{
+	/* Queued to DMA, drops are counted by the driver */
+	return dUART_Tx(dUART_PORT_TCM, Data, Size, pdMS_TO_TICKS(COM_TX_TIMEOUT));
+}
 
-    while(1) {
+/* TCM Tx ready - room for a full response */
+static bool COMTCM_IsTxReady(void)
+{
+	return (dUART_GetTxRoom(dUART_PORT_TCM) >= COM_TXBUF_LEN);
+}
 
-    	/* set watchdog status to asleep */
-    	WD_Status(WD_CMDUSB, WD_ASLEEP);
-
-        /* Commands over USB */
-        if (pdPASS == xQueueReceive(CmdUSBQ, &newByte, pdMS_TO_TICKS(COM_RX_TIMEOUT))) {
-        	/* set watchdog status to alive */
-        	WD_Status(WD_CMDUSB, WD_ALIVE);
-
-            COMUSB_RxBuf[COMUSB_RxLen++] = newByte;
-            COMUSBRxInProgress = true;
-
-            cmdStatus = CmdUSB_Process(COMUSB_RxBuf, COMUSB_RxLen, COMUSB_TxBuf, &COMUSB_TxLen);
-            /* Binary commands */
-            if (cmdStatus == CMDSTAT_DONE) {
-                if (COMUSB_TxLen > 0)
-                	COMUSB_TxData(COMUSB_TxBuf, COMUSB_TxLen);
-                COMUSB_ResetRx();
-                /* Set active, if we have a command */
-                Sys_SetCommActive();
-            }
-
-        } else if (CmdUSB_IsDF2DataStreaming()) {
-			CmdUSB_SetDF2Reading(COMUSB_TxBuf, &COMUSB_TxLen);
-			COMUSB_TxData(COMUSB_TxBuf, COMUSB_TxLen);
-			COMUSB_ResetRx();
+/* TCM Rx span */
+static uint32_t COMTCM_RxSpan(uint8_t **Data)
+{
+	/* Refill once the previous span is consumed */
+	if (COMTCM_RxStageLen == 0) {
+		while ((COMTCM_RxStageLen < COM_RXSTAGE_LEN) &&
+				(pdPASS == xQueueReceive(CmdTCMQ, &COMTCM_RxStage[COMTCM_RxStageLen], 0)))
+			COMTCM_RxStageLen++;
+	}
+
+	*Data = COMTCM_RxStage;
+	return COMTCM_RxStageLen;
+}
+
+/* TCM Rx consume */
+static void COMTCM_RxConsume(uint32_t Len)
+{
+	Len = MIN(Len, COMTCM_RxStageLen);
+	memmove(COMTCM_RxStage, &COMTCM_RxStage[Len], (COMTCM_RxStageLen - Len));
+	COMTCM_RxStageLen -= Len;
+}
+
+/* TCM commands */
+static CmdStatus_t COMTCM_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	CmdStatus_t cmdStatus;
+
+	/* Baud negotiation is handled by the link, rest by CmdTCM */
+	if (TCMLink_IsLinkCmd(CmdBuf, CmdLen))
+		cmdStatus = TCMLink_Process(CmdBuf, CmdLen, RspBuf, RspLen);
+	else
+		cmdStatus = CmdTCM_Process(CmdBuf, CmdLen, RspBuf, RspLen);
 
+	if (cmdStatus == CMDSTAT_DONE) {
+		TCMLink_Activity(CmdBuf, CmdLen);
+		if (!COM_IsASCIIMode()) {
+			/* Set active, if we have a command */
 			Sys_SetCommActive();
+			TCMi_SetConnected(true);
+		}
+	}
 
-        } else {
+	return cmdStatus;
+}
 
-        	/* set watchdog status to alive */
-        	WD_Status(WD_CMDUSB, WD_ALIVE);
-            /* Handle comm timeout */
-            if (COMUSBRxInProgress)
-            	COMUSB_ResetRx();
-        }
-    }
+/* TCM poll */
+static void COMTCM_Poll(void)
+{
+	/* Supervise Tx DMA */
+	dUART_TxCheck(dUART_PORT_TCM);
+	/* Run baud negotiation */
+	TCMLink_Tick();
 }
 
-static void COM_CMDTCMTask(void *Args)
+/** AxM **/
+
+/* AxM1 Rx notify - from ISR */
+static void COMAxM1_RxCB(void)
 {
-    bool rxInProgress = false;
-    CmdStatus_t cmdStatus;
-    uint32_t txLockCnt = 0;
-	uint8_t newByte;
+	COM_RxNotifyFromISR(COM_PORT_AxM1);
+}
 
-    /* Wait till Config notifies completion */
-    uint32_t notifiedValue;
-    xTaskNotifyWait(UINT_MIN, UINT_MAX, &notifiedValue, portMAX_DELAY);
+/* AxM1 Rx span */
+static uint32_t COMAxM1_RxSpan(uint8_t **Data)
+{
+	return dUART_RxSpan(dUART_PORT_AxM1, Data);
+}
 
-    while(1) {
+/* AxM1 Rx consume */
+static void COMAxM1_RxConsume(uint32_t Len)
+{
+	dUART_RxConsume(dUART_PORT_AxM1, Len);
+}
 
-        /* set watchdog status to asleep */
-        WD_Status(WD_CMDTCM, WD_ASLEEP);
+/* AxM1 Tx function */
+static StdReturn_t COMAxM1_TxData(uint8_t *Data, uint32_t Size)
+{
+	return AxMi_Tx(AxMi_AxM1, Data, Size);
+}
 
-        /* Commands over TCM */
-        if (pdPASS == xQueueReceive(CmdTCMQ, &newByte, pdMS_TO_TICKS(COM_RX_TIMEOUT))) {
+/* AxM1 responses */
+static CmdStatus_t COMAxM1_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	if (AxMUpd_IsUpdCmd(CmdBuf, CmdLen))
+		return AxMUpd_Process(1, CmdBuf, CmdLen, RspBuf, RspLen);
 
-            /* set watchdog status to alive */
-            WD_Status(WD_CMDTCM, WD_ALIVE);
-
-            COMTCM_RxBuf[COMTCM_RxLen++] = newByte;
-            rxInProgress = true;
-
-            cmdStatus = CmdTCM_Process(COMTCM_RxBuf, COMTCM_RxLen, COMTCM_TxBuf, &COMTCM_TxLen);
-            if (cmdStatus == CMDSTAT_DONE) {
-            	/* Tx only when there is data in buffer */
-            	if (COMTCM_TxLen > 0) {
-            		if (TCMi_IsTxReady()) {
-            			/* Tx is not locked */
-            			txLockCnt = 0;
-            			TCMi_Tx(COMTCM_TxBuf, COMTCM_TxLen);
-            		} else {
-            			/* Reset TxReady, if Tx is locked continously */
-            			if (++txLockCnt >= COM_TCM_TX_LOCK) {
-            				TCMi_ResetTxReady();
-            				txLockCnt = 0;
-            			}
-            		}
-                }
-                rxInProgress = false;
-                COMTCM_ResetRxTx();
-                if (!COM_IsASCIIMode()) {
-					/* Set active, if we have a command */
-					Sys_SetCommActive();
-					TCMi_SetConnected(true);
-                }
-            }
-        } else {
-            /* set watchdog status to alive */
-            WD_Status(WD_CMDTCM, WD_ALIVE);
+	CmdStatus_t cmdStatus = AxMi_Process(AxMi_AxM1, CmdBuf, CmdLen, RspBuf, RspLen);
+	if (cmdStatus == CMDSTAT_DONE)
+		AxMSched_PollDone(1, true);
+	return cmdStatus;
+}
 
-            /* Handle comm timeout */
-            if (rxInProgress) {
-            	COMTCM_ResetRx();
-                rxInProgress = false;
-            }
-        }
-    }
+/* AxM2 Rx notify - from ISR */
+static void COMAxM2_RxCB(void)
+{
+	COM_RxNotifyFromISR(COM_PORT_AxM2);
 }
 
-/* Communication Process - Data */
-static void COM_DATATask(void *Args)
+/* AxM2 Rx span */
+static uint32_t COMAxM2_RxSpan(uint8_t **Data)
 {
-    ChnReading_t loadReading;
-    uint32_t txTCMLockCnt = 0;
+	return dUART_RxSpan(dUART_PORT_AxM2, Data);
+}
 
-    /* Wait till Config notifies completion */
-    uint32_t notifiedValue;
-    xTaskNotifyWait(UINT_MIN, UINT_MAX, &notifiedValue, portMAX_DELAY);
+/* AxM2 Rx consume */
+static void COMAxM2_RxConsume(uint32_t Len)
+{
+	dUART_RxConsume(dUART_PORT_AxM2, Len);
+}
 
-    while(1) {
+/* AxM2 Tx function */
+static StdReturn_t COMAxM2_TxData(uint8_t *Data, uint32_t Size)
+{
+	return AxMi_Tx(AxMi_AxM2, Data, Size);
+}
 
-    	/* set watchdog status to asleep */
-    	WD_Status(WD_COMDATA, WD_ASLEEP);
+/* AxM2 responses */
+static CmdStatus_t COMAxM2_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	if (AxMUpd_IsUpdCmd(CmdBuf, CmdLen))
+		return AxMUpd_Process(2, CmdBuf, CmdLen, RspBuf, RspLen);
 
-        /* Send data from MxA */
-        if (pdPASS == xQueueReceive(ComDataQ, &loadReading, portMAX_DELAY)) {
+	CmdStatus_t cmdStatus = AxMi_Process(AxMi_AxM2, CmdBuf, CmdLen, RspBuf, RspLen);
+	if (cmdStatus == CMDSTAT_DONE)
+		AxMSched_PollDone(2, true);
+	return cmdStatus;
+}
 
-            /* set watchdog status to alive */
-            WD_Status(WD_COMDATA, WD_ALIVE);
+/* AxM polls - one schedule for both modules, run from either port's pass */
+static void COMAxM_Poll(void)
+{
+	AxMSched_Poll_t poll;
+	TickType_t wait;
+	uint32_t axm;
 
+	AxMSched_Expire();
 
-            /* If TCM burst is enabled, send data to TCM port. Otherwise, USB port */
-            if (TCMi_IsConnected() && TCMi_GetBurstMode()) {
-            	CmdTCM_Tx_Reading(loadReading.Reading, TCMi_GetReading(), COMTCM_TxBuf, &COMTCM_TxLen);
-            	if (TCMi_IsTxReady()) {
-            		txTCMLockCnt = 0;
-            		TCMi_Tx(COMTCM_TxBuf, COMTCM_TxLen);
-            	} else {
-            		/* Reset TxReady, if Tx is locked continously */
-            		if (++txTCMLockCnt >= COM_TCM_TX_LOCK) {
-            			TCMi_ResetTxReady();
-            			txTCMLockCnt = 0;
-            		}
-                }
-                COMTCM_ResetTx();
-	        } else {
-        		if (COM_IsASCIIMode())
-        			CmdUSB_Tx_ASCIIReading(loadReading.Src, loadReading.Reading, COMUSB_TxBuf, &COMUSB_TxLen);
-        		else
-        			CmdUSB_Tx_Reading(loadReading.Src, loadReading.Reading, COMUSB_TxBuf, &COMUSB_TxLen);
-        		COMUSB_TxData(COMUSB_TxBuf, COMUSB_TxLen);
-        	}
+	/* Firmware update owns the links */
+	if (AxMUpd_IsActive())
+		return;
 
-        }
-    }
+	/* Sent polls stay pending, so each module is handed out once at most */
+	while (0 != (axm = AxMSched_Next(&poll, &wait))) {
+		if (RET_OK != AxMi_Poll((axm == 1) ? AxMi_AxM1 : AxMi_AxM2, poll))
+			break;
+		AxMSched_PollSent(axm);
+	}
 }
 
-/* Communication Process - Events - USB */
-static void COM_EVTUSBTask(void *Args)
+/** Scheduler **/
+
+/* Transmit response */
+static inline void COM_PortTx(COM_PortCtx_t *Ctx)
 {
-    uint32_t comEvent = 0;
-    bool txEventUSB = false;
+	if (Ctx->TxLen > 0)
+		Ctx->Ops->Tx(Ctx->TxBuf, Ctx->TxLen);
+	Ctx->TxLen = 0;
+}
 
-    /* Wait till Config notifies completion */
+/* Is Tx buffer free - the last response has been handed over */
+static inline bool COM_PortIsTxReady(COM_PortCtx_t *Ctx)
+{
+	return ((Ctx->Ops->IsTxReady == NULL) || Ctx->Ops->IsTxReady());
+}
+
+/* Take pending events */
+static inline uint32_t COM_TakeEvents(COM_PortCtx_t *Ctx)
+{
+	taskENTER_CRITICAL();
+	uint32_t evt = Ctx->Events;
+	Ctx->Events = 0;
+	taskEXIT_CRITICAL();
+
+	return evt;
+}
+
+/* Receive timeout - from the timer ISR */
+static void COM_RxTmrCB(void *Arg)
+{
+	COM_PortCtx_t *ctx = (COM_PortCtx_t*)Arg;
+
+	ctx->RxTimedOut = true;
+	COM_RxNotifyFromISR((COM_Port_t)(ctx - COM_Ports));
+}
+
+/* Idle period - from the timer ISR */
+static void COM_IdleTmrCB(void *Arg)
+{
+	COM_PortCtx_t *ctx = (COM_PortCtx_t*)Arg;
+
+	ctx->IdleDue = true;
+	COM_RxNotifyFromISR((COM_Port_t)(ctx - COM_Ports));
+}
+
+/* Service port - returns true if more data may be waiting */
+static bool COM_PortService(COM_PortCtx_t *Ctx)
+{
+	const COM_PortOps_t *ops = Ctx->Ops;
+	CmdStatus_t cmdStatus;
+	uint8_t *data;
+	uint32_t len;
+
+	if (ops->Poll != NULL)
+		ops->Poll();
+
+	/* Hold off till there is room for a response */
+	if (!COM_PortIsTxReady(Ctx))
+		return false;
+
+	/* Commands - one span per pass keeps ports fair */
+	len = ops->RxSpan(&data);
+	if (len > 0) {
+		for (uint32_t i = 0; i < len; i++) {
+			/* Drop runaway frames */
+			if (Ctx->RxLen >= COM_RXBUF_LEN)
+				Ctx->RxLen = 0;
+
+			Ctx->RxBuf[Ctx->RxLen++] = data[i];
+
+			Ctx->TxLen = 0;
+			cmdStatus = ops->Process(Ctx->RxBuf, Ctx->RxLen, Ctx->TxBuf, &Ctx->TxLen);
+			if (cmdStatus == CMDSTAT_DONE) {
+				Ctx->RxLen = 0;
+				if (Ctx->TxLen > 0) {
+					/* One response per pass - the rest of the span waits for the buffer */
+					COM_PortTx(Ctx);
+					len = i + 1;
+					break;
+				}
+			}
+		}
+		ops->RxConsume(len);
+		/* Timeout restarts - an expiry before the rearm is stale */
+		TWheel_Arm(&Ctx->RxTmr, COM_RX_TIMEOUT);
+		Ctx->RxTimedOut = false;
+		Ctx->RxQuiet = false;
+	} else if (Ctx->RxTimedOut) {
+		/* Handle comm timeout */
+		Ctx->RxTimedOut = false;
+		Ctx->RxLen = 0;
+		Ctx->RxQuiet = true;
+	}
+
+	/* Quiet line */
+	if (Ctx->IdleDue && Ctx->RxQuiet && COM_PortIsTxReady(Ctx)) {
+		Ctx->IdleDue = false;
+		Ctx->TxLen = 0;
+		ops->Idle(Ctx->TxBuf, &Ctx->TxLen);
+		COM_PortTx(Ctx);
+		TWheel_Arm(&Ctx->IdleTmr, COM_RX_TIMEOUT);
+	}
+
+	/* Events - kept pending till the buffer is free */
+	if ((ops->Event != NULL) && COM_PortIsTxReady(Ctx)) {
+		uint32_t evt = COM_TakeEvents(Ctx);
+		if (evt != 0) {
+			Ctx->TxLen = 0;
+			ops->Event(evt, Ctx->TxBuf, &Ctx->TxLen);
+			COM_PortTx(Ctx);
+		}
+	}
+
+	return (len > 0);
+}
+
+/* Wait for the start-up bit - port bits arriving meanwhile are kept */
+static uint32_t COM_WaitStart(void)
+{
     uint32_t notifiedValue;
-    xTaskNotifyWait(UINT_MIN, UINT_MAX, &notifiedValue, portMAX_DELAY);
+    uint32_t pending = 0;
 
-    while(1) {
-    	/* set watchdog status to asleep */
-    	WD_Status(WD_EVTUSB, WD_ASLEEP);
+    do {
+        xTaskNotifyWait(UINT_MIN, UINT_MAX, &notifiedValue, portMAX_DELAY);
+        pending |= (notifiedValue & COM_NOTIFY_PORTS);
+    } while (!(notifiedValue & COM_NOTIFY_START));
 
-        /* Wait for an event */
-        xTaskNotifyWait(UINT_MIN, UINT_MAX, &comEvent, portMAX_DELAY);
+    return pending;
+}
 
-    	/* set watchdog status to alive */
-    	WD_Status(WD_EVTUSB, WD_ALIVE);
+/* Communication Process - All ports */
+static void COM_Task(void *Args)
+{
+    uint32_t notifiedValue;
+    uint32_t busy;
+    TickType_t pollTick;
 
-    	/* Process events */
-    	if ((comEvent & EVT_USB_MASKALL) && !COM_IsASCIIMode()) {
-    		CmdUSB_Tx_Event(comEvent, COMUSB_TxBuf, &COMUSB_TxLen);
-    		txEventUSB = true;
-    	}
+    /* Wait till Config notifies completion, USB Rx may notify before */
+    busy = COM_WaitStart();
+    pollTick = xTaskGetTickCount();
 
-    	if ((comEvent & EVT_USB_EXP_ADATA) && COM_IsASCIIMode()) {
-    		CmdUSB_Tx_Event(comEvent, COMUSB_TxBuf, &COMUSB_TxLen);
-    		txEventUSB = true;
-    	}
+    /* Release Tx Lock semaphore */
+    xSemaphoreGive(COMUSBSem);
 
-    	if ((comEvent & EVT_USB_EXP_ADATA_H) && COM_IsASCIIMode()) {
-    		CmdUSB_Tx_Event(comEvent, COMUSB_TxBuf, &COMUSB_TxLen);
-    		txEventUSB = true;
-    	}
+    while(1) {
 
-        comEvent = 0;
+    	/* set watchdog status to asleep */
+    	WD_Status(WD_COM, WD_ASLEEP);
+
+        /* Wait for data or an event, keep going while ports have data */
+        notifiedValue = 0;
+        xTaskNotifyWait(UINT_MIN, UINT_MAX, &notifiedValue,
+        		(busy != 0) ? 0 : pdMS_TO_TICKS(COM_POLL_TIME));
 
-        if (txEventUSB) {
-            txEventUSB = false;
-            COMUSB_TxData(COMUSB_TxBuf, COMUSB_TxLen);
+        /* Poll period - every port gets its Poll and held Tx a look, even under steady notifies */
+        if ((xTaskGetTickCount() - pollTick) >= pdMS_TO_TICKS(COM_POLL_TIME)) {
+        	pollTick = xTaskGetTickCount();
+        	notifiedValue |= COM_NOTIFY_PORTS;
         }
+
+    	/* set watchdog status to alive */
+    	WD_Status(WD_COM, WD_ALIVE);
+
+    	/* Ports notified or still draining */
+    	uint32_t due = (notifiedValue | busy) & COM_NOTIFY_PORTS;
+    	busy = 0;
+    	for (uint32_t port = 0; port < COM_PORT_N_ENUM; port++) {
+    		if ((COM_Ports[port].Ops != NULL) && (due & (1UL << port))) {
+    			if (COM_PortService(&COM_Ports[port]))
+    				busy |= (1UL << port);
+    		}
+    	}
     }
 }
 
-/* Communication Process - Events - TCM */
-static void COM_EVTTCMTask(void *Args)
+/* Data USB Tx - the next reading goes to the other buffer */
+static void COMDAT_TxUSB(void)
+{
+	COMUSB_TxData(COMDAT_TxBuf[COMDAT_TxIdx], COMDAT_TxLen);
+	COMDAT_TxIdx ^= 1;
+}
+
+/* Communication Process - Data */
+static void COM_DATATask(void *Args)
 {
-    uint32_t comEvent = 0;
-    bool txEventTCM = false;
+    COM_DataRec_t dataRec;
+    Fusion_Record_t fusionRec;
 
     /* Wait till Config notifies completion */
-    uint32_t notifiedValue;
-    xTaskNotifyWait(UINT_MIN, UINT_MAX, &notifiedValue, portMAX_DELAY);
+    COM_WaitStart();
 
     while(1) {
-        /* set watchdog status to asleep */
-        WD_Status(WD_EVTTCM, WD_ASLEEP);
-
-        /* Wait for an event */
-        xTaskNotifyWait(UINT_MIN, UINT_MAX, &comEvent, portMAX_DELAY);
-
-        /* set watchdog status to alive */
-        WD_Status(WD_EVTTCM, WD_ALIVE);
-
-        /* Check for TCM COM events */
-        if (comEvent & EVT_TCM_ALL) {
-        	/* If Tx is not ready, retry */
-        	if (TCMi_IsTxReady()) {
-        		CmdTCM_Tx_Event(comEvent, COMTCM_TxBuf, &COMTCM_TxLen);
-        		txEventTCM = true;
-        	} else {
-        		/* Schedule TCM com event again */
-        		xTaskNotify(xComEvtTCMTaskHandle, comEvent, eSetBits);
-            }
-        }
 
-        comEvent = 0;
+    	/* set watchdog status to asleep */
+    	WD_Status(WD_COMDATA, WD_ASLEEP);
+
+        /* Records waiting on the auxiliaries are flushed even without new readings */
+        bool isFusion = Fusion_IsSubscribed();
+        TickType_t wait = isFusion ? pdMS_TO_TICKS(COMDAT_FUSION_WAIT) : portMAX_DELAY;
+
+        /* Send data from MxA */
+        if (pdPASS == xQueueReceive(ComRecQ, &dataRec, wait)) {
+            ChnReading_t *loadReading = &dataRec.Reading;
 
-        if (txEventTCM) {
-            txEventTCM = false;
-            if (COMTCM_TxLen > 0)
-            	TCMi_Tx(COMTCM_TxBuf, COMTCM_TxLen);
-            COMTCM_ResetTx();
+            /* set watchdog status to alive */
+            WD_Status(WD_COMDATA, WD_ALIVE);
+
+            /* Break capture ring sees every reading, whatever the stream */
+            BlackBox_Put(loadReading->Src, loadReading->Reading, dataRec.Stamp);
+
+            /* If TCM burst is enabled, send data to TCM port. Otherwise, USB port */
+            if (TCMi_IsConnected() && TCMi_GetBurstMode()) {
+            	CmdTCM_Tx_Reading(loadReading->Reading, TCMi_GetReading(), COMDAT_TxBuf[COMDAT_TxIdx], &COMDAT_TxLen);
+            	COMTCM_TxData(COMDAT_TxBuf[COMDAT_TxIdx], COMDAT_TxLen);
+	        } else if (isFusion) {
+	        	/* Stamped at acquisition - time in the queue is not skew between sources */
+	        	Fusion_PutSample(loadReading->Src, loadReading->Reading, dataRec.Stamp);
+	        } else {
+        		if (COM_IsASCIIMode())
+        			CmdUSB_Tx_ASCIIReading(loadReading->Src, loadReading->Reading, COMDAT_TxBuf[COMDAT_TxIdx], &COMDAT_TxLen);
+        		else
+        			CmdUSB_Tx_Reading(loadReading->Src, loadReading->Reading, COMDAT_TxBuf[COMDAT_TxIdx], &COMDAT_TxLen);
+        		COMDAT_TxUSB();
+        	}
+            COMDAT_TxLen = 0;
+        }
+
+        /* One frame per instant of the primary */
+        while (isFusion && Fusion_GetRecord(&fusionRec)) {
+            WD_Status(WD_COMDATA, WD_ALIVE);
+            CmdUSB_Tx_Record(&fusionRec, COMDAT_TxBuf[COMDAT_TxIdx], &COMDAT_TxLen);
+            COMDAT_TxUSB();
+            COMDAT_TxLen = 0;
         }
     }
 }
@@ -360,32 +639,18 @@ static void COM_EVTTCMTask(void *Args)
 /* Create communication task */
 static void COMTasks_Create(void)
 {
-    /* Command processing task for USB */
-    static StaticTask_t xComCmdUSBTaskTCB;
-    static StackType_t uxComCmdUSBTaskStack[COMCMDUSBTASK_STACKSZ];
+    /* Port scheduler - commands and events on all ports */
+    static StaticTask_t xComTaskTCB;
+    static StackType_t uxComTaskStack[COMTASK_STACKSZ];
 
-    xComCmdUSBTaskHandle = xTaskCreateStatic(COM_CMDUSBTask,
-                                        COMCMDUSBTASK_NAME,
-                                        COMCMDUSBTASK_STACKSZ,
+    xComTaskHandle = xTaskCreateStatic(COM_Task,
+                                        COMTASK_NAME,
+                                        COMTASK_STACKSZ,
                                         NULL,
-                                        COMCMDUSBTASK_PRIO,
-                                        uxComCmdUSBTaskStack,
-                                        &xComCmdUSBTaskTCB);
-    if (xComCmdUSBTaskHandle == NULL)
-        Error_Handler(ERROR_TASK_CREATE);
-
-    /* Command processing task for TCM */
-    static StaticTask_t xComCmdTCMTaskTCB;
-    static StackType_t uxComCmdTCMTaskStack[COMCMDTCMTASK_STACKSZ];
-
-    xComCmdTCMTaskHandle = xTaskCreateStatic(COM_CMDTCMTask,
-            COMCMDTCMTASK_NAME,
-            COMCMDTCMTASK_STACKSZ,
-            NULL,
-            COMCMDTCMTASK_PRIO,
-            uxComCmdTCMTaskStack,
-            &xComCmdTCMTaskTCB);
-    if (xComCmdTCMTaskHandle == NULL)
+                                        COMTASK_PRIO,
+                                        uxComTaskStack,
+                                        &xComTaskTCB);
+    if (xComTaskHandle == NULL)
         Error_Handler(ERROR_TASK_CREATE);
 
     /* Data handling task */
@@ -401,34 +666,6 @@ static void COMTasks_Create(void)
             &xComDataTaskTCB);
     if (xComDataTaskHandle == NULL)
         Error_Handler(ERROR_TASK_CREATE);
-
-    /* Event handling task - USB */
-    static StaticTask_t xComEvtUSBTaskTCB;
-    static StackType_t uxComEvtUSBTaskStack[COMEVTUSBTASK_STACKSZ];
-
-    xComEvtUSBTaskHandle = xTaskCreateStatic(COM_EVTUSBTask,
-            COMEVTUSBTASK_NAME,
-            COMEVTUSBTASK_STACKSZ,
-            NULL,
-            COMEVTUSBTASK_PRIO,
-            uxComEvtUSBTaskStack,
-            &xComEvtUSBTaskTCB);
-    if (xComEvtUSBTaskHandle == NULL)
-        Error_Handler(ERROR_TASK_CREATE);
-
-    /* Event handling task - TCM */
-    static StaticTask_t xComEvtTCMTaskTCB;
-    static StackType_t uxComEvtTCMTaskStack[COMEVTTCMTASK_STACKSZ];
-
-    xComEvtTCMTaskHandle = xTaskCreateStatic(COM_EVTTCMTask,
-            COMEVTTCMTASK_NAME,
-            COMEVTTCMTASK_STACKSZ,
-            NULL,
-            COMEVTTCMTASK_PRIO,
-            uxComEvtTCMTaskStack,
-            &xComEvtTCMTaskTCB);
-    if (xComEvtTCMTaskHandle == NULL)
-        Error_Handler(ERROR_TASK_CREATE);
 }
 
 /* Public Functions */
@@ -438,6 +675,9 @@ bool COM_Init(void)
 {
 	StdReturn_t stdRet;
 
+    /* Time aligned records - off till subscribed */
+    Fusion_Init();
+
     /* Communication Task */
     COMTasks_Create();
 
@@ -445,18 +685,171 @@ bool COM_Init(void)
     stdRet = USBi_Start();
     if(stdRet != RET_OK)
        Error_Handler(ERROR_BOOTUP_USB);
+    COM_RegisterPort(COM_PORT_USB, &COMUSB_Ops);
+    ExportBulk_Init();
+    BlackBox_Init();
+    LogBin_Init();
 
     /* Start TCM */
     stdRet = TCMi_ComStart();
     if (stdRet != RET_OK)
     	Error_Handler(ERROR_COMSTART_TCMi);
 
+    /* TCM Tx over DMA */
+    stdRet = dUART_Init(dUART_PORT_TCM, dUART_BAUD_DEFAULT);
+    if (stdRet != RET_OK)
+    	Error_Handler(ERROR_COMSTART_TCMi);
+    TCMLink_Init();
+    COM_RegisterPort(COM_PORT_TCM, &COMTCM_Ops);
+
     /* Start AxMs */
     AxMi_Init();
+    AxMUpd_Init();
+    AxMSched_Init();
+
+    /* AxM Rx over circular DMA */
+    stdRet = dUART_RxStart(dUART_PORT_AxM1, COMAxM1_RxCB);
+    if (stdRet != RET_OK)
+    	Error_Handler(ERROR_COMSTART_AxM);
+    COM_RegisterPort(COM_PORT_AxM1, &COMAxM1_Ops);
+
+    stdRet = dUART_RxStart(dUART_PORT_AxM2, COMAxM2_RxCB);
+    if (stdRet != RET_OK)
+    	Error_Handler(ERROR_COMSTART_AxM);
+    COM_RegisterPort(COM_PORT_AxM2, &COMAxM2_Ops);
 
     return true;
 }
 
+/* Start - Config loaded, COM tasks start serving */
+void COM_Start(void)
+{
+	if (xComTaskHandle != NULL)
+		xTaskNotify(xComTaskHandle, COM_NOTIFY_START, eSetBits);
+	if (xComDataTaskHandle != NULL)
+		xTaskNotify(xComDataTaskHandle, COM_NOTIFY_START, eSetBits);
+}
+
+/* Register port */
+StdReturn_t COM_RegisterPort(COM_Port_t Port, const COM_PortOps_t *Ops)
+{
+	if ((Port >= COM_PORT_N_ENUM) || (Ops == NULL))
+		return RET_ARGS_NOK;
+	/* Rx, Tx and a protocol are the minimum */
+	if ((Ops->RxSpan == NULL) || (Ops->RxConsume == NULL) || (Ops->Tx == NULL) || (Ops->Process == NULL))
+		return RET_ARGS_NOK;
+
+	COM_PortCtx_t *ctx = &COM_Ports[Port];
+
+	taskENTER_CRITICAL();
+	ctx->RxLen = 0;
+	ctx->TxLen = 0;
+	ctx->RxTimedOut = false;
+	ctx->IdleDue = false;
+	ctx->RxQuiet = true;
+	ctx->Events = 0;
+	ctx->Ops = Ops;
+	taskEXIT_CRITICAL();
+
+	/* Deadlines on the timer wheel, nothing polls for them */
+	TWheel_Cancel(&ctx->RxTmr);
+	TWheel_Cancel(&ctx->IdleTmr);
+	TWheel_InitCb(&ctx->RxTmr, COM_RxTmrCB, ctx);
+	TWheel_InitCb(&ctx->IdleTmr, COM_IdleTmrCB, ctx);
+	if (Ops->Idle != NULL)
+		TWheel_Arm(&ctx->IdleTmr, COM_RX_TIMEOUT);
+
+	return RET_OK;
+}
+
+/* Set port events */
+void COM_SetEvent(COM_Port_t Port, uint32_t Evt)
+{
+	if (Port >= COM_PORT_N_ENUM)
+		return;
+
+	/* Breaks and overloads freeze the capture window */
+	if (Evt & (EVT_USB_TBREAK | EVT_USB_CBREAK | EVT_USB_OVERLOAD))
+		BlackBox_Trigger(Evt);
+	/* Log of the test closes with it */
+	if (Evt & EVT_USB_TESTSTOP)
+		LogBin_TestStop();
+
+	taskENTER_CRITICAL();
+	COM_Ports[Port].Events |= Evt;
+	taskEXIT_CRITICAL();
+
+	if (xComTaskHandle != NULL)
+		xTaskNotify(xComTaskHandle, (1UL << Port), eSetBits);
+}
+
+/* Set port events - from ISR */
+void COM_SetEventFromISR(COM_Port_t Port, uint32_t Evt)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+	if (Port >= COM_PORT_N_ENUM)
+		return;
+
+	/* Breaks and overloads freeze the capture window */
+	if (Evt & (EVT_USB_TBREAK | EVT_USB_CBREAK | EVT_USB_OVERLOAD))
+		BlackBox_Trigger(Evt);
+	/* Log of the test closes with it */
+	if (Evt & EVT_USB_TESTSTOP)
+		LogBin_StopFromISR();
+
+	UBaseType_t savedMask = taskENTER_CRITICAL_FROM_ISR();
+	COM_Ports[Port].Events |= Evt;
+	taskEXIT_CRITICAL_FROM_ISR(savedMask);
+
+	if (xComTaskHandle != NULL) {
+		xTaskNotifyFromISR(xComTaskHandle, (1UL << Port), eSetBits, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
+}
+
+/* Received data on port - from ISR */
+void COM_RxNotifyFromISR(COM_Port_t Port)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+	if ((Port >= COM_PORT_N_ENUM) || (xComTaskHandle == NULL))
+		return;
+
+	xTaskNotifyFromISR(xComTaskHandle, (1UL << Port), eSetBits, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* Transmit on USB - Data stays in use till the transfer completes */
+StdReturn_t COM_TxUSB(uint8_t *Data, uint32_t Size)
+{
+	return COMUSB_TxData(Data, Size);
+}
+
+/* Queue data reading - call where it is acquired, the stamp is taken here */
+StdReturn_t COM_PutReading(ChnReading_t *Reading)
+{
+	COM_DataRec_t rec = {.Reading = *Reading, .Stamp = HRT_GetTick64()};
+
+	if (pdPASS != xQueueSend(ComRecQ, &rec, 0))
+		return RET_BUF_FULL;
+
+	return RET_OK;
+}
+
+/* Queue data reading - from ISR */
+StdReturn_t COM_PutReadingFromISR(ChnReading_t *Reading)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	COM_DataRec_t rec = {.Reading = *Reading, .Stamp = HRT_GetTick64()};
+
+	if (pdPASS != xQueueSendFromISR(ComRecQ, &rec, &xHigherPriorityTaskWoken))
+		return RET_BUF_FULL;
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+
+	return RET_OK;
+}
+
 /* Is ASCII mode */
 uint32_t COM_IsASCIIMode(void)
 {
@@ -10,14 +10,72 @@
 
 /* Includes */
 #include "PAL.h"
+#include "Cmds.h"
+#include "DAQ.h"
 
 /* Macros */
 
+/* COM task notification - bit per port wakes it, start-up bit releases it after Config */
+#define COM_NOTIFY_PORTS    ((1UL << COM_PORT_N_ENUM) - 1)
+#define COM_NOTIFY_START    (1UL << 31)
+
 /* Types */
 
+/* Ports */
+typedef enum {
+    COM_PORT_USB = 0,
+    COM_PORT_TCM,
+    COM_PORT_AxM1,
+    COM_PORT_AxM2,
+    COM_PORT_N_ENUM,
+} COM_Port_t;
+
+/* Port operations - NULL where not supported */
+typedef struct {
+    /* Contiguous received bytes, returns length */
+    uint32_t (*RxSpan)(uint8_t **Data);
+    /* Release bytes taken from RxSpan */
+    void (*RxConsume)(uint32_t Len);
+    /* Transmit */
+    StdReturn_t (*Tx)(uint8_t *Data, uint32_t Size);
+    /* Room for a response - port is skipped till ready */
+    bool (*IsTxReady)(void);
+    /* Protocol handler */
+    CmdStatus_t (*Process)(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen);
+    /* Events to response */
+    void (*Event)(uint32_t Evt, uint8_t *RspBuf, uint32_t *RspLen);
+    /* Called after the line has been quiet for the receive timeout */
+    void (*Idle)(uint8_t *RspBuf, uint32_t *RspLen);
+    /* Called every scheduler pass */
+    void (*Poll)(void);
+} COM_PortOps_t;
+
+/* Data reading - stamped on the HRT where it was acquired */
+typedef struct {
+    ChnReading_t Reading;
+    HRTime64_t Stamp;
+} COM_DataRec_t;
+
 /* Function Prototypes */
 /* Initialize */
 bool COM_Init(void);
+/* Start - Config loaded, COM tasks start serving */
+void COM_Start(void);
+
+/* Register port */
+StdReturn_t COM_RegisterPort(COM_Port_t Port, const COM_PortOps_t *Ops);
+/* Set port events */
+void COM_SetEvent(COM_Port_t Port, uint32_t Evt);
+/* Set port events - from ISR */
+void COM_SetEventFromISR(COM_Port_t Port, uint32_t Evt);
+/* Received data on port - from ISR */
+void COM_RxNotifyFromISR(COM_Port_t Port);
+/* Transmit on USB - Data stays in use till the transfer completes */
+StdReturn_t COM_TxUSB(uint8_t *Data, uint32_t Size);
+/* Queue data reading - call where it is acquired, the stamp is taken here */
+StdReturn_t COM_PutReading(ChnReading_t *Reading);
+/* Queue data reading - from ISR */
+StdReturn_t COM_PutReadingFromISR(ChnReading_t *Reading);
 
 /* Is ASCII mode */
 uint32_t COM_IsASCIIMode(void);
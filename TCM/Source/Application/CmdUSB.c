@@ -31,8 +31,18 @@
 #include "Update.h"
 #include "DispHome.h"
 #include "DispUpdate.h"
-
-#include "CRC8OS.h"
+#include "Fusion.h"
+#include "AxMUpd.h"
+#include "AxMSched.h"
+#include "ExportBulk.h"
+#include "ImportBulk.h"
+#include "LogBin.h"
+#include "BlackBox.h"
+#include "Prof.h"
+#include "dI2C.h"
+#include "dUART.h"
+
+#include "BufUtil.h"
 
 #include "Disp.h"
 #include "IO.h"
@@ -47,6 +57,16 @@
 #define APP_PROTOCOL_VER_MAJOR (0x01)
 #define APP_PROTOCOL_VER_MINOR (0x02)
 
+/* Extended commands - above CMD_EVTMASK, table stays sorted */
+#define CMD_FUSION          (0xE1)  // Time aligned readings of all sources
+#define CMD_EXPORT_BULK     (EXPBULK_FUNCCODE)  // Bulk file export from an offset
+#define CMD_BLACKBOX        (0xE4)  // Break capture window
+#define CMD_LOGENC          (0xE5)  // Log file encoding
+#define CMD_PROF            (0xE6)  // Profiling probes
+#define CMD_I2CSTAT         (0xE7)  // I2C bus statistics
+#define CMD_UARTSTAT        (0xE8)  // UART link statistics
+#define CMD_LOGBIN          (0xE9)  // Binary log start, stop and statistics
+
 
 /* Types */
 
@@ -63,12 +83,6 @@ uint8_t CmdDevAddr = DF3_DEVADDR1;
 
 /* Private Functions */
 
-/* Get CRC */
-static inline uint8_t GetCRC(uint8_t *Buf, uint32_t Len)
-{
-    return CRC8OS_Calc(Buf, Len, CRC8OS_Init());
-}
-
 /* Get Addr */
 static inline uint8_t GetAddr(void)
 {
@@ -97,50 +111,7 @@ static inline uint8_t CheckAddr(uint8_t Addr)
     return false;
 }
 
-/* Get arguments */
-static inline uint8_t GetArgUINT8(uint8_t *Buf)
-{
-    return *Buf;
-}
-static inline uint16_t GetArgUINT16(uint8_t *Buf)
-{
-    uint16_t arg;
-    memcpy((void*)&arg, (void*)Buf, sizeof(uint16_t));
-    return arg;
-}
-static inline uint32_t GetArgUINT32(uint8_t *Buf)
-{
-    uint32_t arg;
-    memcpy((void*)&arg, (void*)Buf, sizeof(uint32_t));
-    return arg;
-}
-static inline int32_t GetArgINT32(uint8_t *Buf)
-{
-    int32_t arg;
-    memcpy((void*)&arg, (void*)Buf, sizeof(int32_t));
-    return arg;
-}
-static inline float32_t GetArgFLT32(uint8_t *Buf)
-{
-    float32_t arg;
-    memcpy((void*)&arg, (void*)Buf, sizeof(float32_t));
-    return arg;
-}
-
 /* Set values */
-static inline void SetValUINT32(uint32_t Val, uint8_t *Buf)
-{
-    memcpy((void*)Buf, (void*)&Val, sizeof(uint32_t));
-}
-static inline void SetValINT32(int32_t Val, uint8_t *Buf)
-{
-    memcpy((void*)Buf, (void*)&Val, sizeof(int32_t));
-}
-static inline void SetValFLT32(float32_t Val, uint8_t *Buf)
-{
-    memcpy((void*)Buf, (void*)&Val, sizeof(float32_t));
-}
-
 static inline void SetValSTR(char *Str, char *Buf, uint32_t size)
 {
 	memcpy(Buf, Str, size);
@@ -237,8 +208,10 @@ static void CmdProc_SetTime(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, u
     uint32_t argTime = GetArgUINT32(pCmdBuf);
     if(!Sys_SetTime(argTime))
         NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
-    else
+    else {
+        HRT_SetWallClock(argTime);
         ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+    }
     return;
 }
 
@@ -315,6 +288,85 @@ static void CmdProc_ImportFile(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf
 		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
 		return;
 	}
+	if(argOpt == 0x04) { // Start windowed import - size, CRC32, window, name
+		if((dataLen <= 10) || (dataLen > (10 + 63))) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint32_t argSize = GetArgUINT32(pCmdBuf + 1);
+		uint32_t argCRC = GetArgUINT32(pCmdBuf + 5);
+		uint8_t argWindow = GetArgUINT8(pCmdBuf + 9);
+
+		char fname[64];
+		memset(fname, 0, sizeof(fname));
+		strncpy(fname, (char*)(pCmdBuf + 10), (dataLen - 10));
+
+		uint32_t window;
+		StdReturn_t stdRet = ImportBulk_Start(fname, argSize, argCRC, argWindow, &window);
+		if(stdRet == RET_ARGS_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+
+		uint8_t data[3];
+		data[0] = argOpt;
+		data[1] = (uint8_t) window;
+		data[2] = (uint8_t) IMPBULK_BLOCK_LEN;
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argOpt == 0x05) { // Windowed block - sequence, data. Answered once per window
+		if(dataLen < 5) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint32_t argSeq = GetArgUINT32(pCmdBuf + 1);
+
+		bool ack;
+		StdReturn_t stdRet = ImportBulk_PutBlock(argSeq, (pCmdBuf + 5), (dataLen - 5), &ack);
+		if(stdRet == RET_ENV_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet == RET_ARGS_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_FACCESSERR, RspBuf, RspLen);
+			return;
+		}
+		if(ack) {
+			uint8_t data[5];
+			data[0] = argOpt;
+			SetValUINT32(ImportBulk_GetNext(), &data[1]);
+			RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		}
+		return;
+	}
+	if(argOpt == 0x06) { // Finish windowed import - done, or first missing block
+		uint32_t next;
+		StdReturn_t stdRet = ImportBulk_Finish(&next);
+		if(stdRet == RET_ENV_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+		if((stdRet != RET_OK) && (stdRet != RET_NOK)) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_FACCESSERR, RspBuf, RspLen);
+			return;
+		}
+
+		uint8_t data[6];
+		data[0] = argOpt;
+		data[1] = (stdRet == RET_OK) ? 0 : 1;
+		SetValUINT32(next, &data[2]);
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
 
 	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
     return;
@@ -525,12 +577,40 @@ static void CmdProc_Recovery(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf,
     return;
 }
 
-/* Update AxMs */
+/* Update AxMs - image file name after the source runs the windowed update */
 static void CmdProc_UpdateAxM(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
 {
+	uint8_t dataLen = CMDBYTE_DATALEN;
 	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
 
 	uint8_t argSrc = GetArgUINT8(pCmdBuf);
+	if((dataLen > 1) && ((argSrc == 0x01) || (argSrc == 0x02))) {
+		if(dataLen > (1 + 63)) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+
+		char fname[64];
+		memset(fname, 0, sizeof(fname));
+		strncpy(fname, (char*)(pCmdBuf + 1), (dataLen - 1));
+
+		/* Progress follows as EVT_USB_AXMUPD */
+		StdReturn_t stdRet = AxMUpd_Start(argSrc, fname);
+		if(stdRet == RET_ENV_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet == RET_ARGS_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_FACCESSERR, RspBuf, RspLen);
+			return;
+		}
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
 	if(argSrc == 0x01) { // AxM1
 		Update_ReqUpdate(1);
 		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
@@ -664,6 +744,12 @@ static void CmdProc_ReadBurst(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf,
             return;
         }
 
+        /* AxMs polled at the burst rate - period (msecs) to Hz, clamped to the scheduler range */
+        uint32_t rate = (argPeriod == 0) ? 1000 : MIN((1000 / argPeriod), 1000);
+        rate = MAX(rate, 1);
+        AxMSched_SetDataRate(1, rate);
+        AxMSched_SetDataRate(2, rate);
+
         ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
         return;
     }
@@ -2293,6 +2379,7 @@ static void CmdProc_TestStart(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf,
 
     if(Test_Start()) {
         Test_SetRunByHost(HOST_FT_USB);
+        LogBin_TestStart();
         ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
     } else {
         NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
@@ -3049,6 +3136,425 @@ static void CmdProc_EvtMask(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, u
 	return;
 }
 
+/* Time aligned readings - subscription and rate */
+static void CmdProc_Fusion(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+
+	uint8_t argGS = GetArgUINT8(pCmdBuf);
+	if(argGS == CMD_GET) {
+		uint8_t data[5];
+		data[0] = (uint8_t) Fusion_IsSubscribed();
+		SetValUINT32(Fusion_GetRate(), &data[1]);
+
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argGS == CMD_SET) {
+		if (CMDBYTE_DATALEN != 6) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint8_t argEn = GetArgUINT8(pCmdBuf + 1);
+		uint32_t argRate = GetArgUINT32(pCmdBuf + 2);
+
+		if((argEn > 1) || (RET_OK != Fusion_SetRate(argRate))) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		Fusion_Subscribe(argEn == 1);
+		/* Auxiliaries keep up with the record rate, 0 follows the primary - scheduler default */
+		if (argRate > 0) {
+			AxMSched_SetDataRate(1, argRate);
+			AxMSched_SetDataRate(2, argRate);
+		}
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
+/* Bulk Export File */
+static void CmdProc_ExportBulk(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t dataLen = CMDBYTE_DATALEN;
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+
+	uint8_t argOpt = GetArgUINT8(pCmdBuf);
+	if(argOpt == EXPBULK_OPT_START) { // Start from offset
+		if((dataLen <= 5) || (dataLen > (5 + 63))) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint32_t argOffset = GetArgUINT32(pCmdBuf + 1);
+
+		char fname[64];
+		memset(fname, 0, sizeof(fname));
+		strncpy(fname, (char*)(pCmdBuf + 5), (dataLen - 5));
+
+		uint32_t fileSize;
+		StdReturn_t stdRet = ExportBulk_Start(fname, argOffset, GetAddr(), &fileSize);
+		if(stdRet == RET_ENV_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet == RET_ARGS_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_FACCESSERR, RspBuf, RspLen);
+			return;
+		}
+
+		/* Blocks follow from the export task */
+		uint8_t data[7];
+		data[0] = argOpt;
+		SetValUINT32(fileSize, &data[1]);
+		data[5] = (uint8_t) (EXPBULK_BLOCK_LEN & 0xFF);
+		data[6] = (uint8_t) (EXPBULK_BLOCK_LEN >> 8);
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argOpt == EXPBULK_OPT_RANGE) { // Log file time window - from the index
+		if((dataLen <= 9) || (dataLen > (9 + 63))) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint32_t argFrom = GetArgUINT32(pCmdBuf + 1);
+		uint32_t argTo = GetArgUINT32(pCmdBuf + 5);
+
+		char fname[64];
+		memset(fname, 0, sizeof(fname));
+		strncpy(fname, (char*)(pCmdBuf + 9), (dataLen - 9));
+
+		uint32_t start, end, fileSize;
+		StdReturn_t stdRet = LogBin_IdxFind(fname, argFrom, argTo, &start, &end);
+		if(stdRet == RET_OK)
+			stdRet = ExportBulk_StartRange(fname, LOGBIN_HDR_LEN, start, end, GetAddr(), &fileSize);
+		if(stdRet == RET_ENV_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet == RET_ARGS_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_FACCESSERR, RspBuf, RspLen);
+			return;
+		}
+
+		/* Head block, then the window */
+		uint8_t data[11];
+		data[0] = argOpt;
+		SetValUINT32(start, &data[1]);
+		SetValUINT32(((end == 0) ? fileSize : end), &data[5]);
+		data[9] = (uint8_t) (EXPBULK_BLOCK_LEN & 0xFF);
+		data[10] = (uint8_t) (EXPBULK_BLOCK_LEN >> 8);
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argOpt == EXPBULK_OPT_PREVIEW) { // Log file overview - from the pyramid
+		if((dataLen <= 5) || (dataLen > (5 + 63))) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint32_t argPoints = GetArgUINT32(pCmdBuf + 1);
+
+		char fname[64];
+		memset(fname, 0, sizeof(fname));
+		strncpy(fname, (char*)(pCmdBuf + 5), (dataLen - 5));
+
+		char pname[64];
+		uint32_t level, count, fileSize;
+		StdReturn_t stdRet = LogBin_PyrFind(fname, argPoints, pname, sizeof(pname), &level, &count);
+		if(stdRet == RET_OK)
+			stdRet = ExportBulk_Start(pname, 0, GetAddr(), &fileSize);
+		if(stdRet == RET_ENV_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_FACCESSERR, RspBuf, RspLen);
+			return;
+		}
+
+		/* Level file follows as blocks */
+		uint8_t data[12];
+		data[0] = argOpt;
+		data[1] = (uint8_t) level;
+		SetValUINT32(count, &data[2]);
+		SetValUINT32(fileSize, &data[6]);
+		data[10] = (uint8_t) (EXPBULK_BLOCK_LEN & 0xFF);
+		data[11] = (uint8_t) (EXPBULK_BLOCK_LEN >> 8);
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argOpt == EXPBULK_OPT_ABORT) {
+		ExportBulk_Abort();
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+	if(argOpt == EXPBULK_OPT_STATUS) { // State and resume offset
+		uint8_t data[6];
+		data[0] = argOpt;
+		data[1] = (uint8_t) ExportBulk_GetState();
+		SetValUINT32(ExportBulk_GetOffset(), &data[2]);
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
+/* Break capture */
+static void CmdProc_BlackBox(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+	uint32_t pre, post;
+
+	uint8_t argGS = GetArgUINT8(pCmdBuf);
+	if(argGS == CMD_GET) {
+		uint8_t data[14];
+		BlackBox_GetWindow(&pre, &post);
+		data[0] = (uint8_t) BlackBox_IsEnabled();
+		SetValUINT32(pre, &data[1]);
+		SetValUINT32(post, &data[5]);
+		data[9] = (uint8_t) BlackBox_GetState();
+		SetValUINT32(BlackBox_GetCaptures(), &data[10]);
+
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argGS == CMD_SET) {
+		if (CMDBYTE_DATALEN != 10) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint8_t argEn = GetArgUINT8(pCmdBuf + 1);
+		pre = GetArgUINT32(pCmdBuf + 2);
+		post = GetArgUINT32(pCmdBuf + 6);
+
+		if(argEn > 1) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		StdReturn_t stdRet = BlackBox_SetWindow(pre, post);
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, ((stdRet == RET_ENV_NOK) ? CMD_RET_IMPROPERENV : CMD_RET_WRONGARGS), RspBuf, RspLen);
+			return;
+		}
+		BlackBox_Enable(argEn == 1);
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
+/* Log file encoding */
+static void CmdProc_LogEnc(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+
+	uint8_t argGS = GetArgUINT8(pCmdBuf);
+	if(argGS == CMD_GET) {
+		uint8_t enc = (uint8_t) LogBin_GetEncoding();
+		RESP(CMDBYTE_FUNCCODE, &enc, 1, RspBuf, RspLen);
+		return;
+	}
+	if(argGS == CMD_SET) {
+		StdReturn_t stdRet = LogBin_SetEncoding(GetArgUINT8(pCmdBuf + 1));
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, ((stdRet == RET_ENV_NOK) ? CMD_RET_IMPROPERENV : CMD_RET_WRONGARGS), RspBuf, RspLen);
+			return;
+		}
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
+/* Profiling probes - GET dumps cycles per probe, SET resets */
+static void CmdProc_Prof(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+	uint8_t data[5 + (PROF_N_ENUM * 16)];
+	Prof_Stat_t stat;
+
+	uint8_t argGS = GetArgUINT8(pCmdBuf);
+	if(argGS == CMD_GET) {
+		/* Core clock, probes, then [count][min][max][mean] of each */
+		SetValUINT32(SystemCoreClock, &data[0]);
+		data[4] = PROF_N_ENUM;
+		for(uint32_t i = 0; i < PROF_N_ENUM; i++) {
+			uint8_t *rec = &data[5 + (i * 16)];
+			Prof_Get((Prof_Probe_t) i, &stat);
+			SetValUINT32(stat.Count, &rec[0]);
+			SetValUINT32(stat.Min, &rec[4]);
+			SetValUINT32(stat.Max, &rec[8]);
+			SetValUINT32((stat.Count > 0) ? (uint32_t) (stat.Sum / stat.Count) : 0, &rec[12]);
+		}
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argGS == CMD_SET) {
+		Prof_Reset();
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
+/* I2C bus statistics - GET dumps counters and latency per bus, SET resets */
+static void CmdProc_I2CStat(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+	uint8_t data[1 + (dI2C_N_BUS * 32)];
+	dI2C_Stat_t stat;
+
+	uint8_t argGS = GetArgUINT8(pCmdBuf);
+	if(argGS == CMD_GET) {
+		/* Buses, then [xfers][nacks][timeouts][bus errors][recoveries][min][max][mean] of each, usecs */
+		data[0] = dI2C_N_BUS;
+		for(uint32_t i = 0; i < dI2C_N_BUS; i++) {
+			uint8_t *rec = &data[1 + (i * 32)];
+			dI2C_GetStat(i, &stat);
+			SetValUINT32(stat.Xfers, &rec[0]);
+			SetValUINT32(stat.Nacks, &rec[4]);
+			SetValUINT32(stat.Timeouts, &rec[8]);
+			SetValUINT32(stat.BusErrs, &rec[12]);
+			SetValUINT32(stat.Recoveries, &rec[16]);
+			SetValUINT32(stat.LatMin, &rec[20]);
+			SetValUINT32(stat.LatMax, &rec[24]);
+			SetValUINT32((stat.LatCount > 0) ? (uint32_t) (stat.LatSum / stat.LatCount) : 0, &rec[28]);
+		}
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argGS == CMD_SET) {
+		dI2C_ResetStat();
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
+/* UART link statistics - GET dumps counters per port, SET resets */
+static void CmdProc_UARTStat(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+	uint8_t data[1 + (dUART_PORT_N_ENUM * 32)];
+	dUART_TxStats_t stat;
+
+	uint8_t argGS = GetArgUINT8(pCmdBuf);
+	if(argGS == CMD_GET) {
+		/* Ports, then [baud][tx frames][tx bytes][tx dropped][tx stalls][tx max pending][rx errors][rx overruns] of each */
+		data[0] = dUART_PORT_N_ENUM;
+		for(uint32_t i = 0; i < dUART_PORT_N_ENUM; i++) {
+			uint8_t *rec = &data[1 + (i * 32)];
+			dUART_GetTxStats(i, &stat);
+			SetValUINT32(dUART_GetBaudRate(i), &rec[0]);
+			SetValUINT32(stat.TxFrames, &rec[4]);
+			SetValUINT32(stat.TxBytes, &rec[8]);
+			SetValUINT32(stat.TxDropped, &rec[12]);
+			SetValUINT32(stat.TxStalls, &rec[16]);
+			SetValUINT32(stat.TxMaxPending, &rec[20]);
+			SetValUINT32(dUART_GetRxErrors(i), &rec[24]);
+			SetValUINT32(dUART_GetRxOverruns(i), &rec[28]);
+		}
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argGS == CMD_SET) {
+		for(uint32_t i = 0; i < dUART_PORT_N_ENUM; i++)
+			dUART_ResetTxStats(i);
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
+/* Binary log - GET dumps state and statistics, SET starts to a file or stops */
+static void CmdProc_LogBin(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+	uint8_t dataLen = CMDBYTE_DATALEN;
+	uint8_t *pCmdBuf = &CMDBYTE_DATA0;
+	uint8_t data[1 + 32 + (4 * LOGBIN_PYR_N_LEVEL)];
+	LogBin_Stats_t stat;
+
+	uint8_t argGS = GetArgUINT8(pCmdBuf);
+	if(argGS == CMD_GET) {
+		/* [active][records][writes][buf waits][max write][prealloc][idx entries][blocks][bytes][pyr entries of each level] */
+		LogBin_GetStats(&stat);
+		data[0] = (uint8_t) LogBin_IsActive();
+		SetValUINT32(stat.Records, &data[1]);
+		SetValUINT32(stat.Writes, &data[5]);
+		SetValUINT32(stat.BufWaits, &data[9]);
+		SetValUINT32(stat.MaxWriteTime, &data[13]);
+		SetValUINT32(stat.Prealloc, &data[17]);
+		SetValUINT32(stat.IdxEntries, &data[21]);
+		SetValUINT32(stat.Blocks, &data[25]);
+		SetValUINT32(stat.Bytes, &data[29]);
+		for(uint32_t i = 0; i < LOGBIN_PYR_N_LEVEL; i++) {
+			SetValUINT32(stat.PyrEntries[i], &data[33 + (4 * i)]);
+		}
+		RESP(CMDBYTE_FUNCCODE, data, sizeof(data), RspBuf, RspLen);
+		return;
+	}
+	if(argGS == CMD_SET) {
+		if(dataLen < 2) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		uint8_t argEn = GetArgUINT8(pCmdBuf + 1);
+		StdReturn_t stdRet;
+
+		if(argEn == 0) {
+			/* Completion follows as EVT_USB_LOGBIN */
+			stdRet = LogBin_Stop();
+		} else if((argEn == 1) && (dataLen > 2) && (dataLen <= (2 + 63))) {
+			char fname[64];
+			memset(fname, 0, sizeof(fname));
+			strncpy(fname, (char*)(pCmdBuf + 2), (dataLen - 2));
+			stdRet = LogBin_Start(fname);
+		} else {
+			stdRet = RET_ARGS_NOK;
+		}
+
+		if(stdRet == RET_ENV_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet == RET_ARGS_NOK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+			return;
+		}
+		if(stdRet != RET_OK) {
+			NACK(CMDBYTE_FUNCCODE, CMD_RET_FACCESSERR, RspBuf, RspLen);
+			return;
+		}
+		ACK(CMDBYTE_FUNCCODE, RspBuf, RspLen);
+		return;
+	}
+
+	NACK(CMDBYTE_FUNCCODE, CMD_RET_WRONGARGS, RspBuf, RspLen);
+	return;
+}
+
 /* Command Table */
 static const CmdHandler_t CmdTable[] =
 {
@@ -3147,6 +3653,16 @@ static const CmdHandler_t CmdTable[] =
     {CMD_EVENT,             CMD_PERM_ALL, 0, 0, CmdProc_Event},
     {CMD_EVTMASK,           CMD_PERM_ALL, 0, 0, CmdProc_EvtMask},
 
+    // Extended
+    {CMD_FUSION,            CMD_PERM_ALL, 0, 0, CmdProc_Fusion},
+    {CMD_EXPORT_BULK,       CMD_PERM_ALL, 0, 0, CmdProc_ExportBulk},
+    {CMD_BLACKBOX,          CMD_PERM_ALL, 0, 0, CmdProc_BlackBox},
+    {CMD_LOGENC,            CMD_PERM_ALL, 0, 0, CmdProc_LogEnc},
+    {CMD_PROF,              CMD_PERM_ALL, 0, 0, CmdProc_Prof},
+    {CMD_I2CSTAT,           CMD_PERM_ALL, 0, 0, CmdProc_I2CStat},
+    {CMD_UARTSTAT,          CMD_PERM_ALL, 0, 0, CmdProc_UARTStat},
+    {CMD_LOGBIN,            CMD_PERM_ALL, 0, 0, CmdProc_LogBin},
+
 	// End
 	{CMD_MAX, CMD_PERM_ALL, 0, 0, NULL},
 };
@@ -3219,8 +3735,8 @@ static void CmdProc_ASCIICmds(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf,
 
 /* Public Functions */
 
-/* Process command - USB */
-CmdStatus_t CmdUSB_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+/* Process command - USB, profiled */
+static CmdStatus_t CmdUSB_ProcessCmd(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
 {
     /* Do not process commands while sleeping */
     if (Sys_IsSleeping())
@@ -3309,9 +3825,20 @@ CmdStatus_t CmdUSB_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, ui
     return CMDSTAT_DONE;
 }
 
+/* Process command - USB */
+CmdStatus_t CmdUSB_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+    PROF_START(PROF_CMDUSB_PROCESS);
+    CmdStatus_t cmdStatus = CmdUSB_ProcessCmd(CmdBuf, CmdLen, RspBuf, RspLen);
+    PROF_STOP(PROF_CMDUSB_PROCESS);
+
+    return cmdStatus;
+}
+
 /* Tx reading */
 void CmdUSB_Tx_Reading(uint32_t Src, float32_t Reading, uint8_t *RspBuf, uint32_t *RspLen)
 {
+    PROF_START(PROF_CMDUSB_TX_READING);
     uint8_t data[5];
     /* Set source and reading **/
     data[0] = (uint8_t) (Src - 1);
@@ -3321,12 +3848,32 @@ void CmdUSB_Tx_Reading(uint32_t Src, float32_t Reading, uint8_t *RspBuf, uint32_
     RspBuf[*RspLen] = GetCRC(RspBuf, *RspLen);
     *RspLen += 1;
 
+    PROF_STOP(PROF_CMDUSB_TX_READING);
+    return;
+}
+
+/* Tx time aligned record */
+void CmdUSB_Tx_Record(const Fusion_Record_t *Rec, uint8_t *RspBuf, uint32_t *RspLen)
+{
+    uint8_t data[9 + (FUSION_CHN_N_ENUM * sizeof(float32_t))];
+    /* Set time (usecs), valid channels and readings */
+    SetValUINT32((uint32_t) Rec->Stamp, &data[0]);
+    SetValUINT32((uint32_t) (Rec->Stamp >> 32), &data[4]);
+    data[8] = (uint8_t) Rec->Valid;
+    for (uint32_t i = 0; i < FUSION_CHN_N_ENUM; i++)
+        SetValFLT32(Rec->Reading[i], &data[9 + (i * sizeof(float32_t))]);
+    /* Set response and CRC */
+    RESP(CMD_FUSION, data, sizeof(data), RspBuf, RspLen);
+    RspBuf[*RspLen] = GetCRC(RspBuf, *RspLen);
+    *RspLen += 1;
+
     return;
 }
 
 /* Tx ASCII reading */
 void CmdUSB_Tx_ASCIIReading(uint32_t Src, float32_t Reading, uint8_t *RspBuf, uint32_t *RspLen)
 {
+	PROF_START(PROF_CMDUSB_TX_ASCII);
 	char data[16];
 
 	/* Source Load */
@@ -3352,6 +3899,7 @@ void CmdUSB_Tx_ASCIIReading(uint32_t Src, float32_t Reading, uint8_t *RspBuf, ui
 	strcpy((char*) RspBuf, data);
 	*RspLen = strlen(data);
 
+	PROF_STOP(PROF_CMDUSB_TX_ASCII);
     return;
 }
 
@@ -3401,6 +3949,29 @@ void CmdUSB_Tx_Event(uint32_t Evt, uint8_t *RspBuf, uint32_t *RspLen)
         	RESP(CMD_EVENT, data, 8, RspBuf, RspLen);
         	break;
 
+        case EVT_USB_AXMUPD:
+        	event = EVT_USB_AXMUPD;
+        	SetValUINT32(event, &data[0]);
+        	/* Windowed AxM update - running, result of the last and progress (%) */
+        	data[4] = AxMUpd_IsActive() ? 1 : 0;
+        	data[5] = (uint8_t) AxMUpd_GetResult();
+        	float32_t updProg = (float32_t) AxMUpd_GetProgress();
+        	SetValFLT32(updProg, &data[6]);
+        	RESP(CMD_EVENT, data, 10, RspBuf, RspLen);
+        	break;
+
+        case EVT_USB_LOGBIN:
+        	event = EVT_USB_LOGBIN;
+        	SetValUINT32(event, &data[0]);
+        	/* Binary log closed - failed, records and bytes logged */
+        	LogBin_Stats_t logStat;
+        	LogBin_GetStats(&logStat);
+        	data[4] = LogBin_IsFailed() ? 1 : 0;
+        	SetValUINT32(logStat.Records, &data[5]);
+        	SetValUINT32(logStat.Bytes, &data[9]);
+        	RESP(CMD_EVENT, data, 13, RspBuf, RspLen);
+        	break;
+
         case EVT_USB_BOOTERR:
         	size = ErrorLog_GetSize();
         	for (i=0; i<size; i++)
@@ -9,6 +9,7 @@
 #define _CMDUSB_H_
 
 /* Includes */
+#include "Fusion.h"
 
 /* Macros */
 
@@ -21,6 +22,8 @@ CmdStatus_t CmdUSB_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, ui
 
 /* Transmit reading */
 void CmdUSB_Tx_Reading(uint32_t Src, float32_t Reading, uint8_t *RspBuf, uint32_t *RspLen);
+/* Tx time aligned record */
+void CmdUSB_Tx_Record(const Fusion_Record_t *Rec, uint8_t *RspBuf, uint32_t *RspLen);
 /* Tx ASCII reading */
 void CmdUSB_Tx_ASCIIReading(uint32_t Src, float32_t Reading, uint8_t *RspBuf, uint32_t *RspLen);
 /* Tx event */
@@ -0,0 +1,259 @@
+/**
+ *  @file ExportBulk.c
+ *  @brief Bulk file export - blocks streamed from an offset
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "ExportBulk.h"
+#include "Tasks.h"
+#include "COM.h"
+
+#include "BufUtil.h"
+#include "CRC32.h"
+
+#include "Error.h"
+#include "Watchdog.h"
+
+#include "ff.h"
+
+/* Macros */
+
+/* Frames - one read ahead while the other is sent */
+#define EXPBULK_N_FRAME     (2)
+/* Sends of a block before giving up - host stopped reading */
+#define EXPBULK_MAX_RETRIES (20)
+
+/* Types */
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static TaskHandle_t xExportBulkTaskHandle;
+
+static __ALIGNED(4) uint8_t ExpBulkFrame[EXPBULK_N_FRAME][EXPBULK_FRAME_LEN];
+
+static FIL ExpBulkFile;
+static volatile ExportBulk_State_t ExpBulkState = EXPBULK_IDLE;
+static volatile bool ExpBulkAbortReq = false;
+static volatile uint32_t ExpBulkOffset = 0;
+/* Block reads stop at End - then continue at the next range, if any */
+static uint32_t ExpBulkEnd = 0;
+static uint32_t ExpBulkNextStart = 0;
+static uint32_t ExpBulkNextEnd = 0;
+static uint8_t ExpBulkAddr = 0;
+
+/* Private Functions */
+
+/* Read next block into frame - returns frame length */
+static bool ExportBulk_ReadBlock(uint8_t *Frame, uint32_t *FrameLen)
+{
+    UINT len;
+    uint32_t want = MIN(EXPBULK_BLOCK_LEN, (ExpBulkEnd - ExpBulkOffset));
+
+    if (FR_OK != f_read(&ExpBulkFile, &Frame[EXPBULK_HDR_LEN], want, &len))
+        return false;
+
+    Frame[0] = ExpBulkAddr;
+    Frame[1] = EXPBULK_FUNCCODE;
+    Frame[2] = (EXPBULK_HDR_LEN - 4);
+    Frame[3] = EXPBULK_OPT_BLOCK;
+    SetValUINT32(ExpBulkOffset, &Frame[4]);
+    SetValUINT32(len, &Frame[8]);
+    Frame[12] = GetCRC(Frame, (EXPBULK_HDR_LEN - 1));
+
+    uint32_t crc = CRC32_Final(CRC32_Calc(&Frame[EXPBULK_HDR_LEN], len, CRC32_Init()));
+    SetValUINT32(crc, &Frame[EXPBULK_HDR_LEN + len]);
+
+    *FrameLen = EXPBULK_HDR_LEN + len + 4;
+    return true;
+}
+
+/* Send frame - waits for the previous transfer */
+static bool ExportBulk_Send(uint8_t *Frame, uint32_t FrameLen)
+{
+    for (uint32_t retry = 0; retry < EXPBULK_MAX_RETRIES; retry++) {
+        WD_Status(WD_EXPORT, WD_ALIVE);
+        if (ExpBulkAbortReq)
+            return false;
+        if (RET_OK == COM_TxUSB(Frame, FrameLen))
+            return true;
+    }
+    return false;
+}
+
+/* Export Process - runs below COM, the start response goes out before the first block */
+static void ExportBulk_Task(void *Args)
+{
+    uint32_t frameLen;
+    uint32_t idx = 0;
+
+    while (1) {
+
+        /* set watchdog status to asleep */
+        WD_Status(WD_EXPORT, WD_ASLEEP);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (ExpBulkState != EXPBULK_RUNNING)
+            continue;
+
+        /* Final state is published once the file is closed - a new start may reuse it right away */
+        ExportBulk_State_t endState = EXPBULK_RUNNING;
+        while (endState == EXPBULK_RUNNING) {
+
+            /* set watchdog status to alive */
+            WD_Status(WD_EXPORT, WD_ALIVE);
+
+            if (ExpBulkAbortReq) {
+                endState = EXPBULK_ABORTED;
+                break;
+            }
+
+            /* Read while the other frame is on the wire */
+            uint8_t *frame = ExpBulkFrame[idx];
+            if (!ExportBulk_ReadBlock(frame, &frameLen)) {
+                endState = EXPBULK_ERROR;
+                break;
+            }
+
+            if (!ExportBulk_Send(frame, frameLen)) {
+                endState = ExpBulkAbortReq ? EXPBULK_ABORTED : EXPBULK_ERROR;
+                break;
+            }
+            idx = (idx + 1) % EXPBULK_N_FRAME;
+
+            /* Zero length block ends the file */
+            uint32_t len = frameLen - EXPBULK_HDR_LEN - 4;
+            if (len == 0) {
+                endState = EXPBULK_DONE;
+                break;
+            }
+            ExpBulkOffset += len;
+
+            /* Range done - on to the next one */
+            if ((ExpBulkOffset == ExpBulkEnd) && (ExpBulkNextEnd != 0)) {
+                if (FR_OK != f_lseek(&ExpBulkFile, ExpBulkNextStart)) {
+                    endState = EXPBULK_ERROR;
+                    break;
+                }
+                ExpBulkOffset = ExpBulkNextStart;
+                ExpBulkEnd = ExpBulkNextEnd;
+                ExpBulkNextEnd = 0;
+            }
+        }
+
+        f_close(&ExpBulkFile);
+        ExpBulkState = endState;
+    }
+}
+
+/* Public Functions */
+
+/* Init */
+void ExportBulk_Init(void)
+{
+    static StaticTask_t xExportBulkTaskTCB;
+    static StackType_t uxExportBulkTaskStack[EXPORTTASK_STACKSZ];
+
+    xExportBulkTaskHandle = xTaskCreateStatic(ExportBulk_Task,
+                                               EXPORTTASK_NAME,
+                                               EXPORTTASK_STACKSZ,
+                                               NULL,
+                                               EXPORTTASK_PRIO,
+                                               uxExportBulkTaskStack,
+                                               &xExportBulkTaskTCB);
+    if (xExportBulkTaskHandle == NULL)
+        Error_Handler(ERROR_TASK_CREATE);
+}
+
+/* Open file and arm the task */
+static StdReturn_t ExportBulk_Open(const char *Path, uint32_t Offset, uint32_t End, uint8_t Addr, uint32_t *FileSize)
+{
+    if ((Path == NULL) || (FileSize == NULL))
+        return RET_ARGS_NOK;
+    if (ExpBulkState == EXPBULK_RUNNING)
+        return RET_ENV_NOK;
+
+    if (FR_OK != f_open(&ExpBulkFile, Path, (FA_OPEN_EXISTING | FA_READ)))
+        return RET_HW_NOK;
+
+    *FileSize = (uint32_t) f_size(&ExpBulkFile);
+
+    /* Resume - offset at or before the end */
+    if ((Offset > *FileSize) || (End > *FileSize) || (FR_OK != f_lseek(&ExpBulkFile, Offset))) {
+        f_close(&ExpBulkFile);
+        return RET_ARGS_NOK;
+    }
+
+    ExpBulkAddr = Addr;
+    ExpBulkOffset = Offset;
+    ExpBulkEnd = (End == 0) ? *FileSize : End;
+    ExpBulkNextEnd = 0;
+    ExpBulkAbortReq = false;
+    return RET_OK;
+}
+
+/* Run the armed export */
+static void ExportBulk_Run(void)
+{
+    ExpBulkState = EXPBULK_RUNNING;
+    xTaskNotifyGive(xExportBulkTaskHandle);
+}
+
+/* Start export of file from offset */
+StdReturn_t ExportBulk_Start(const char *Path, uint32_t Offset, uint8_t Addr, uint32_t *FileSize)
+{
+    StdReturn_t stdRet = ExportBulk_Open(Path, Offset, 0, Addr, FileSize);
+    if (stdRet == RET_OK)
+        ExportBulk_Run();
+    return stdRet;
+}
+
+/* Start export of file head, then the byte range Start to End */
+StdReturn_t ExportBulk_StartRange(const char *Path, uint32_t Head, uint32_t Start, uint32_t End, uint8_t Addr, uint32_t *FileSize)
+{
+    if ((Head == 0) || ((End != 0) && (Start > End)))
+        return RET_ARGS_NOK;
+
+    StdReturn_t stdRet = ExportBulk_Open(Path, 0, Head, Addr, FileSize);
+    if (stdRet != RET_OK)
+        return stdRet;
+
+    if (End == 0)
+        End = *FileSize;
+    if ((Start < Head) || (Start > End)) {
+        f_close(&ExpBulkFile);
+        return RET_ARGS_NOK;
+    }
+
+    ExpBulkNextStart = Start;
+    ExpBulkNextEnd = End;
+    ExportBulk_Run();
+    return RET_OK;
+}
+
+/* Abort export */
+void ExportBulk_Abort(void)
+{
+    if (ExpBulkState == EXPBULK_RUNNING)
+        ExpBulkAbortReq = true;
+}
+
+/* Get state */
+ExportBulk_State_t ExportBulk_GetState(void)
+{
+    return ExpBulkState;
+}
+
+/* Get offset of next block - resume point */
+uint32_t ExportBulk_GetOffset(void)
+{
+    return ExpBulkOffset;
+}
+
+/******************************** End of File *********************************/
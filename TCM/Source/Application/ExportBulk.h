@@ -0,0 +1,57 @@
+/**
+ *  @file ExportBulk.h
+ *  @brief Bulk file export - blocks streamed from an offset
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _EXPORTBULK_H_
+#define _EXPORTBULK_H_
+
+/* Includes */
+#include "PAL.h"
+
+/* Macros */
+
+/* Bulk export function code */
+#define EXPBULK_FUNCCODE    (0xE3)
+
+/* Bulk export options */
+#define EXPBULK_OPT_START   (0x01)  // Offset, file name - returns file size and block length
+#define EXPBULK_OPT_ABORT   (0x02)
+#define EXPBULK_OPT_STATUS  (0x03)  // Returns state and next offset
+#define EXPBULK_OPT_RANGE   (0x04)  // Time window, file name - file head then the window
+#define EXPBULK_OPT_PREVIEW (0x05)  // Points, log file name - pyramid level that fits
+#define EXPBULK_OPT_BLOCK   (0x10)  // Device - offset, length, data and CRC32 follow
+
+/* Block - header, data and CRC32 of data. Zero length block ends the file */
+#define EXPBULK_BLOCK_LEN   (4096)
+#define EXPBULK_HDR_LEN     (13)    // [Addr][Func][9][Opt][Offset u32][Len u32][CRC8]
+#define EXPBULK_FRAME_LEN   (EXPBULK_HDR_LEN + EXPBULK_BLOCK_LEN + 4)
+
+/* Types */
+
+/* States */
+typedef enum {
+    EXPBULK_IDLE = 0,
+    EXPBULK_RUNNING,
+    EXPBULK_DONE,
+    EXPBULK_ABORTED,
+    EXPBULK_ERROR,
+} ExportBulk_State_t;
+
+/* Function Prototypes */
+/* Init */
+void ExportBulk_Init(void);
+/* Start export of file from offset */
+StdReturn_t ExportBulk_Start(const char *Path, uint32_t Offset, uint8_t Addr, uint32_t *FileSize);
+/* Start export of file head, then the byte range Start to End */
+StdReturn_t ExportBulk_StartRange(const char *Path, uint32_t Head, uint32_t Start, uint32_t End, uint8_t Addr, uint32_t *FileSize);
+/* Abort export */
+void ExportBulk_Abort(void);
+/* Get state */
+ExportBulk_State_t ExportBulk_GetState(void);
+/* Get offset of next block - resume point */
+uint32_t ExportBulk_GetOffset(void);
+
+#endif /* _EXPORTBULK_H_ */
@@ -0,0 +1,260 @@
+/**
+ *  @file Fusion.c
+ *  @brief Time aligned multi-channel readings
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "Fusion.h"
+#include "SrcLoad.h"
+
+/* Macros */
+
+/* Auxiliary readings kept for interpolation */
+#define FUSION_HIST_LEN     (8)
+/* Primary readings waiting for the auxiliaries */
+#define FUSION_PEND_LEN     (16)
+
+/* Wait for an auxiliary to pass the primary instant, then hold its last reading */
+#define FUSION_AUX_WAIT     (20 * 1000)     // 20 msecs
+/* Auxiliary without readings for this long is left out of records */
+#define FUSION_AUX_STALE    (200 * 1000)    // 200 msecs
+
+/* Types */
+
+/* Stamped reading */
+typedef struct {
+    HRTime64_t Stamp;
+    float32_t Reading;
+} Fusion_Sample_t;
+
+/* Auxiliary history - newest at Head - 1 */
+typedef struct {
+    Fusion_Sample_t Sample[FUSION_HIST_LEN];
+    uint32_t Head;
+    uint32_t Cnt;
+} Fusion_Hist_t;
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static volatile bool FusionSubscribed = false;
+static volatile uint32_t FusionRate = 0;
+/* Subscription or rate changed - state is reset by the data path */
+static volatile bool FusionResetReq = false;
+
+/* Output grid */
+static HRTime64_t FusionPeriod = 0;
+static HRTime64_t FusionNextEmit = 0;
+
+/* Primary readings on the output grid */
+static Fusion_Sample_t FusionPend[FUSION_PEND_LEN];
+static uint32_t FusionPendHead = 0;
+static uint32_t FusionPendCnt = 0;
+
+/* Auxiliaries */
+static Fusion_Hist_t FusionAux[FUSION_CHN_N_ENUM];
+
+/* Private Functions */
+
+/* Channel of source */
+static inline Fusion_Chn_t Fusion_GetChn(uint32_t Src)
+{
+    if (Src == SRC_LOAD_PRIM)
+        return FUSION_CHN_PRIM;
+    if (Src == SRC_LOAD_AUX1)
+        return FUSION_CHN_AUX1;
+    if (Src == SRC_LOAD_AUX2)
+        return FUSION_CHN_AUX2;
+    return FUSION_CHN_N_ENUM;
+}
+
+/* Reset state */
+static void Fusion_Reset(void)
+{
+    FusionResetReq = false;
+
+    FusionPeriod = (FusionRate != 0) ? (1000000 / FusionRate) : 0;
+    FusionNextEmit = 0;
+    FusionPendHead = 0;
+    FusionPendCnt = 0;
+    memset(FusionAux, 0, sizeof(FusionAux));
+}
+
+/* Get auxiliary sample - 0 is the newest */
+static inline Fusion_Sample_t *Fusion_HistGet(Fusion_Hist_t *Hist, uint32_t Idx)
+{
+    return &Hist->Sample[(Hist->Head + FUSION_HIST_LEN - 1 - Idx) % FUSION_HIST_LEN];
+}
+
+/* Put auxiliary sample */
+static void Fusion_HistPut(Fusion_Hist_t *Hist, float32_t Reading, HRTime64_t Stamp)
+{
+    /* Time went back - source restarted */
+    if ((Hist->Cnt != 0) && (Stamp < Fusion_HistGet(Hist, 0)->Stamp))
+        Hist->Cnt = 0;
+
+    Hist->Sample[Hist->Head].Stamp = Stamp;
+    Hist->Sample[Hist->Head].Reading = Reading;
+    Hist->Head = (Hist->Head + 1) % FUSION_HIST_LEN;
+    if (Hist->Cnt < FUSION_HIST_LEN)
+        Hist->Cnt++;
+}
+
+/* Auxiliary reading at an instant - false till the auxiliary has caught up */
+static bool Fusion_HistAt(Fusion_Hist_t *Hist, HRTime64_t Stamp, HRTime64_t Now, float32_t *Reading, bool *Valid)
+{
+    *Valid = false;
+
+    /* Not connected */
+    if (Hist->Cnt == 0)
+        return true;
+
+    Fusion_Sample_t *newer = Fusion_HistGet(Hist, 0);
+
+    /* Stopped */
+    if ((newer->Stamp + FUSION_AUX_STALE) < Stamp)
+        return true;
+
+    /* Not yet past the instant - wait, then hold */
+    if (newer->Stamp < Stamp) {
+        if ((Now - Stamp) < FUSION_AUX_WAIT)
+            return false;
+        *Reading = newer->Reading;
+        *Valid = true;
+        return true;
+    }
+
+    /* Bracket the instant */
+    for (uint32_t i = 1; i < Hist->Cnt; i++) {
+        Fusion_Sample_t *older = Fusion_HistGet(Hist, i);
+        if (older->Stamp <= Stamp) {
+            HRTime64_t span = newer->Stamp - older->Stamp;
+            if (span == 0)
+                *Reading = newer->Reading;
+            else
+                *Reading = older->Reading + (newer->Reading - older->Reading) *
+                        ((float32_t) (Stamp - older->Stamp) / (float32_t) span);
+            *Valid = true;
+            return true;
+        }
+        newer = older;
+    }
+
+    /* Older than the history - nearest reading */
+    *Reading = newer->Reading;
+    *Valid = true;
+    return true;
+}
+
+/* Public Functions */
+
+/* Init */
+void Fusion_Init(void)
+{
+    FusionSubscribed = false;
+    FusionRate = 0;
+    Fusion_Reset();
+}
+
+/* Subscribe to records */
+void Fusion_Subscribe(bool En)
+{
+    FusionSubscribed = En;
+    FusionResetReq = true;
+}
+
+/* Is subscribed */
+bool Fusion_IsSubscribed(void)
+{
+    return FusionSubscribed;
+}
+
+/* Set output rate (Hz) */
+StdReturn_t Fusion_SetRate(uint32_t Rate)
+{
+    if (Rate > FUSION_RATE_MAX)
+        return RET_ARGS_NOK;
+
+    FusionRate = Rate;
+    FusionResetReq = true;
+    return RET_OK;
+}
+
+/* Get output rate (Hz) */
+uint32_t Fusion_GetRate(void)
+{
+    return FusionRate;
+}
+
+/* Put reading, stamped at acquisition */
+void Fusion_PutSample(uint32_t Src, float32_t Reading, HRTime64_t Stamp)
+{
+    if (FusionResetReq)
+        Fusion_Reset();
+
+    Fusion_Chn_t chn = Fusion_GetChn(Src);
+    if (chn == FUSION_CHN_N_ENUM)
+        return;
+
+    if (chn != FUSION_CHN_PRIM) {
+        Fusion_HistPut(&FusionAux[chn], Reading, Stamp);
+        return;
+    }
+
+    /* Primary readings nearest past each output instant */
+    if (FusionPeriod != 0) {
+        if ((FusionNextEmit != 0) && (Stamp < FusionNextEmit))
+            return;
+        /* Keep the grid, restart it after a gap */
+        if ((FusionNextEmit != 0) && ((Stamp - FusionNextEmit) < FusionPeriod))
+            FusionNextEmit += FusionPeriod;
+        else
+            FusionNextEmit = Stamp + FusionPeriod;
+    }
+
+    /* Auxiliaries too far behind - drop the oldest */
+    if (FusionPendCnt == FUSION_PEND_LEN)
+        FusionPendCnt--;
+
+    FusionPend[FusionPendHead].Stamp = Stamp;
+    FusionPend[FusionPendHead].Reading = Reading;
+    FusionPendHead = (FusionPendHead + 1) % FUSION_PEND_LEN;
+    FusionPendCnt++;
+}
+
+/* Get record, false till all channels are aligned */
+bool Fusion_GetRecord(Fusion_Record_t *Rec)
+{
+    if (FusionResetReq)
+        Fusion_Reset();
+
+    if (FusionPendCnt == 0)
+        return false;
+
+    Fusion_Sample_t *prim = &FusionPend[(FusionPendHead + FUSION_PEND_LEN - FusionPendCnt) % FUSION_PEND_LEN];
+    HRTime64_t now = HRT_GetTick64();
+
+    Rec->Stamp = prim->Stamp;
+    Rec->Valid = FUSION_VALID_PRIM;
+    Rec->Reading[FUSION_CHN_PRIM] = prim->Reading;
+
+    for (uint32_t chn = FUSION_CHN_AUX1; chn < FUSION_CHN_N_ENUM; chn++) {
+        bool valid;
+        Rec->Reading[chn] = 0.0f;
+        if (!Fusion_HistAt(&FusionAux[chn], prim->Stamp, now, &Rec->Reading[chn], &valid))
+            return false;
+        if (valid)
+            Rec->Valid |= (1 << chn);
+    }
+
+    FusionPendCnt--;
+    return true;
+}
+
+/******************************** End of File *********************************/
@@ -0,0 +1,57 @@
+/**
+ *  @file Fusion.h
+ *  @brief Time aligned multi-channel readings
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _FUSION_H_
+#define _FUSION_H_
+
+/* Includes */
+#include "PAL.h"
+
+/* Macros */
+
+/* Max output rate (Hz) - 0 is every primary reading */
+#define FUSION_RATE_MAX     (1000)
+
+/* Valid readings in a record */
+#define FUSION_VALID_PRIM   (1 << FUSION_CHN_PRIM)
+#define FUSION_VALID_AUX1   (1 << FUSION_CHN_AUX1)
+#define FUSION_VALID_AUX2   (1 << FUSION_CHN_AUX2)
+
+/* Types */
+
+/* Channels */
+typedef enum {
+    FUSION_CHN_PRIM = 0,
+    FUSION_CHN_AUX1,
+    FUSION_CHN_AUX2,
+    FUSION_CHN_N_ENUM,
+} Fusion_Chn_t;
+
+/* Record - all channels at one instant of the primary */
+typedef struct {
+    HRTime64_t Stamp;
+    uint32_t Valid;
+    float32_t Reading[FUSION_CHN_N_ENUM];
+} Fusion_Record_t;
+
+/* Function Prototypes */
+/* Init */
+void Fusion_Init(void);
+/* Subscribe to records */
+void Fusion_Subscribe(bool En);
+/* Is subscribed */
+bool Fusion_IsSubscribed(void);
+/* Set output rate (Hz) */
+StdReturn_t Fusion_SetRate(uint32_t Rate);
+/* Get output rate (Hz) */
+uint32_t Fusion_GetRate(void);
+/* Put reading, stamped at acquisition */
+void Fusion_PutSample(uint32_t Src, float32_t Reading, HRTime64_t Stamp);
+/* Get record, false till all channels are aligned */
+bool Fusion_GetRecord(Fusion_Record_t *Rec);
+
+#endif /* _FUSION_H_ */
@@ -0,0 +1,213 @@
+/**
+ *  @file ImportBulk.c
+ *  @brief Bulk file import - windowed blocks, whole file CRC
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "ImportBulk.h"
+
+#include "CRC32.h"
+
+#include "ff.h"
+
+/* Macros */
+
+/* Write buffer - multiple of the SD sector, writes stay sector aligned */
+#define IMPBULK_WRBUF_LEN   (4096)
+
+/* Types */
+
+/* Out of order block */
+typedef struct {
+    bool Valid;
+    uint8_t Len;
+    uint8_t Data[IMPBULK_BLOCK_LEN];
+} ImportBulk_Slot_t;
+
+/* Module context */
+typedef struct {
+    bool Active;
+    bool Err;
+    uint32_t FileSize;
+    uint32_t FileCRC;       // Expected
+    uint32_t Crc;           // Running, data in order
+    uint32_t Window;
+    uint32_t NBlocks;
+    uint32_t Next;          // First missing block
+    uint32_t WrLen;
+} ImportBulk_Ctx_t;
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static ImportBulk_Ctx_t ImpBulk;
+static FIL ImpBulkFile;
+static char ImpBulkPath[64];
+
+static __ALIGNED(4) uint8_t ImpBulkWrBuf[IMPBULK_WRBUF_LEN];
+static ImportBulk_Slot_t ImpBulkSlot[IMPBULK_WINDOW_MAX];
+
+/* Private Functions */
+
+/* Length of block */
+static inline uint32_t ImportBulk_BlockLen(uint32_t Seq)
+{
+    if (Seq == (ImpBulk.NBlocks - 1))
+        return ImpBulk.FileSize - (Seq * IMPBULK_BLOCK_LEN);
+    return IMPBULK_BLOCK_LEN;
+}
+
+/* Write buffer to file */
+static bool ImportBulk_Flush(void)
+{
+    UINT len;
+
+    if (ImpBulk.WrLen == 0)
+        return true;
+
+    if ((FR_OK != f_write(&ImpBulkFile, ImpBulkWrBuf, ImpBulk.WrLen, &len)) || (len != ImpBulk.WrLen))
+        return false;
+
+    ImpBulk.WrLen = 0;
+    return true;
+}
+
+/* Append block in order - written once the buffer is full */
+static bool ImportBulk_Append(const uint8_t *Data, uint32_t Len)
+{
+    ImpBulk.Crc = CRC32_Calc(Data, Len, ImpBulk.Crc);
+
+    /* Block length divides the buffer, never split */
+    memcpy(&ImpBulkWrBuf[ImpBulk.WrLen], Data, Len);
+    ImpBulk.WrLen += Len;
+    ImpBulk.Next++;
+
+    if (ImpBulk.WrLen == IMPBULK_WRBUF_LEN)
+        return ImportBulk_Flush();
+    return true;
+}
+
+/* Close file, removed unless verified */
+static void ImportBulk_Close(bool Keep)
+{
+    f_close(&ImpBulkFile);
+    if (!Keep)
+        f_unlink(ImpBulkPath);
+    ImpBulk.Active = false;
+}
+
+/* Public Functions */
+
+/* Start import to file - returns accepted window */
+StdReturn_t ImportBulk_Start(const char *Path, uint32_t FileSize, uint32_t Crc, uint32_t Window, uint32_t *Accepted)
+{
+    if ((Path == NULL) || (Accepted == NULL) || (Window == 0))
+        return RET_ARGS_NOK;
+
+    /* Previous import abandoned */
+    if (ImpBulk.Active)
+        ImportBulk_Close(false);
+
+    if (FR_OK != f_open(&ImpBulkFile, Path, (FA_CREATE_ALWAYS | FA_WRITE)))
+        return RET_HW_NOK;
+
+    memset(&ImpBulk, 0, sizeof(ImpBulk));
+    memset(ImpBulkSlot, 0, sizeof(ImpBulkSlot));
+    memset(ImpBulkPath, 0, sizeof(ImpBulkPath));
+    strncpy(ImpBulkPath, Path, (sizeof(ImpBulkPath) - 1));
+
+    ImpBulk.FileSize = FileSize;
+    ImpBulk.FileCRC = Crc;
+    ImpBulk.Crc = CRC32_Init();
+    ImpBulk.Window = MIN(Window, IMPBULK_WINDOW_MAX);
+    ImpBulk.NBlocks = (FileSize + (IMPBULK_BLOCK_LEN - 1)) / IMPBULK_BLOCK_LEN;
+    ImpBulk.Active = true;
+
+    *Accepted = ImpBulk.Window;
+    return RET_OK;
+}
+
+/* Put block - Ack set when the host is due an acknowledge */
+StdReturn_t ImportBulk_PutBlock(uint32_t Seq, const uint8_t *Data, uint32_t Len, bool *Ack)
+{
+    *Ack = false;
+
+    if (!ImpBulk.Active)
+        return RET_ENV_NOK;
+    if (ImpBulk.Err)
+        return RET_HW_NOK;
+    if ((Seq >= ImpBulk.NBlocks) || (Len != ImportBulk_BlockLen(Seq)))
+        return RET_ARGS_NOK;
+
+    /* Duplicate or beyond the window - host resends from Next */
+    if ((Seq < ImpBulk.Next) || (Seq >= (ImpBulk.Next + ImpBulk.Window)))
+        return RET_OK;
+
+    uint32_t prev = ImpBulk.Next;
+
+    if (Seq == ImpBulk.Next) {
+        ImpBulk.Err = !ImportBulk_Append(Data, Len);
+        /* Drain blocks held for this one */
+        while (!ImpBulk.Err && (ImpBulk.Next < ImpBulk.NBlocks)) {
+            ImportBulk_Slot_t *slot = &ImpBulkSlot[ImpBulk.Next % IMPBULK_WINDOW_MAX];
+            if (!slot->Valid)
+                break;
+            slot->Valid = false;
+            ImpBulk.Err = !ImportBulk_Append(slot->Data, slot->Len);
+        }
+    } else {
+        ImportBulk_Slot_t *slot = &ImpBulkSlot[Seq % IMPBULK_WINDOW_MAX];
+        memcpy(slot->Data, Data, Len);
+        slot->Len = (uint8_t) Len;
+        slot->Valid = true;
+    }
+
+    if (ImpBulk.Err)
+        return RET_HW_NOK;
+
+    /* Acknowledge once per window and at the last block */
+    *Ack = ((prev / ImpBulk.Window) != (ImpBulk.Next / ImpBulk.Window)) ||
+           ((prev != ImpBulk.Next) && (ImpBulk.Next == ImpBulk.NBlocks));
+    return RET_OK;
+}
+
+/* Finish - RET_OK verified and closed, RET_NOK blocks missing from Next */
+StdReturn_t ImportBulk_Finish(uint32_t *Next)
+{
+    *Next = ImpBulk.Next;
+
+    if (!ImpBulk.Active)
+        return RET_ENV_NOK;
+    if (!ImpBulk.Err && (ImpBulk.Next < ImpBulk.NBlocks))
+        return RET_NOK;
+
+    /* Remaining partial buffer, then the whole file CRC */
+    bool ok = !ImpBulk.Err && ImportBulk_Flush() &&
+              (CRC32_Final(ImpBulk.Crc) == ImpBulk.FileCRC);
+
+    if (ok && (FR_OK != f_sync(&ImpBulkFile)))
+        ok = false;
+
+    ImportBulk_Close(ok);
+    return ok ? RET_OK : RET_HW_NOK;
+}
+
+/* Get first missing block */
+uint32_t ImportBulk_GetNext(void)
+{
+    return ImpBulk.Next;
+}
+
+/* Is importing */
+bool ImportBulk_IsActive(void)
+{
+    return ImpBulk.Active;
+}
+
+/******************************** End of File *********************************/
@@ -0,0 +1,35 @@
+/**
+ *  @file ImportBulk.h
+ *  @brief Bulk file import - windowed blocks, whole file CRC
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _IMPORTBULK_H_
+#define _IMPORTBULK_H_
+
+/* Includes */
+#include "PAL.h"
+
+/* Macros */
+
+/* Block - all but the last are full */
+#define IMPBULK_BLOCK_LEN   (128)
+/* Unacknowledged blocks the host may stream */
+#define IMPBULK_WINDOW_MAX  (32)
+
+/* Types */
+
+/* Function Prototypes */
+/* Start import to file - returns accepted window */
+StdReturn_t ImportBulk_Start(const char *Path, uint32_t FileSize, uint32_t Crc, uint32_t Window, uint32_t *Accepted);
+/* Put block - Ack set when the host is due an acknowledge */
+StdReturn_t ImportBulk_PutBlock(uint32_t Seq, const uint8_t *Data, uint32_t Len, bool *Ack);
+/* Finish - RET_OK verified and closed, RET_NOK blocks missing from Next */
+StdReturn_t ImportBulk_Finish(uint32_t *Next);
+/* Get first missing block */
+uint32_t ImportBulk_GetNext(void);
+/* Is importing */
+bool ImportBulk_IsActive(void);
+
+#endif /* _IMPORTBULK_H_ */
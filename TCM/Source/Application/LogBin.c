@@ -0,0 +1,1114 @@
+/**
+ *  @file LogBin.c
+ *  @brief Binary data logger - double buffered, sector aligned
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "LogBin.h"
+#include "Tasks.h"
+#include "DAQ.h"
+
+#include "CfgDev.h"
+#include "TestCfg.h"
+#include "SrcLoad.h"
+#include "System.h"
+#include "COM.h"
+
+#include "Error.h"
+#include "Watchdog.h"
+
+#include "CRC32.h"
+#include "BufUtil.h"
+
+#include "ff.h"
+#include "diskio.h"
+
+/* Macros */
+
+/* Buffers - one filled while the other is written */
+#define LOGBIN_N_BUF        (2)
+
+/* Samples waiting for the drain */
+#define LOGBIN_Q_LEN        (500)
+/* Drain wake up, for stop requests */
+#define LOGBIN_DRAIN_WAIT   (100)   // 100 msecs
+/* Wait for the writer to free a buffer - samples wait in the queue meanwhile */
+#define LOGBIN_BUF_WAIT     (100)   // 100 msecs
+
+/* Preallocation - duration when the test stops on load or extension */
+#define LOGBIN_PLAN_TIME    (3600)                  // 1 hour (secs)
+/* Headroom over the planned records (1/8) */
+#define LOGBIN_PLAN_MARGIN  (8)
+#define LOGBIN_PLAN_MAX     (256 * 1024 * 1024)     // 256 MB
+
+/* Index entries collected before a write */
+#define LOGBIN_IDX_BUF_LEN  (512)
+#define LOGBIN_PATH_LEN     (64)
+
+/* Preview entries collected before a write - header and whole entries */
+#define LOGBIN_PYR_BUF_LEN  (LOGBIN_PYR_HDR_LEN + (34 * LOGBIN_PYR_ENT_LEN))
+/* Sources summarized, indexed by reading source */
+#define LOGBIN_PYR_N_SRC    (LOGBIN_N_SRC)
+
+/* Longest zigzag varint of a delta */
+#define LOGBIN_VARINT_MAX   (10)
+
+/* Types */
+
+/* Buffer */
+typedef struct {
+    uint32_t Len;
+    volatile bool Full;     // Handed to writer
+    bool HasRec;            // A record starts in buffer
+    uint32_t RecTime;       // First record - msecs from start
+    uint32_t RecOff;        // First record - file offset
+} LogBin_Buf_t;
+
+/* Summary of samples */
+typedef struct {
+    uint32_t N;             // Samples
+    uint32_t Parts;         // Samples or entries of the level below folded in
+    float32_t Min;
+    float32_t Max;
+    float32_t Sum;
+} LogBin_Acc_t;
+
+/* Encoder of a source - block being filled */
+typedef struct {
+    uint32_t Count;
+    uint32_t Len;
+    int32_t First;
+    int32_t Last;
+    uint32_t Time;          // First sample - msecs from start
+    uint8_t Blk[LOGBIN_BLK_HDR_LEN + LOGBIN_BLK_DATA_MAX];
+} LogBin_Enc_t;
+
+/* Pyramid level - sidecar file and a summary per source */
+typedef struct {
+    FIL File;
+    bool Open;
+    uint32_t Len;
+    uint8_t Buf[LOGBIN_PYR_BUF_LEN];
+    LogBin_Acc_t Acc[LOGBIN_PYR_N_SRC];
+} LogBin_Pyr_t;
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static TaskHandle_t xLogBinTaskHandle;
+static TaskHandle_t xLogBinWrTaskHandle;
+/* Samples to log - drained by the log task only */
+static QueueHandle_t LogBinQ = NULL;
+
+static __ALIGNED(4) uint8_t LogBinData[LOGBIN_N_BUF][LOGBIN_BUF_LEN];
+static LogBin_Buf_t LogBinBufs[LOGBIN_N_BUF];
+/* Buffer being filled */
+static uint32_t LogBinFill = 0;
+
+static FIL LogBinFile;
+/* Bytes written */
+static FSIZE_t LogBinFileOff = 0;
+/* Contiguous region - first sector and size, buffers go straight to the card */
+static bool LogBinContig = false;
+static LBA_t LogBinSect = 0;
+static FSIZE_t LogBinPlanSize = 0;
+static volatile bool LogBinActive = false;
+static volatile bool LogBinStopReq = false;
+/* Last buffer handed to writer - close after it */
+static volatile bool LogBinFinal = false;
+static volatile bool LogBinErr = false;
+/* Start of log - 64 bit high resolution time */
+static HRTime64_t LogBinStart = 0;
+/* Bytes put in the stream */
+static uint32_t LogBinStreamOff = 0;
+
+/* Encoding - quantization step in calibration units */
+static uint32_t LogBinEnc = LOGBIN_ENC_RAW;
+static float32_t LogBinStep = 1.0f;
+static LogBin_Enc_t LogBinEncs[LOGBIN_N_SRC];
+
+/* Time index - written by the writer task only */
+static FIL LogBinIdxFile;
+static bool LogBinIdxOpen = false;
+static uint8_t LogBinIdxBuf[LOGBIN_IDX_BUF_LEN];
+static uint32_t LogBinIdxLen = 0;
+
+/* Preview pyramid - built by the writer task from the buffers it writes */
+static LogBin_Pyr_t LogBinPyr[LOGBIN_PYR_N_LEVEL];
+/* Record or block split across buffers */
+static uint8_t LogBinPyrCarry[LOGBIN_BLK_HDR_LEN + LOGBIN_BLK_DATA_MAX];
+static uint32_t LogBinPyrCarryLen = 0;
+
+/* Buffer written */
+static SemaphoreHandle_t LogBinWrSem;
+
+static LogBin_Stats_t LogBinStats;
+
+/* Private Functions */
+
+/* Set values */
+static inline void SetValSTR(const char *Str, uint8_t *Buf, uint32_t Size)
+{
+    memset(Buf, 0, Size);
+    strncpy((char*)Buf, Str, (Size - 1));
+}
+
+/* Empty a buffer for refill - index mark included */
+static inline void LogBin_BufReset(LogBin_Buf_t *Buf)
+{
+    Buf->Len = 0;
+    Buf->HasRec = false;
+    Buf->RecTime = 0;
+    Buf->RecOff = 0;
+}
+
+/* Hand the filled buffer to writer and move to the other */
+static void LogBin_Swap(void)
+{
+    LogBinBufs[LogBinFill].Full = true;
+    xTaskNotifyGive(xLogBinWrTaskHandle);
+
+    LogBinFill = (LogBinFill + 1) % LOGBIN_N_BUF;
+
+    /* Writer still on the other buffer - hold off draining */
+    if (LogBinBufs[LogBinFill].Full)
+        LogBinStats.BufWaits++;
+    while (LogBinBufs[LogBinFill].Full && !LogBinErr) {
+        WD_Status(WD_LOG, WD_ALIVE);
+        xSemaphoreTake(LogBinWrSem, pdMS_TO_TICKS(LOGBIN_BUF_WAIT));
+    }
+    LogBin_BufReset(&LogBinBufs[LogBinFill]);
+}
+
+/* Put bytes in the stream - records may cross buffers */
+static void LogBin_Put(const uint8_t *Data, uint32_t Len)
+{
+    while (Len > 0) {
+        LogBin_Buf_t *buf = &LogBinBufs[LogBinFill];
+        uint32_t n = MIN(Len, (LOGBIN_BUF_LEN - buf->Len));
+
+        memcpy(&LogBinData[LogBinFill][buf->Len], Data, n);
+        buf->Len += n;
+        LogBinStreamOff += n;
+        Data += n;
+        Len -= n;
+
+        if (buf->Len == LOGBIN_BUF_LEN)
+            LogBin_Swap();
+    }
+}
+
+/* Msecs from start of log */
+static inline uint32_t LogBin_Time(void)
+{
+    return (uint32_t) ((HRT_GetTick64() - LogBinStart) / 1000);
+}
+
+/* Data starts in the buffer - indexed when the buffer is written */
+static inline void LogBin_Mark(void)
+{
+    LogBin_Buf_t *buf = &LogBinBufs[LogBinFill];
+    if (!buf->HasRec) {
+        buf->HasRec = true;
+        buf->RecTime = LogBin_Time();
+        buf->RecOff = LogBinStreamOff;
+    }
+}
+
+/* Quantize reading to the resolution */
+static inline int32_t LogBin_Quantize(float32_t Reading)
+{
+    float32_t q = Reading / LogBinStep;
+
+    /* Not finite or out of range - stored as the minimum */
+    if (!isfinite(q) || (q >= 2147483647.0f) || (q <= -2147483647.0f))
+        return INT32_MIN;
+    return (int32_t) lroundf(q);
+}
+
+/* Close block of source and put it in the stream */
+static void LogBin_EncClose(uint32_t Src)
+{
+    LogBin_Enc_t *enc = &LogBinEncs[Src];
+    if (enc->Count == 0)
+        return;
+
+    uint8_t *blk = enc->Blk;
+    SetValUINT16(LOGBIN_BLK_SYNC, &blk[0]);
+    blk[2] = (uint8_t) Src;
+    blk[3] = 0;
+    SetValUINT16((uint16_t) enc->Count, &blk[4]);
+    SetValUINT16((uint16_t) enc->Len, &blk[6]);
+    SetValUINT32(enc->Time, &blk[8]);
+    SetValUINT32((uint32_t) enc->First, &blk[12]);
+    SetValFLT32(LogBinStep, &blk[16]);
+
+    /* CRC of header before it and the data */
+    uint32_t crc = CRC32_Calc(blk, (LOGBIN_BLK_HDR_LEN - 4), CRC32_Init());
+    crc = CRC32_Calc(&blk[LOGBIN_BLK_HDR_LEN], enc->Len, crc);
+    SetValUINT32(CRC32_Final(crc), &blk[20]);
+
+    LogBin_Mark();
+    LogBin_Put(blk, (LOGBIN_BLK_HDR_LEN + enc->Len));
+    LogBinStats.Blocks++;
+    enc->Count = 0;
+    enc->Len = 0;
+}
+
+/* Add reading to block of source */
+static void LogBin_EncPut(uint32_t Src, float32_t Reading)
+{
+    LogBin_Enc_t *enc = &LogBinEncs[Src];
+    int32_t q = LogBin_Quantize(Reading);
+
+    if (enc->Count == 0) {
+        enc->First = q;
+        enc->Time = LogBin_Time();
+    } else {
+        /* Zigzag varint of the delta */
+        int64_t delta = (int64_t) q - (int64_t) enc->Last;
+        uint64_t zz = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+        uint8_t *p = &enc->Blk[LOGBIN_BLK_HDR_LEN + enc->Len];
+        while (zz >= 0x80) {
+            *p++ = (uint8_t) (zz | 0x80);
+            zz >>= 7;
+            enc->Len++;
+        }
+        *p = (uint8_t) zz;
+        enc->Len++;
+    }
+    enc->Last = q;
+    enc->Count++;
+
+    if ((enc->Count == LOGBIN_BLK_COUNT_MAX) || ((enc->Len + LOGBIN_VARINT_MAX) > LOGBIN_BLK_DATA_MAX))
+        LogBin_EncClose(Src);
+}
+
+/* Close blocks open too long - bounds the time a block spans */
+static void LogBin_EncAge(void)
+{
+    uint32_t now = LogBin_Time();
+    for (uint32_t src = 0; src < LOGBIN_N_SRC; src++) {
+        if ((LogBinEncs[src].Count > 0) && ((now - LogBinEncs[src].Time) >= LOGBIN_BLK_TIME))
+            LogBin_EncClose(src);
+    }
+}
+
+/* Close all blocks */
+static void LogBin_EncFlush(void)
+{
+    for (uint32_t src = 0; src < LOGBIN_N_SRC; src++)
+        LogBin_EncClose(src);
+}
+
+/* Put record */
+static inline void LogBin_PutRec(const ChnReading_t *Reading)
+{
+    uint8_t rec[LOGBIN_REC_LEN];
+
+    if (LogBinEnc == LOGBIN_ENC_DELTA) {
+        /* Sources beyond the encoders are not logged */
+        if ((uint32_t) Reading->Src < LOGBIN_N_SRC) {
+            LogBin_EncPut(Reading->Src, Reading->Reading);
+            LogBinStats.Records++;
+        }
+        return;
+    }
+
+    LogBin_Mark();
+
+    rec[0] = (uint8_t) Reading->Src;
+    SetValFLT32(Reading->Reading, &rec[1]);
+    LogBin_Put(rec, sizeof(rec));
+    LogBinStats.Records++;
+}
+
+/* Put header - units, resolution and sample period */
+static void LogBin_PutHdr(void)
+{
+    uint8_t hdr[LOGBIN_HDR_LEN];
+
+    uint32_t srcLoad = CfgDev_Get_SrcLoad();
+    bool isTorque = SrcLoad_IsTorque();
+    char *calUnit = SrcLoad_GetCalUnits(srcLoad);
+    char *currUnit = SrcLoad_GetUnitsStr(SrcLoad_GetUnits(isTorque), isTorque, true);
+
+    SetValUINT32(LOGBIN_MAGIC, &hdr[0]);
+    SetValUINT16(LOGBIN_VERSION, &hdr[4]);
+    SetValUINT16(LOGBIN_HDR_LEN, &hdr[6]);
+    hdr[8] = LOGBIN_REC_LEN;
+    hdr[9] = (uint8_t) srcLoad;
+    hdr[10] = (uint8_t) LogBinEnc;
+    hdr[11] = 0;
+    SetValUINT32(CfgDev_Get_DataLogTime(), &hdr[12]);
+    SetValUINT32(SrcLoad_GetConfResolution(), &hdr[16]);
+    SetValUINT32(HRT_ToWallClock(LogBinStart, NULL), &hdr[20]);
+    /* Readings are logged in calibration units - factor to display units */
+    SetValFLT32(SrcLoad_GetConvFactor(isTorque, calUnit, currUnit), &hdr[24]);
+    SetValSTR(calUnit, &hdr[28], LOGBIN_UNITS_LEN);
+    SetValSTR(currUnit, &hdr[36], LOGBIN_UNITS_LEN);
+
+    LogBin_Put(hdr, sizeof(hdr));
+}
+
+/* Quantization step - a digit at the configured resolution, in calibration units */
+static void LogBin_SetStep(void)
+{
+    uint32_t srcLoad = CfgDev_Get_SrcLoad();
+    bool isTorque = SrcLoad_IsTorque();
+    char *calUnit = SrcLoad_GetCalUnits(srcLoad);
+    char *currUnit = SrcLoad_GetUnitsStr(SrcLoad_GetUnits(isTorque), isTorque, true);
+
+    float32_t conv = fabsf(SrcLoad_GetConvFactor(isTorque, calUnit, currUnit));
+    if (!isfinite(conv) || (conv == 0.0f))
+        conv = 1.0f;
+    LogBinStep = 1.0f / (powf(10.0f, (float32_t) SrcLoad_GetConfResolution()) * conv);
+}
+
+/* Planned file size - from log period and stop conditions */
+static FSIZE_t LogBin_PlanSize(void)
+{
+    /* Log period (msecs), stop time (secs) */
+    uint32_t period = MAX(CfgDev_Get_DataLogTime(), 1);
+    uint64_t duration = LOGBIN_PLAN_TIME;
+    if (CfgDev_Get_StopCond() == STOP_ON_LMT_TIME)
+        duration = CfgDev_Get_StopTime();
+
+    uint64_t size = LOGBIN_HDR_LEN + (((duration * 1000) / period) * LOGBIN_REC_LEN);
+    size += size / LOGBIN_PLAN_MARGIN;
+    size = MIN(size, LOGBIN_PLAN_MAX);
+
+    /* Whole buffers */
+    return (FSIZE_t) (((size + LOGBIN_BUF_LEN - 1) / LOGBIN_BUF_LEN) * LOGBIN_BUF_LEN);
+}
+
+/* Preallocate contiguous region - falls back to growing the file */
+static void LogBin_Prealloc(void)
+{
+    LogBinContig = false;
+    LogBinPlanSize = LogBin_PlanSize();
+
+    if (FR_OK != f_expand(&LogBinFile, LogBinPlanSize, 1))
+        return;
+
+    /* First sector of the region */
+    FATFS *fs = LogBinFile.obj.fs;
+    LogBinSect = fs->database + ((LBA_t) fs->csize * (LogBinFile.obj.sclust - 2));
+    LogBinContig = true;
+    LogBinStats.Prealloc = (uint32_t) LogBinPlanSize;
+}
+
+/* Write buffer at the file offset */
+static FRESULT LogBin_WriteBuf(uint8_t *Data, uint32_t Len)
+{
+    UINT written;
+    FRESULT res;
+
+    /* Whole buffers inside the region go to known sectors */
+    if (LogBinContig && (Len == LOGBIN_BUF_LEN) && ((LogBinFileOff + Len) <= LogBinPlanSize)) {
+        LBA_t sect = LogBinSect + (LogBinFileOff / FF_MIN_SS);
+        if (RES_OK != disk_write(LogBinFile.obj.fs->pdrv, Data, sect, (Len / FF_MIN_SS)))
+            return FR_DISK_ERR;
+    } else {
+        res = f_lseek(&LogBinFile, LogBinFileOff);
+        if (res == FR_OK)
+            res = f_write(&LogBinFile, Data, Len, &written);
+        if (res != FR_OK)
+            return res;
+        if (written != Len)
+            return FR_DENIED;
+    }
+
+    LogBinFileOff += Len;
+    return FR_OK;
+}
+
+/* Sidecar path of log file - extension replaced */
+static void LogBin_SidePath(const char *Path, const char *Ext, char *SidePath, uint32_t Size)
+{
+    memset(SidePath, 0, Size);
+    strncpy(SidePath, Path, (Size - 1 - strlen(Ext)));
+
+    char *ext = strrchr(SidePath, '.');
+    char *dir = strrchr(SidePath, '/');
+    if ((ext == NULL) || ((dir != NULL) && (ext < dir)))
+        ext = &SidePath[strlen(SidePath)];
+    strcpy(ext, Ext);
+}
+
+/* Write collected index entries - index faults leave the log running */
+static void LogBin_IdxFlush(void)
+{
+    UINT written;
+
+    if (LogBinIdxOpen && (LogBinIdxLen > 0)) {
+        if ((FR_OK != f_write(&LogBinIdxFile, LogBinIdxBuf, LogBinIdxLen, &written)) || (written != LogBinIdxLen)) {
+            f_close(&LogBinIdxFile);
+            LogBinIdxOpen = false;
+        }
+    }
+    LogBinIdxLen = 0;
+}
+
+/* Add index entry of written buffer */
+static void LogBin_IdxPut(const LogBin_Buf_t *Buf)
+{
+    if (!LogBinIdxOpen || !Buf->HasRec)
+        return;
+
+    SetValUINT32(Buf->RecTime, &LogBinIdxBuf[LogBinIdxLen]);
+    SetValUINT32(Buf->RecOff, &LogBinIdxBuf[LogBinIdxLen + 4]);
+    LogBinIdxLen += LOGBIN_IDX_ENT_LEN;
+    LogBinStats.IdxEntries++;
+
+    if (LogBinIdxLen == LOGBIN_IDX_BUF_LEN)
+        LogBin_IdxFlush();
+}
+
+/* Open index and put its header */
+static void LogBin_IdxOpen(const char *Path)
+{
+    char idxPath[LOGBIN_PATH_LEN];
+
+    LogBin_IdxPath(Path, idxPath, sizeof(idxPath));
+    LogBinIdxLen = 0;
+    LogBinIdxOpen = (FR_OK == f_open(&LogBinIdxFile, idxPath, (FA_CREATE_ALWAYS | FA_WRITE)));
+    if (!LogBinIdxOpen)
+        return;
+
+    SetValUINT32(LOGBIN_IDX_MAGIC, &LogBinIdxBuf[0]);
+    SetValUINT16(LOGBIN_IDX_VERSION, &LogBinIdxBuf[4]);
+    SetValUINT16(LOGBIN_IDX_HDR_LEN, &LogBinIdxBuf[6]);
+    SetValUINT16(LOGBIN_IDX_ENT_LEN, &LogBinIdxBuf[8]);
+    SetValUINT16(0, &LogBinIdxBuf[10]);
+    SetValUINT32(HRT_ToWallClock(LogBinStart, NULL), &LogBinIdxBuf[12]);
+    LogBinIdxLen = LOGBIN_IDX_HDR_LEN;
+}
+
+/* Close index */
+static void LogBin_IdxClose(void)
+{
+    LogBin_IdxFlush();
+    if (LogBinIdxOpen)
+        f_close(&LogBinIdxFile);
+    LogBinIdxOpen = false;
+}
+
+/* Read index entry */
+static bool LogBin_IdxRead(FIL *File, uint32_t Entry, uint32_t *Time, uint32_t *Off)
+{
+    uint8_t ent[LOGBIN_IDX_ENT_LEN];
+    UINT len;
+
+    if ((FR_OK != f_lseek(File, (LOGBIN_IDX_HDR_LEN + (Entry * LOGBIN_IDX_ENT_LEN)))) ||
+            (FR_OK != f_read(File, ent, sizeof(ent), &len)) || (len != sizeof(ent)))
+        return false;
+
+    *Time = GetArgUINT32(&ent[0]);
+    *Off = GetArgUINT32(&ent[4]);
+    return true;
+}
+
+/* Last entry at or before time, entries - times ascending */
+static bool LogBin_IdxSearch(FIL *File, uint32_t N, uint32_t Time, uint32_t *Entry)
+{
+    uint32_t lo = 0, hi = N;
+    uint32_t t, off;
+
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) / 2);
+        if (!LogBin_IdxRead(File, mid, &t, &off))
+            return false;
+        if (t <= Time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    /* lo is the first entry after time */
+    *Entry = lo;
+    return true;
+}
+
+/* Write collected preview entries - faults close the level, the log runs on */
+static void LogBin_PyrFlush(LogBin_Pyr_t *Pyr)
+{
+    UINT written;
+
+    if (Pyr->Open && (Pyr->Len > 0)) {
+        if ((FR_OK != f_write(&Pyr->File, Pyr->Buf, Pyr->Len, &written)) || (written != Pyr->Len)) {
+            f_close(&Pyr->File);
+            Pyr->Open = false;
+        }
+    }
+    Pyr->Len = 0;
+}
+
+/* Add samples to summary */
+static void LogBin_PyrAcc(LogBin_Acc_t *Acc, uint32_t N, float32_t Min, float32_t Max, float32_t Sum)
+{
+    if (Acc->N == 0) {
+        Acc->Min = Min;
+        Acc->Max = Max;
+    } else {
+        Acc->Min = MIN(Acc->Min, Min);
+        Acc->Max = MAX(Acc->Max, Max);
+    }
+    Acc->N += N;
+    Acc->Parts++;
+    Acc->Sum += Sum;
+}
+
+/* Emit summary of source at level - and fold it into the level above */
+static void LogBin_PyrEmit(uint32_t Level, uint32_t Src)
+{
+    LogBin_Pyr_t *pyr = &LogBinPyr[Level];
+    LogBin_Acc_t *acc = &pyr->Acc[Src];
+
+    if (acc->N == 0)
+        return;
+
+    /* No room for the entry - header makes the fill point vary */
+    if (pyr->Open && ((pyr->Len + LOGBIN_PYR_ENT_LEN) > LOGBIN_PYR_BUF_LEN))
+        LogBin_PyrFlush(pyr);
+
+    if (pyr->Open) {
+        uint8_t *ent = &pyr->Buf[pyr->Len];
+        ent[0] = (uint8_t) Src;
+        SetValUINT16((uint16_t) MIN(acc->N, UINT16_MAX), &ent[1]);
+        SetValFLT32(acc->Min, &ent[3]);
+        SetValFLT32(acc->Max, &ent[7]);
+        SetValFLT32((acc->Sum / (float32_t) acc->N), &ent[11]);
+        pyr->Len += LOGBIN_PYR_ENT_LEN;
+        LogBinStats.PyrEntries[Level]++;
+    }
+
+    if ((Level + 1) < LOGBIN_PYR_N_LEVEL) {
+        LogBin_Acc_t *up = &LogBinPyr[Level + 1].Acc[Src];
+        LogBin_PyrAcc(up, acc->N, acc->Min, acc->Max, acc->Sum);
+        if (up->Parts >= LOGBIN_PYR_RATIO)
+            LogBin_PyrEmit((Level + 1), Src);
+    }
+
+    memset(acc, 0, sizeof(LogBin_Acc_t));
+}
+
+/* Add sample to the bottom level */
+static void LogBin_PyrSamp(uint32_t Src, float32_t Val)
+{
+    if (Src >= LOGBIN_PYR_N_SRC)
+        return;
+
+    LogBin_Acc_t *acc = &LogBinPyr[0].Acc[Src];
+    LogBin_PyrAcc(acc, 1, Val, Val, Val);
+    if (acc->Parts >= LOGBIN_PYR_RATIO)
+        LogBin_PyrEmit(0, Src);
+}
+
+/* Add samples of encoded block */
+static void LogBin_PyrBlk(const uint8_t *Blk)
+{
+    uint32_t src = Blk[2];
+    uint32_t count = GetArgUINT16(&Blk[4]);
+    uint32_t len = GetArgUINT16(&Blk[6]);
+    int64_t q = (int32_t) GetArgUINT32(&Blk[12]);
+    float32_t step = GetArgFLT32(&Blk[16]);
+    const uint8_t *p = &Blk[LOGBIN_BLK_HDR_LEN];
+    const uint8_t *end = p + len;
+
+    LogBin_PyrSamp(src, ((float32_t) q * step));
+    for (uint32_t i = 1; (i < count) && (p < end); i++) {
+        uint64_t zz = 0;
+        uint32_t shift = 0;
+        while ((p < end) && (*p & 0x80)) {
+            zz |= (uint64_t) (*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        if (p < end)
+            zz |= (uint64_t) (*p++) << shift;
+        q += (int64_t) (zz >> 1) ^ -(int64_t) (zz & 1);
+        LogBin_PyrSamp(src, ((float32_t) q * step));
+    }
+}
+
+/* Length of record or block starting the carry - 0 till known */
+static inline uint32_t LogBin_PyrUnitLen(void)
+{
+    if (LogBinEnc == LOGBIN_ENC_RAW)
+        return LOGBIN_REC_LEN;
+    if (LogBinPyrCarryLen < LOGBIN_BLK_HDR_LEN)
+        return 0;
+    return LOGBIN_BLK_HDR_LEN + MIN(GetArgUINT16(&LogBinPyrCarry[6]), LOGBIN_BLK_DATA_MAX);
+}
+
+/* Summarize written buffer - Off is its place in the file */
+static void LogBin_PyrFeed(const uint8_t *Data, uint32_t Len, FSIZE_t Off)
+{
+    /* Records only, after the header */
+    if (Off < LOGBIN_HDR_LEN) {
+        uint32_t skip = MIN(Len, (uint32_t) (LOGBIN_HDR_LEN - Off));
+        Data += skip;
+        Len -= skip;
+    }
+
+    /* Raw records in place, the one split across buffers through the carry */
+    if ((LogBinEnc == LOGBIN_ENC_RAW) && (LogBinPyrCarryLen == 0)) {
+        while (Len >= LOGBIN_REC_LEN) {
+            LogBin_PyrSamp(Data[0], GetArgFLT32(&Data[1]));
+            Data += LOGBIN_REC_LEN;
+            Len -= LOGBIN_REC_LEN;
+        }
+    }
+
+    /* Blocks are collected in the carry */
+    while (Len > 0) {
+        uint32_t unit = LogBin_PyrUnitLen();
+        uint32_t want = (unit == 0) ? LOGBIN_BLK_HDR_LEN : unit;
+        uint32_t n = MIN(Len, (want - LogBinPyrCarryLen));
+
+        memcpy(&LogBinPyrCarry[LogBinPyrCarryLen], Data, n);
+        LogBinPyrCarryLen += n;
+        Data += n;
+        Len -= n;
+
+        if ((unit == 0) || (LogBinPyrCarryLen < unit))
+            continue;
+
+        if (LogBinEnc == LOGBIN_ENC_RAW)
+            LogBin_PyrSamp(LogBinPyrCarry[0], GetArgFLT32(&LogBinPyrCarry[1]));
+        else if (GetArgUINT16(&LogBinPyrCarry[0]) == LOGBIN_BLK_SYNC)
+            LogBin_PyrBlk(LogBinPyrCarry);
+        LogBinPyrCarryLen = 0;
+    }
+}
+
+/* Open pyramid sidecars and put their headers */
+static void LogBin_PyrOpen(const char *Path)
+{
+    char pyrPath[LOGBIN_PATH_LEN];
+    char ext[4] = ".P1";
+    uint32_t decim = 1;
+
+    memset(LogBinPyr, 0, sizeof(LogBinPyr));
+    LogBinPyrCarryLen = 0;
+
+    for (uint32_t l = 0; l < LOGBIN_PYR_N_LEVEL; l++) {
+        LogBin_Pyr_t *pyr = &LogBinPyr[l];
+
+        ext[2] = (char) ('1' + l);
+        decim *= LOGBIN_PYR_RATIO;
+        LogBin_SidePath(Path, ext, pyrPath, sizeof(pyrPath));
+        pyr->Open = (FR_OK == f_open(&pyr->File, pyrPath, (FA_CREATE_ALWAYS | FA_WRITE)));
+        if (!pyr->Open)
+            continue;
+
+        SetValUINT32(LOGBIN_PYR_MAGIC, &pyr->Buf[0]);
+        SetValUINT16(LOGBIN_PYR_VERSION, &pyr->Buf[4]);
+        SetValUINT16(LOGBIN_PYR_HDR_LEN, &pyr->Buf[6]);
+        SetValUINT16(LOGBIN_PYR_ENT_LEN, &pyr->Buf[8]);
+        SetValUINT16((uint16_t) (l + 1), &pyr->Buf[10]);
+        SetValUINT32(decim, &pyr->Buf[12]);
+        pyr->Len = LOGBIN_PYR_HDR_LEN;
+    }
+}
+
+/* Close pyramid - partial summaries are emitted, finest level first */
+static void LogBin_PyrClose(void)
+{
+    for (uint32_t l = 0; l < LOGBIN_PYR_N_LEVEL; l++) {
+        LogBin_Pyr_t *pyr = &LogBinPyr[l];
+
+        for (uint32_t src = 0; src < LOGBIN_PYR_N_SRC; src++)
+            LogBin_PyrEmit(l, src);
+
+        LogBin_PyrFlush(pyr);
+        if (pyr->Open)
+            f_close(&pyr->File);
+        pyr->Open = false;
+    }
+}
+
+/* Drain queued samples into buffers */
+static void LogBin_Task(void *Args)
+{
+    ChnReading_t reading;
+
+    while (1) {
+
+        /* set watchdog status to asleep */
+        WD_Status(WD_LOG, WD_ASLEEP);
+
+        if (!LogBinActive || LogBinFinal) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (pdPASS == xQueueReceive(LogBinQ, &reading, pdMS_TO_TICKS(LOGBIN_DRAIN_WAIT))) {
+
+            /* set watchdog status to alive */
+            WD_Status(WD_LOG, WD_ALIVE);
+
+            LogBin_PutRec(&reading);
+        }
+
+        if (LogBinEnc == LOGBIN_ENC_DELTA)
+            LogBin_EncAge();
+
+        /* Drained on stop, or file failed - hand the last buffer over, then the final flag */
+        if (LogBinErr || (LogBinStopReq && (uxQueueMessagesWaiting(LogBinQ) == 0))) {
+            if (!LogBinErr && (LogBinEnc == LOGBIN_ENC_DELTA))
+                LogBin_EncFlush();
+            LogBinBufs[LogBinFill].Full = true;
+            LogBinFinal = true;
+            xTaskNotifyGive(xLogBinWrTaskHandle);
+        }
+    }
+}
+
+/* Write buffers to file */
+static void LogBin_WrTask(void *Args)
+{
+    uint32_t wr = 0;
+
+    while (1) {
+
+        /* set watchdog status to asleep */
+        WD_Status(WD_LOGWR, WD_ASLEEP);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* set watchdog status to alive */
+        WD_Status(WD_LOGWR, WD_ALIVE);
+
+        /* In fill order - final flag is set after the last buffer */
+        while (1) {
+            LogBin_Buf_t *buf = &LogBinBufs[wr];
+
+            if (buf->Full) {
+                if (!LogBinErr && (buf->Len > 0)) {
+                    TickType_t tickStart = xTaskGetTickCount();
+                    FSIZE_t off = LogBinFileOff;
+                    if (FR_OK != LogBin_WriteBuf(LogBinData[wr], buf->Len)) {
+                        LogBinErr = true;
+                        Error_Handler(ERROR_LOG_WRITE);
+                    }
+                    TickType_t wrTime = xTaskGetTickCount() - tickStart;
+                    LogBinStats.MaxWriteTime = MAX(LogBinStats.MaxWriteTime, wrTime);
+                    LogBinStats.Writes++;
+                    LogBin_IdxPut(buf);
+                    LogBin_PyrFeed(LogBinData[wr], buf->Len, off);
+                }
+
+                LogBin_BufReset(buf);
+                buf->Full = false;
+                xSemaphoreGive(LogBinWrSem);
+                wr = (wr + 1) % LOGBIN_N_BUF;
+                continue;
+            }
+
+            /* Last buffer written - drop the unused preallocation */
+            if (LogBinFinal) {
+                if ((FR_OK != f_lseek(&LogBinFile, LogBinFileOff)) || (FR_OK != f_truncate(&LogBinFile)))
+                    LogBinErr = true;
+                f_close(&LogBinFile);
+                LogBin_IdxClose();
+                LogBin_PyrClose();
+                wr = 0;
+                LogBinActive = false;
+                LogBinFinal = false;
+                /* Stop was acknowledged when posted, completion is reported here */
+                COM_SetEvent(COM_PORT_USB, EVT_USB_LOGBIN);
+            }
+            break;
+        }
+    }
+}
+
+/* Public Functions */
+
+/* Init */
+void LogBin_Init(void)
+{
+    static StaticSemaphore_t xLogBinWrSemStruct;
+
+    LogBinWrSem = xSemaphoreCreateBinaryStatic(&xLogBinWrSemStruct);
+    configASSERT(LogBinWrSem);
+
+    /* Samples - from acquisition to the drain */
+    static StaticQueue_t xLogBinQStruct;
+    static uint8_t logBinQStorage[LOGBIN_Q_LEN * sizeof(ChnReading_t)];
+
+    LogBinQ = xQueueCreateStatic(LOGBIN_Q_LEN,
+            sizeof(ChnReading_t),
+            logBinQStorage,
+            &xLogBinQStruct);
+    configASSERT(LogBinQ);
+
+    /* Drain */
+    static StaticTask_t xLogBinTaskTCB;
+    static StackType_t uxLogBinTaskStack[LOGTASK_STACKSZ];
+
+    xLogBinTaskHandle = xTaskCreateStatic(LogBin_Task,
+                                           LOGTASK_NAME,
+                                           LOGTASK_STACKSZ,
+                                           NULL,
+                                           LOGTASK_PRIO,
+                                           uxLogBinTaskStack,
+                                           &xLogBinTaskTCB);
+    if (xLogBinTaskHandle == NULL)
+        Error_Handler(ERROR_TASK_CREATE);
+
+    /* Writer - below the drain, SD latency only delays the writes */
+    static StaticTask_t xLogBinWrTaskTCB;
+    static StackType_t uxLogBinWrTaskStack[LOGWRTASK_STACKSZ];
+
+    xLogBinWrTaskHandle = xTaskCreateStatic(LogBin_WrTask,
+                                             LOGWRTASK_NAME,
+                                             LOGWRTASK_STACKSZ,
+                                             NULL,
+                                             LOGWRTASK_PRIO,
+                                             uxLogBinWrTaskStack,
+                                             &xLogBinWrTaskTCB);
+    if (xLogBinWrTaskHandle == NULL)
+        Error_Handler(ERROR_TASK_CREATE);
+}
+
+/* Set encoding of the next log */
+StdReturn_t LogBin_SetEncoding(uint32_t Enc)
+{
+    if (Enc > LOGBIN_ENC_DELTA)
+        return RET_ARGS_NOK;
+    if (LogBinActive)
+        return RET_ENV_NOK;
+
+    LogBinEnc = Enc;
+    return RET_OK;
+}
+
+/* Get encoding */
+uint32_t LogBin_GetEncoding(void)
+{
+    return LogBinEnc;
+}
+
+/* Start logging to file */
+StdReturn_t LogBin_Start(const char *Path)
+{
+    if (Path == NULL)
+        return RET_ARGS_NOK;
+    if (LogBinActive)
+        return RET_ENV_NOK;
+
+    if (FR_OK != f_open(&LogBinFile, Path, (FA_CREATE_ALWAYS | FA_WRITE)))
+        return RET_HW_NOK;
+
+    memset(LogBinBufs, 0, sizeof(LogBinBufs));
+    memset(&LogBinStats, 0, sizeof(LogBinStats));
+    LogBinFill = 0;
+    LogBinStopReq = false;
+    LogBinFinal = false;
+    LogBinErr = false;
+    LogBinFileOff = 0;
+    LogBinStreamOff = 0;
+    memset(LogBinEncs, 0, sizeof(LogBinEncs));
+    xQueueReset(LogBinQ);
+
+    /* Cluster allocation is done now, not while logging */
+    LogBin_Prealloc();
+
+    /* Index next to the log, writer owns it from here */
+    LogBinStart = HRT_GetTick64();
+    LogBin_IdxOpen(Path);
+    LogBin_PyrOpen(Path);
+
+    LogBin_SetStep();
+    LogBin_PutHdr();
+
+    LogBinActive = true;
+    xTaskNotifyGive(xLogBinTaskHandle);
+    return RET_OK;
+}
+
+/* Stop logging - posted, EVT_USB_LOGBIN follows once the file is closed */
+StdReturn_t LogBin_Stop(void)
+{
+    if (!LogBinActive || LogBinStopReq)
+        return RET_OK;
+
+    LogBinStopReq = true;
+    xTaskNotifyGive(xLogBinTaskHandle);
+
+    return RET_OK;
+}
+
+/* Stop logging - from ISR */
+void LogBin_StopFromISR(void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (!LogBinActive || LogBinStopReq)
+        return;
+
+    LogBinStopReq = true;
+    vTaskNotifyGiveFromISR(xLogBinTaskHandle, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* Is logging */
+bool LogBin_IsActive(void)
+{
+    return LogBinActive;
+}
+
+/* Has the last log failed - file error while writing */
+bool LogBin_IsFailed(void)
+{
+    return LogBinErr;
+}
+
+/* Test started - log to a new file when data logging is enabled */
+StdReturn_t LogBin_TestStart(void)
+{
+    char path[LOGBIN_PATH_LEN];
+
+    if (!CfgDev_Get_DataLogEnable())
+        return RET_OK;
+
+    snprintf(path, sizeof(path), "%08lX.BIN", (unsigned long) Sys_GetTime());
+    return LogBin_Start(path);
+}
+
+/* Test stopped */
+StdReturn_t LogBin_TestStop(void)
+{
+    return LogBin_Stop();
+}
+
+/* Queue sample - dropped while not logging */
+StdReturn_t LogBin_PutReading(ChnReading_t *Reading)
+{
+    if ((LogBinQ == NULL) || !LogBinActive || LogBinStopReq)
+        return RET_ENV_NOK;
+
+    if (pdPASS != xQueueSend(LogBinQ, Reading, 0))
+        return RET_BUF_FULL;
+
+    return RET_OK;
+}
+
+/* Queue sample - from ISR */
+StdReturn_t LogBin_PutReadingFromISR(ChnReading_t *Reading)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if ((LogBinQ == NULL) || !LogBinActive || LogBinStopReq)
+        return RET_ENV_NOK;
+
+    if (pdPASS != xQueueSendFromISR(LogBinQ, Reading, &xHigherPriorityTaskWoken))
+        return RET_BUF_FULL;
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+
+    return RET_OK;
+}
+
+/* Get statistics */
+void LogBin_GetStats(LogBin_Stats_t *Stats)
+{
+    *Stats = LogBinStats;
+    Stats->Bytes = (LogBinStreamOff > LOGBIN_HDR_LEN) ? (LogBinStreamOff - LOGBIN_HDR_LEN) : 0;
+}
+
+/* Index path of log file - extension replaced with .IDX */
+void LogBin_IdxPath(const char *Path, char *IdxPath, uint32_t Size)
+{
+    LogBin_SidePath(Path, ".IDX", IdxPath, Size);
+}
+
+/* Find pyramid level fitting a point count - coarsest with at least Points entries */
+StdReturn_t LogBin_PyrFind(const char *Path, uint32_t Points, char *PyrPath, uint32_t Size, uint32_t *Level, uint32_t *Count)
+{
+    char ext[4] = ".P1";
+    bool found = false;
+    FIL file;
+
+    if ((Path == NULL) || (PyrPath == NULL))
+        return RET_ARGS_NOK;
+
+    /* Finest first - stop at the first too coarse for the points */
+    for (uint32_t l = 0; l < LOGBIN_PYR_N_LEVEL; l++) {
+        char pyrPath[LOGBIN_PATH_LEN];
+
+        ext[2] = (char) ('1' + l);
+        LogBin_SidePath(Path, ext, pyrPath, sizeof(pyrPath));
+        if (FR_OK != f_open(&file, pyrPath, FA_READ))
+            continue;
+        FSIZE_t size = f_size(&file);
+        f_close(&file);
+        if (size < LOGBIN_PYR_HDR_LEN)
+            continue;
+        uint32_t count = (uint32_t) ((size - LOGBIN_PYR_HDR_LEN) / LOGBIN_PYR_ENT_LEN);
+
+        if (found && (count < Points))
+            break;
+        memset(PyrPath, 0, Size);
+        strncpy(PyrPath, pyrPath, (Size - 1));
+        *Level = l + 1;
+        *Count = count;
+        found = true;
+    }
+
+    return (found ? RET_OK : RET_HW_NOK);
+}
+
+/* Find byte range of log file covering a time window (Sys_GetTime units) - End 0 is end of file */
+StdReturn_t LogBin_IdxFind(const char *Path, uint32_t From, uint32_t To, uint32_t *Start, uint32_t *End)
+{
+    char idxPath[LOGBIN_PATH_LEN];
+    uint8_t hdr[LOGBIN_IDX_HDR_LEN];
+    FIL file;
+    UINT len;
+
+    if ((Path == NULL) || (From > To))
+        return RET_ARGS_NOK;
+
+    LogBin_IdxPath(Path, idxPath, sizeof(idxPath));
+    if (FR_OK != f_open(&file, idxPath, FA_READ))
+        return RET_HW_NOK;
+
+    if ((FR_OK != f_read(&file, hdr, sizeof(hdr), &len)) || (len != sizeof(hdr)) ||
+            (GetArgUINT32(&hdr[0]) != LOGBIN_IDX_MAGIC)) {
+        f_close(&file);
+        return RET_NOK;
+    }
+
+    /* Window in msecs from start of log */
+    uint32_t startTime = GetArgUINT32(&hdr[12]);
+    uint64_t from = (From > startTime) ? ((uint64_t) (From - startTime) * 1000) : 0;
+    uint64_t to = (To > startTime) ? ((uint64_t) (To - startTime) * 1000) : 0;
+    /* Encoded blocks hold up to a block time of earlier samples */
+    to += LOGBIN_BLK_TIME;
+    from = MIN(from, UINT32_MAX);
+    to = MIN(to, UINT32_MAX);
+
+    uint32_t n = (uint32_t) ((f_size(&file) - LOGBIN_IDX_HDR_LEN) / LOGBIN_IDX_ENT_LEN);
+    uint32_t first, last, t;
+    bool ok = LogBin_IdxSearch(&file, n, (uint32_t) from, &first) &&
+              LogBin_IdxSearch(&file, n, (uint32_t) to, &last);
+
+    /* From the entry before the window, to the entry after it */
+    *Start = LOGBIN_HDR_LEN;
+    *End = 0;
+    if (ok && (first > 0))
+        ok = LogBin_IdxRead(&file, (first - 1), &t, Start);
+    if (ok && (last < n))
+        ok = LogBin_IdxRead(&file, last, &t, End);
+
+    f_close(&file);
+    return (ok ? RET_OK : RET_HW_NOK);
+}
+
+/******************************** End of File *********************************/
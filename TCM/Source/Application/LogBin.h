@@ -0,0 +1,105 @@
+/**
+ *  @file LogBin.h
+ *  @brief Binary data logger - double buffered, sector aligned
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _LOGBIN_H_
+#define _LOGBIN_H_
+
+/* Includes */
+#include "PAL.h"
+#include "DAQ.h"
+
+/* Macros */
+
+/* Buffer length - multiple of the SD sector, every write starts on a buffer boundary */
+#define LOGBIN_BUF_LEN      (4096)
+
+/* File header */
+#define LOGBIN_MAGIC        (0x424D4354)    // "TCMB"
+#define LOGBIN_VERSION      (1)
+#define LOGBIN_HDR_LEN      (44)
+#define LOGBIN_UNITS_LEN    (8)
+
+/* Record - source and reading */
+#define LOGBIN_REC_LEN      (5)
+
+/* Encodings - header byte 10 */
+#define LOGBIN_ENC_RAW      (0)     // Records
+#define LOGBIN_ENC_DELTA    (1)     // Blocks of quantized deltas per source
+
+/* Encoded block - header, then Count - 1 zigzag varint deltas of the quantized readings */
+#define LOGBIN_BLK_SYNC     (0x4B42)        // "BK"
+#define LOGBIN_BLK_HDR_LEN  (24)            // [Sync u16][Src][0][Count u16][Len u16][Time u32][First i32][Step f32][CRC32]
+#define LOGBIN_BLK_DATA_MAX (512)
+#define LOGBIN_BLK_COUNT_MAX (1024)
+#define LOGBIN_BLK_TIME     (1000)          // Oldest sample of an open block (msecs)
+/* Sources logged when encoded */
+#define LOGBIN_N_SRC        (4)
+
+/* Time index sidecar (.IDX) - header, then an entry per buffer written */
+#define LOGBIN_IDX_MAGIC    (0x494D4354)    // "TCMI"
+#define LOGBIN_IDX_VERSION  (1)
+#define LOGBIN_IDX_HDR_LEN  (16)
+#define LOGBIN_IDX_ENT_LEN  (8)             // [Time u32 msecs from start][Offset u32 of record]
+
+/* Preview pyramid sidecars (.P1, .P2) - min/max/mean per source, each level 1:64 of the one below */
+#define LOGBIN_PYR_MAGIC    (0x504D4354)    // "TCMP"
+#define LOGBIN_PYR_VERSION  (1)
+#define LOGBIN_PYR_N_LEVEL  (2)
+#define LOGBIN_PYR_RATIO    (64)
+#define LOGBIN_PYR_HDR_LEN  (16)
+#define LOGBIN_PYR_ENT_LEN  (15)            // [Src][Count u16, saturates][Min f32][Max f32][Mean f32]
+
+/* Types */
+
+/* Statistics */
+typedef struct {
+    uint32_t Records;       // Records logged
+    uint32_t Writes;        // Buffers written
+    uint32_t BufWaits;      // Buffer full, writer still busy with the other
+    uint32_t MaxWriteTime;  // Longest buffer write (msecs)
+    uint32_t Prealloc;      // Contiguous region at start (bytes), 0 if the file grows
+    uint32_t IdxEntries;    // Time index entries
+    uint32_t Blocks;        // Encoded blocks
+    uint32_t Bytes;         // Bytes logged after the header
+    uint32_t PyrEntries[LOGBIN_PYR_N_LEVEL];    // Preview entries per level
+} LogBin_Stats_t;
+
+/* Function Prototypes */
+/* Init */
+void LogBin_Init(void);
+/* Set encoding of the next log */
+StdReturn_t LogBin_SetEncoding(uint32_t Enc);
+/* Get encoding */
+uint32_t LogBin_GetEncoding(void);
+/* Start logging to file */
+StdReturn_t LogBin_Start(const char *Path);
+/* Stop logging - posted, EVT_USB_LOGBIN follows once the file is flushed and closed */
+StdReturn_t LogBin_Stop(void);
+/* Stop logging - from ISR */
+void LogBin_StopFromISR(void);
+/* Is logging - till the file is closed */
+bool LogBin_IsActive(void);
+/* Has the last log failed - file error while writing */
+bool LogBin_IsFailed(void);
+/* Test started - log to a new file when data logging is enabled */
+StdReturn_t LogBin_TestStart(void);
+/* Test stopped */
+StdReturn_t LogBin_TestStop(void);
+/* Queue sample - call where it is acquired, dropped while not logging */
+StdReturn_t LogBin_PutReading(ChnReading_t *Reading);
+/* Queue sample - from ISR */
+StdReturn_t LogBin_PutReadingFromISR(ChnReading_t *Reading);
+/* Get statistics */
+void LogBin_GetStats(LogBin_Stats_t *Stats);
+/* Index path of log file */
+void LogBin_IdxPath(const char *Path, char *IdxPath, uint32_t Size);
+/* Find byte range of log file covering a time window (Sys_GetTime units) - End 0 is end of file */
+StdReturn_t LogBin_IdxFind(const char *Path, uint32_t From, uint32_t To, uint32_t *Start, uint32_t *End);
+/* Find pyramid level fitting a point count - coarsest with at least Points entries */
+StdReturn_t LogBin_PyrFind(const char *Path, uint32_t Points, char *PyrPath, uint32_t Size, uint32_t *Level, uint32_t *Count);
+
+#endif /* _LOGBIN_H_ */
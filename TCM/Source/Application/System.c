@@ -91,14 +91,9 @@ static void GoShutdown(bool SysRunning)
         vTaskSuspend(xDispTaskHandle);
         vTaskSuspend(xDaqTaskHandle);
         vTaskSuspend(xCfgTaskHandle);
-        vTaskSuspend(xComCmdUSBTaskHandle);
-        vTaskSuspend(xComCmdTCMTaskHandle);
+        vTaskSuspend(xComTaskHandle);
         vTaskSuspend(xComDataTaskHandle);
-        vTaskSuspend(xComEvtTCMTaskHandle);
-        vTaskSuspend(xComEvtUSBTaskHandle);
         vTaskSuspend(xAxMHostTaskHandle);
-        vTaskSuspend(xAxM1RxTaskHandle);
-        vTaskSuspend(xAxM2RxTaskHandle);
 
         /* Down display */
         Disp_PwrDown();
@@ -120,6 +115,7 @@ static void GoShutdown(bool SysRunning)
     Power_Down();
 
     /* Disable running interrupts */
+    PAL_NVIC_DisableIRQ(DMA1_Channel4_IRQn);
     PAL_NVIC_DisableIRQ(DMA1_Channel3_IRQn);
     PAL_NVIC_DisableIRQ(DMA1_Channel2_IRQn);
     PAL_NVIC_DisableIRQ(USART3_IRQn);
@@ -329,7 +325,7 @@ static void SysStateON(void)
         static uint32_t TempTimeStart = 0; // temp var
         if((xTaskGetTickCount() - TempTimeStart) > 1000) { // 1 sec
             TempTimeStart = xTaskGetTickCount();
-            xTaskNotify(xComEvtUSBTaskHandle, EVT_USB_BOOTERR, eSetValueWithOverwrite);
+            COM_SetEvent(COM_PORT_USB, EVT_USB_BOOTERR);
         }
     }
 
@@ -458,8 +454,11 @@ bool Sys_InitStage1(void)
 /* Init - Stage2 */
 bool Sys_InitStage2(void)
 {
-    if(!Sys.StartUp)
+    /* Stage1 not run - rails and the gauge bus are down, charge state from CHRG_STATUS only */
+    if(!Sys.StartUp) {
+        Power_CacheStart(false);
         return false;
+    }
 
     if(RET_OK != Power_InitStage2(&Sys.PwrStat)) {
     	Error_Handler(ERROR_BOOTUP_POWER_INIT2);
@@ -484,6 +483,9 @@ bool Sys_InitStage2(void)
     Sys.DischargeCnt = 0;
     Sys.PwrStat.ExtPwr = false;
 
+    /* Wall clock of the high resolution time */
+    HRT_SetWallClock(Sys_GetTime());
+
     //RV:SYSTask_Create();
 
     Sys.StartUp = true;
@@ -552,5 +554,53 @@ bool Sys_GetWakeupOnExtPwr(void)
     return Sys.WakeupOnExtPwr;
 }
 
+/* Is Charging - cached, never on the bus. False till CHRG_STATUS is sampled */
+bool Sys_IsCharging(void)
+{
+    uint32_t val = 0;
+
+    if(PWR_CACHE_NONE == Power_GetCached(PWR_FLD_CHARGING, &val))
+        return false;
+    return (val != 0);
+}
+
+/* Battery fields stale - some gauge field missed its refreshes or was never read */
+bool Sys_IsBattStale(void)
+{
+    uint32_t val;
+
+    return ((PWR_CACHE_FRESH != Power_GetCached(PWR_FLD_TEMP, &val)) ||
+            (PWR_CACHE_FRESH != Power_GetCached(PWR_FLD_VOLTAGE, &val)) ||
+            (PWR_CACHE_FRESH != Power_GetCached(PWR_FLD_LEVEL, &val)));
+}
+
+/* Battery level (%) - cached, last good read if stale, 0 if never read */
+uint32_t Sys_GetBattLevel(void)
+{
+    uint32_t val = 0;
+
+    Power_GetCached(PWR_FLD_LEVEL, &val);
+    return val;
+}
+
+/* Battery voltage (V) - cached, last good read if stale, 0 if never read */
+float32_t Sys_GetBattVoltage(void)
+{
+    uint32_t val = 0;
+
+    Power_GetCached(PWR_FLD_VOLTAGE, &val);
+    return ((float32_t)val / 1000.0f);
+}
+
+/* Battery temperature (degC) - cached, last good read if stale, 0 if never read */
+float32_t Sys_GetBattTemp(void)
+{
+    uint32_t val = 0;
+
+    if(PWR_CACHE_NONE == Power_GetCached(PWR_FLD_TEMP, &val))
+        return 0.0f;
+    return (((float32_t)val / 10.0f) - 273.15f);
+}
+
 
 /******************************** End of File *********************************/
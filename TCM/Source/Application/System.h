@@ -39,7 +39,7 @@ bool Sys_SetReqCharging(bool Enable);
 uint32_t Sys_GetTime(void);
 /* Set Time */
 bool Sys_SetTime(uint32_t SysTime);
-/* Is Charging */
+/* Is Charging - false till CHRG_STATUS is sampled */
 bool Sys_IsCharging(void);
 /* Is charging enabled */
 bool Sys_IsChargeEnabled(void);
@@ -51,6 +51,8 @@ void Sys_SetBattConnected(bool Connected);
 bool Sys_IsUSBConnected(void);
 /* Is TCM connected */
 bool Sys_IsTCMConnected(void);
+/* Battery fields stale - the getters below then hold the last good read, 0 if never read */
+bool Sys_IsBattStale(void);
 /* Battery level */
 uint32_t Sys_GetBattLevel(void);
 /* Battery voltage */
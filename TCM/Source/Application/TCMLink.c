@@ -0,0 +1,243 @@
+/**
+ *  @file TCMLink.c
+ *  @brief TCM serial link - baud rate negotiation
+ *  @author JZJ
+ *
+ **/
+
+/* Includes */
+#include "TCMLink.h"
+#include "RTOS.h"
+#include "BufUtil.h"
+#include "dUART.h"
+
+/* Macros */
+
+/* Both ends switch after the acknowledgement plus this guard time */
+#define TCMLINK_GUARD_TIME      (20)    // 20 msecs
+/* Host must confirm at the new rate within this time */
+#define TCMLINK_VERIFY_TIME     (1000)  // 1 sec
+/* Fall back to default rate without valid commands for this time - host keeps the link with QUERY */
+#define TCMLINK_KEEPALIVE_TIME  (5000)  // 5 secs
+
+/* Data length of link commands */
+#define TCMLINK_DATALEN_OPT     (1)
+#define TCMLINK_DATALEN_BAUD    (5)
+
+/* Types */
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static TCMLink_State_t LinkState = TCMLINK_IDLE;
+/* Rate being switched to */
+static uint32_t LinkBaud = dUART_BAUD_DEFAULT;
+/* State entry or last valid traffic */
+static TickType_t LinkTick = 0;
+
+/* Private Functions */
+
+/* Set state */
+static inline void TCMLink_SetState(TCMLink_State_t State)
+{
+    LinkState = State;
+    LinkTick = xTaskGetTickCount();
+}
+
+/* Response - option, rate and state */
+static void TCMLink_Resp(uint8_t Addr, uint8_t Opt, uint8_t *RspBuf, uint32_t *RspLen)
+{
+    RspBuf[0] = Addr;
+    RspBuf[1] = TCMLINK_FUNCCODE;
+    RspBuf[2] = 0x06;
+    RspBuf[3] = Opt;
+    SetValUINT32(LinkBaud, &RspBuf[4]);
+    RspBuf[8] = (uint8_t) LinkState;
+    RspBuf[9] = GetCRC(RspBuf, 9);
+    *RspLen = 10;
+}
+
+/* NACK */
+static void TCMLink_NACK(uint8_t Addr, uint8_t Exception, uint8_t *RspBuf, uint32_t *RspLen)
+{
+    RspBuf[0] = Addr;
+    RspBuf[1] = TCMLINK_FUNCCODE;
+    RspBuf[2] = 0x02;
+    RspBuf[3] = CMD_EXC_CMDS;
+    RspBuf[4] = Exception;
+    RspBuf[5] = GetCRC(RspBuf, 5);
+    *RspLen = 6;
+}
+
+/* Fall back to default rate */
+static void TCMLink_Fallback(void)
+{
+    LinkBaud = dUART_BAUD_DEFAULT;
+    dUART_SetBaudRate(dUART_PORT_TCM, dUART_BAUD_DEFAULT);
+    TCMLink_SetState(TCMLINK_IDLE);
+}
+
+/* Public Functions */
+
+/* Init */
+void TCMLink_Init(void)
+{
+    LinkBaud = dUART_BAUD_DEFAULT;
+    TCMLink_SetState(TCMLINK_IDLE);
+}
+
+/* Is link command */
+bool TCMLink_IsLinkCmd(uint8_t *CmdBuf, uint32_t CmdLen)
+{
+    return ((CmdLen >= 2) && (CMDBYTE_FUNCCODE == TCMLINK_FUNCCODE));
+}
+
+/* Process link command */
+CmdStatus_t TCMLink_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen)
+{
+    *RspLen = 0;
+
+    /* At least 4 bytes for a message */
+    if (CmdLen < 4)
+        return CMDSTAT_PROCESSING;
+
+    /* Check for entire message */
+    uint32_t msgCnt = CMDBYTE_DATALEN + 4;
+    if (CmdLen < msgCnt)
+        return CMDSTAT_PROCESSING;
+
+    uint8_t addr = CMDBYTE_DEVADDR;
+
+    /* A corrupted rate would take the link down, always check CRC */
+    if (CmdBuf[msgCnt - 1] != GetCRC(CmdBuf, msgCnt - 1)) {
+        TCMLink_NACK(addr, CMD_RET_CRCERROR, RspBuf, RspLen);
+        return CMDSTAT_DONE;
+    }
+
+    if (CMDBYTE_DATALEN < TCMLINK_DATALEN_OPT) {
+        TCMLink_NACK(addr, CMD_RET_WRONGARGS, RspBuf, RspLen);
+        return CMDSTAT_DONE;
+    }
+
+    uint8_t opt = CMDBYTE_DATA0;
+    uint32_t baud;
+
+    switch (opt) {
+    /* Current rate and state */
+    case TCMLINK_OPT_QUERY:
+        TCMLink_Resp(addr, opt, RspBuf, RspLen);
+        break;
+
+    /* Host proposes a rate, switch after the guard time */
+    case TCMLINK_OPT_PROPOSE:
+        if (CMDBYTE_DATALEN != TCMLINK_DATALEN_BAUD) {
+            TCMLink_NACK(addr, CMD_RET_WRONGARGS, RspBuf, RspLen);
+            break;
+        }
+        if ((LinkState != TCMLINK_IDLE) && (LinkState != TCMLINK_LOCKED)) {
+            TCMLink_NACK(addr, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+            break;
+        }
+        baud = GetArgUINT32(&CMDBYTE_DATA0 + 1);
+        if (!dUART_IsBaudSupported(dUART_PORT_TCM, baud)) {
+            TCMLink_NACK(addr, CMD_RET_WRONGARGS, RspBuf, RspLen);
+            break;
+        }
+        LinkBaud = baud;
+        TCMLink_SetState(TCMLINK_SWITCH);
+        TCMLink_Resp(addr, opt, RspBuf, RspLen);
+        break;
+
+    /* Host confirms at the new rate */
+    case TCMLINK_OPT_CONFIRM:
+        if (CMDBYTE_DATALEN != TCMLINK_DATALEN_BAUD) {
+            TCMLink_NACK(addr, CMD_RET_WRONGARGS, RspBuf, RspLen);
+            break;
+        }
+        baud = GetArgUINT32(&CMDBYTE_DATA0 + 1);
+        if (((LinkState != TCMLINK_VERIFY) && (LinkState != TCMLINK_LOCKED)) ||
+                (baud != dUART_GetBaudRate(dUART_PORT_TCM))) {
+            TCMLink_NACK(addr, CMD_RET_IMPROPERENV, RspBuf, RspLen);
+            break;
+        }
+        TCMLink_SetState(TCMLINK_LOCKED);
+        TCMLink_Resp(addr, opt, RspBuf, RspLen);
+        break;
+
+    /* Host requests default rate */
+    case TCMLINK_OPT_REVERT:
+        if (LinkState != TCMLINK_IDLE) {
+            LinkBaud = dUART_BAUD_DEFAULT;
+            TCMLink_SetState(TCMLINK_REVERT);
+        }
+        TCMLink_Resp(addr, opt, RspBuf, RspLen);
+        break;
+
+    default:
+        TCMLink_NACK(addr, CMD_RET_WRONGARGS, RspBuf, RspLen);
+        break;
+    }
+
+    return CMDSTAT_DONE;
+}
+
+/* Frame completed on link - only frames passing CRC keep the link */
+void TCMLink_Activity(uint8_t *CmdBuf, uint32_t CmdLen)
+{
+    if ((LinkState != TCMLINK_LOCKED) || (CmdLen < 4))
+        return;
+
+    uint32_t msgCnt = CMDBYTE_DATALEN + 4;
+    if ((CmdLen < msgCnt) || (CmdBuf[msgCnt - 1] != GetCRC(CmdBuf, msgCnt - 1)))
+        return;
+
+    LinkTick = xTaskGetTickCount();
+}
+
+/* Run link state machine - call periodically */
+void TCMLink_Tick(void)
+{
+    TickType_t elapsed = xTaskGetTickCount() - LinkTick;
+
+    switch (LinkState) {
+    case TCMLINK_SWITCH:
+    case TCMLINK_REVERT:
+        /* Acknowledgement must be on the wire before switching */
+        if (!dUART_IsTxIdle(dUART_PORT_TCM) || (elapsed < pdMS_TO_TICKS(TCMLINK_GUARD_TIME)))
+            break;
+        if ((LinkState == TCMLINK_REVERT) ||
+                (RET_OK != dUART_SetBaudRate(dUART_PORT_TCM, LinkBaud))) {
+            TCMLink_Fallback();
+            break;
+        }
+        TCMLink_SetState(TCMLINK_VERIFY);
+        break;
+
+    case TCMLINK_VERIFY:
+        /* No confirmation - host could not follow */
+        if (elapsed >= pdMS_TO_TICKS(TCMLINK_VERIFY_TIME))
+            TCMLink_Fallback();
+        break;
+
+    case TCMLINK_LOCKED:
+        /* Link lost */
+        if (elapsed >= pdMS_TO_TICKS(TCMLINK_KEEPALIVE_TIME))
+            TCMLink_Fallback();
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Get link state */
+TCMLink_State_t TCMLink_GetState(void)
+{
+    return LinkState;
+}
+
+/******************************** End of File *********************************/
@@ -0,0 +1,51 @@
+/**
+ *  @file TCMLink.h
+ *  @brief TCM serial link - baud rate negotiation
+ *  @author JZJ
+ *
+ **/
+
+#ifndef _TCMLINK_H_
+#define _TCMLINK_H_
+
+/* Includes */
+#include "PAL.h"
+#include "Cmds.h"
+
+/* Macros */
+
+/* Link command function code */
+#define TCMLINK_FUNCCODE    (0xE0)
+
+/* Link command options */
+#define TCMLINK_OPT_QUERY   (0x00)
+#define TCMLINK_OPT_PROPOSE (0x01)
+#define TCMLINK_OPT_CONFIRM (0x02)
+#define TCMLINK_OPT_REVERT  (0x03)
+
+/* Types */
+
+/* Link states */
+typedef enum {
+    TCMLINK_IDLE = 0,   // Default baud rate
+    TCMLINK_SWITCH,     // Proposal acknowledged, waiting for guard time
+    TCMLINK_VERIFY,     // Switched, waiting for host confirmation
+    TCMLINK_LOCKED,     // Running at negotiated baud rate
+    TCMLINK_REVERT,     // Revert acknowledged, waiting for guard time
+} TCMLink_State_t;
+
+/* Function Prototypes */
+/* Init */
+void TCMLink_Init(void);
+/* Is link command */
+bool TCMLink_IsLinkCmd(uint8_t *CmdBuf, uint32_t CmdLen);
+/* Process link command */
+CmdStatus_t TCMLink_Process(uint8_t *CmdBuf, uint32_t CmdLen, uint8_t *RspBuf, uint32_t *RspLen);
+/* Frame completed on link - only frames passing CRC keep the link */
+void TCMLink_Activity(uint8_t *CmdBuf, uint32_t CmdLen);
+/* Run link state machine - call periodically */
+void TCMLink_Tick(void);
+/* Get link state */
+TCMLink_State_t TCMLink_GetState(void);
+
+#endif /* _TCMLINK_H_ */
@@ -40,30 +40,39 @@
 #define DAQTASK_NAME    ("DAQ")
 #define DAQTASK_PRIO    (4)
 #define DAQTASK_STACKSZ (1024)
-/* Command Task - USB/TCM */
-#define COMCMDUSBTASK_NAME  	("COMCMDUSB")
-#define COMCMDUSBTASK_PRIO  	(5)
-#define COMCMDUSBTASK_STACKSZ	(512 + 256)
-#define COMCMDTCMTASK_NAME  	("COMCMDTCM")
-#define COMCMDTCMTASK_PRIO  	(5)
-#define COMCMDTCMTASK_STACKSZ  	(512 + 256)
+/* COM Task - commands and events, all ports */
+#define COMTASK_NAME  		("COM")
+#define COMTASK_PRIO  		(5)
+#define COMTASK_STACKSZ		(1024)
+/* Log Task - drains LogDataQ */
+#define LOGTASK_NAME        ("LOG")
+#define LOGTASK_PRIO        (4)
+#define LOGTASK_STACKSZ     (256)
+/* Log Writer Task - SD writes */
+#define LOGWRTASK_NAME      ("LOGWR")
+#define LOGWRTASK_PRIO      (2)
+#define LOGWRTASK_STACKSZ   (512)
+/* Export Task - bulk file export */
+#define EXPORTTASK_NAME     ("EXPORT")
+#define EXPORTTASK_PRIO     (2)
+#define EXPORTTASK_STACKSZ  (512)
+/* AxM Update Task - windowed image transfer */
+#define AXMUPDTASK_NAME     ("AXMUPD")
+#define AXMUPDTASK_PRIO     (3)
+#define AXMUPDTASK_STACKSZ  (512)
+/* I2C Task - bus recovery deferred from the ISRs. No watchdog entry, created only when an
+ * interrupt driven bus is initialised */
+#define I2CTASK_NAME        ("I2C")
+#define I2CTASK_PRIO        (5)
+#define I2CTASK_STACKSZ     (256)
+/* Black Box Task - break captures to card */
+#define BBOXTASK_NAME       ("BBOX")
+#define BBOXTASK_PRIO       (1)
+#define BBOXTASK_STACKSZ    (512)
 /* Data Task */
 #define COMDATATASK_NAME    ("COMDAT")
 #define COMDATATASK_PRIO    (5)
 #define COMDATATASK_STACKSZ (256)
-/* Event Task - USB/TCM */
-#define COMEVTUSBTASK_NAME       ("COMEVTUSB")
-#define COMEVTUSBTASK_PRIO       (5)
-#define COMEVTUSBTASK_STACKSZ    (512)
-#define COMEVTTCMTASK_NAME       ("COMEVTTCM")
-#define COMEVTTCMTASK_PRIO       (5)
-#define COMEVTTCMTASK_STACKSZ    (256)
-/* AxM Tasks - Rx */
-#define AxM1RXTASK_NAME     ("AxM1RX")
-#define AxM1RXTASK_PRIO     (5)
-#define AxM2RXTASK_NAME     ("AxM2RX")
-#define AxM2RXTASK_PRIO     (5)
-#define AXMRXTASK_STACKSZ   (256)
 /* IO Task */
 #define IOTASK_NAME     ("IO")
 #define IOTASK_PRIO     (6)
@@ -87,7 +96,9 @@
 #define EVT_USB_CSAFELMT    (0x00000040)
 #define EVT_USB_EXPORT_FILE (0x00000100)
 #define EVT_USB_UPDSTAT		(0x00000200)
-#define EVT_USB_MASKALL     (0x0000037F)
+#define EVT_USB_AXMUPD		(0x00000400)
+#define EVT_USB_LOGBIN		(0x00000800)
+#define EVT_USB_MASKALL     (0x00000F7F)
 #define EVT_USB_EXP_ADATA	(0x00010000)
 #define EVT_USB_EXP_ADATA_H	(0x00020000)
 
@@ -112,25 +123,16 @@
 extern TaskHandle_t xDaqTaskHandle;
 extern TaskHandle_t xDispTaskHandle;
 extern TaskHandle_t xCfgTaskHandle;
-extern TaskHandle_t xComCmdUSBTaskHandle;
-extern TaskHandle_t xComCmdTCMTaskHandle;
+extern TaskHandle_t xComTaskHandle;
 extern TaskHandle_t xComDataTaskHandle;
-extern TaskHandle_t xComEvtUSBTaskHandle;
-extern TaskHandle_t xComEvtTCMTaskHandle;
 extern TaskHandle_t xAxMHostTaskHandle;
-extern TaskHandle_t xAxM1RxTaskHandle;
-extern TaskHandle_t xAxM2RxTaskHandle;
 extern TaskHandle_t xSysTaskHandle;
 extern TaskHandle_t xIOTaskHandle;
 extern TaskHandle_t xWatchdogTaskHandle;
 extern TaskHandle_t xUpdateAxMTaskHandle;
 
-extern QueueHandle_t LogDataQ;
-extern QueueHandle_t ComDataQ;
-extern QueueHandle_t CmdUSBQ;
+extern QueueHandle_t ComRecQ;
 extern QueueHandle_t CmdTCMQ;
-extern QueueHandle_t CmdAxM1Q;
-extern QueueHandle_t CmdAxM2Q;
 
 extern SemaphoreHandle_t COMUSBSem;
 
@@ -0,0 +1,38 @@
+/**
+ **  @file BufUtil.c
+ **  @brief Frame buffer helpers - CRC and unaligned fields
+ **  @author JZJ
+ **
+ **/
+
+/* Includes */
+#include "BufUtil.h"
+#include "CRC8OS.h"
+#include "Prof.h"
+
+/* Macros */
+
+/* Types */
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+
+/* Private Functions */
+
+/* Public Functions */
+
+/* Get CRC - CRC8OS over the frame */
+uint8_t GetCRC(uint8_t *Buf, uint32_t Len)
+{
+    PROF_START(PROF_CRC8OS_CALC);
+    uint8_t crc = CRC8OS_Calc(Buf, Len, CRC8OS_Init());
+    PROF_STOP(PROF_CRC8OS_CALC);
+    return crc;
+}
+
+/******************************** End of File *********************************/
@@ -0,0 +1,70 @@
+/**
+ **  @file BufUtil.h
+ **  @brief Frame buffer helpers - CRC and unaligned fields
+ **  @author JZJ
+ **
+ **/
+
+#ifndef _BUFUTIL_H_
+#define _BUFUTIL_H_
+
+/* Includes */
+#include "PAL.h"
+
+/* Macros */
+
+/* Types */
+
+/* Function Prototypes */
+/* Get CRC - CRC8OS over the frame */
+uint8_t GetCRC(uint8_t *Buf, uint32_t Len);
+
+/* Get arguments */
+static inline uint8_t GetArgUINT8(const uint8_t *Buf)
+{
+    return *Buf;
+}
+static inline uint16_t GetArgUINT16(const uint8_t *Buf)
+{
+    uint16_t arg;
+    memcpy((void*)&arg, (void*)Buf, sizeof(uint16_t));
+    return arg;
+}
+static inline uint32_t GetArgUINT32(const uint8_t *Buf)
+{
+    uint32_t arg;
+    memcpy((void*)&arg, (void*)Buf, sizeof(uint32_t));
+    return arg;
+}
+static inline int32_t GetArgINT32(const uint8_t *Buf)
+{
+    int32_t arg;
+    memcpy((void*)&arg, (void*)Buf, sizeof(int32_t));
+    return arg;
+}
+static inline float32_t GetArgFLT32(const uint8_t *Buf)
+{
+    float32_t arg;
+    memcpy((void*)&arg, (void*)Buf, sizeof(float32_t));
+    return arg;
+}
+
+/* Set values */
+static inline void SetValUINT16(uint16_t Val, uint8_t *Buf)
+{
+    memcpy((void*)Buf, (void*)&Val, sizeof(uint16_t));
+}
+static inline void SetValUINT32(uint32_t Val, uint8_t *Buf)
+{
+    memcpy((void*)Buf, (void*)&Val, sizeof(uint32_t));
+}
+static inline void SetValINT32(int32_t Val, uint8_t *Buf)
+{
+    memcpy((void*)Buf, (void*)&Val, sizeof(int32_t));
+}
+static inline void SetValFLT32(float32_t Val, uint8_t *Buf)
+{
+    memcpy((void*)Buf, (void*)&Val, sizeof(float32_t));
+}
+
+#endif /*** _BUFUTIL_H_ ***/
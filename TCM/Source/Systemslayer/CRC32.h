@@ -0,0 +1,26 @@
+/**
+ **  @file CRC32.h
+ **  @brief CRC32 (IEEE 802.3)
+ **  @author JZJ
+ **
+ **/
+
+#ifndef _CRC32_H_
+#define _CRC32_H_
+
+/* Includes */
+#include "PAL.h"
+
+/* Macros */
+
+/* Types */
+
+/* Function Prototypes */
+/* Init */
+uint32_t CRC32_Init(void);
+/* Calculate - continues from Crc */
+uint32_t CRC32_Calc(const uint8_t *Buf, uint32_t Len, uint32_t Crc);
+/* Final */
+uint32_t CRC32_Final(uint32_t Crc);
+
+#endif /*** _CRC32_H_ ***/
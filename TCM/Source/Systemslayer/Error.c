@@ -43,6 +43,9 @@ static const errorHandler_t ErrorHandler[ERROR_N_ENUM] = {
 	[ERROR_BOOTUP_POWER_INIT2] = 	{LEVEL_ERROR, 	"POWER INIT 2"},
 	[ERROR_SETUP_USB_DEVICE] = 		{LEVEL_ERROR,	"USBD SETUP"},
 	[ERROR_BOOTUP_WATCHDOG_INIT] =  {LEVEL_FATAL,	"WDOG INIT"},
+	[ERROR_COMSTART_TCMi] =			{LEVEL_ERROR,	"TCM COM START"},
+	[ERROR_COMSTART_AxM] =			{LEVEL_ERROR,	"AxM COM START"},
+	[ERROR_LOG_WRITE] =				{LEVEL_WARN,	"LOG WRITE"},
 };
 
 
@@ -25,6 +25,9 @@ typedef enum {
 	ERROR_BOOTUP_POWER_INIT2,	// error in power init state 2
 	ERROR_SETUP_USB_DEVICE,		// error in setting USB Device mode
 	ERROR_BOOTUP_WATCHDOG_INIT,	// error in Watchdog initialization
+	ERROR_COMSTART_TCMi,		// error in starting TCM communication
+	ERROR_COMSTART_AxM,			// error in starting AxM receive
+	ERROR_LOG_WRITE,			// error in writing log file
 	/* ADD NEW ERRORS HERE */
 	ERROR_N_ENUM,
 }errorCode_t;
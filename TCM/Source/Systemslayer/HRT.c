@@ -7,23 +7,117 @@
  
 /* Includes */
 #include "PAL.h"
+#include "RTOS.h"
+#include "Prof.h"
 
 /* Macros */
 
+/* Syscall safe - the ISR wakes delayed tasks */
+#define HRT_IRQ_PRIO        (5)
+
+/* Delays below spin */
+#define HRT_SPIN_MAX        (20)    // 20 usecs
+
+/* Compare channels for task delays - CC2 to CC4 */
+#define HRT_N_WAIT          (3)
+
 /* Types */
 
+/* Wall clock anchor - RTC seconds at a 64 bit tick */
+typedef struct {
+    uint32_t Secs;
+    HRTime64_t Tick;
+} HRT_Anchor_t;
+
 /* Externs */
 
 /* Function Declarations */
 
 /* Global Variables */
-/* High Resolution Ticks */
-__IO HRTime_t HRTick = 0;
 
 /* Static Variables */
+/* Wraps of the 32 bit counter - upper word of 64 bit time, counted in the update ISR
+ * Held shifted by one, bit 0 set while the ISR clears the wrap flag */
+static volatile uint32_t HRTEpoch = 0;
+
+/* Task delays - one waiter per compare channel */
+static StaticSemaphore_t HRTWaitSemBuf[HRT_N_WAIT];
+static SemaphoreHandle_t HRTWaitSem[HRT_N_WAIT];
+static uint32_t HRTWaitBusy = 0;
+
+/* Anchor double buffered, Seq odd while being set */
+static HRT_Anchor_t HRTAnchor[2];
+static volatile uint32_t HRTAnchorSeq = 0;
 
 /* Private Functions */
 
+/* Delay before the scheduler - CC2 match wakes the core, no task waits on it yet */
+static void HRT_DelaySleep(HRTime64_t TickEnd)
+{
+    TIM2->CCR2 = (uint32_t) TickEnd;
+    TIM2->DIER |= TIM_DIER_CC2IE;
+
+    /* RTOS keeps interrupts masked till the scheduler starts - only a new pend ends WFE.
+     * A match left pending would hide the next, flag and pend cleared before each wait,
+     * a set update flag pends again and is not lost */
+    SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+    while (1) {
+        TIM2->SR = ~TIM_SR_CC2IF;
+        NVIC_ClearPendingIRQ(TIM2_IRQn);
+        if (HRT_GetTick64() >= TickEnd)
+            break;
+        __WFE();
+    }
+    SCB->SCR &= ~SCB_SCR_SEVONPEND_Msk;
+
+    TIM2->DIER &= ~TIM_DIER_CC2IE;
+    TIM2->SR = ~TIM_SR_CC2IF;
+    NVIC_ClearPendingIRQ(TIM2_IRQn);
+}
+
+/* Delay in task - blocked till a CC2 to CC4 match */
+static void HRT_DelayBlock(HRTime64_t TickEnd)
+{
+    uint32_t ch;
+
+    taskENTER_CRITICAL();
+    for (ch = 0; ch < HRT_N_WAIT; ch++) {
+        if (!(HRTWaitBusy & (1UL << ch))) {
+            HRTWaitBusy |= (1UL << ch);
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    /* Round up, a late wake is made up by the caller */
+    TickType_t ticks = pdMS_TO_TICKS((uint32_t) ((TickEnd - HRT_GetTick64()) / 1000)) + 1;
+
+    /* All channels waiting - tick resolution */
+    if (ch == HRT_N_WAIT) {
+        vTaskDelay(ticks);
+        return;
+    }
+
+    /* Give left by an earlier match */
+    xSemaphoreTake(HRTWaitSem[ch], 0);
+
+    (&TIM2->CCR2)[ch] = (uint32_t) TickEnd;
+    TIM2->SR = ~(TIM_SR_CC2IF << ch);
+    taskENTER_CRITICAL();
+    TIM2->DIER |= (TIM_DIER_CC2IE << ch);
+    taskEXIT_CRITICAL();
+
+    /* Match may have passed while arming - timeout only as a fallback */
+    if (HRT_GetTick64() < TickEnd)
+        xSemaphoreTake(HRTWaitSem[ch], (ticks + 1));
+
+    taskENTER_CRITICAL();
+    TIM2->DIER &= ~(TIM_DIER_CC2IE << ch);
+    TIM2->SR = ~(TIM_SR_CC2IF << ch);
+    HRTWaitBusy &= ~(1UL << ch);
+    taskEXIT_CRITICAL();
+}
+
 /* Public Functions */
 
 /* Init */
@@ -42,57 +136,146 @@ void HRT_Init(void)
     tmpcr1 |= 0;    
     TIM2->CR1 = tmpcr1;
     
-    /* Timebase calculation for 1 MHz - Assumed 120MHz PCLK1 */
-    /* Update_event = TIM_CLK/((PSC + 1)*(ARR + 1)*(RCR + 1)) */
+    /* Free running at 1 MHz - Assumed 120MHz PCLK1 */
+    /* Count_freq = TIM_CLK/(PSC + 1), 32 bit counter wraps after ~71 mins */
     
-    /* Set the Autoreload value */
-    TIM2->ARR = (12 - 1);
+    /* Set the Autoreload value - full 32 bit range */
+    TIM2->ARR = 0xFFFFFFFF;
     
     /* Set the Prescaler value */
-    TIM2->PSC = (10 - 1);
-    
-    /* Clear status register */
-    TIM2->SR = 0;
+    TIM2->PSC = (120 - 1);
     
     /* Generate an update event to reload the Prescaler
      and the repetition counter (only for advanced timer) value immediately */
     TIM2->EGR = TIM_EGR_UG;
     
-    /* Enable the TIM Update interrupt */
-    //RV:TIM2->DIER |= TIM_IT_UPDATE;
+    /* Clear status register - update interrupt on wrap only, the counter is read directly */
+    TIM2->SR = 0;
+    TIM2->DIER = TIM_DIER_UIE;
+    
+    /* Task delays */
+    for (uint32_t i = 0; i < HRT_N_WAIT; i++)
+        HRTWaitSem[i] = xSemaphoreCreateBinaryStatic(&HRTWaitSemBuf[i]);
     
-    /* Set and enable TIM_TRQn */
-    PAL_NVIC_SetPriority(TIM2_IRQn, 0);
+    PAL_NVIC_SetPriority(TIM2_IRQn, HRT_IRQ_PRIO);
     PAL_NVIC_EnableIRQ(TIM2_IRQn);
     
     /* Enable timer */
     TIM2->CR1 |= TIM_CR1_CEN;
 }
 
-/* Increment */
-void HRT_IncTick(void)
+/* ISR - counter wrapped (once every ~71 mins) or a delay ended, CC1 is the timer wheel */
+void HRT_ISR(void)
 {
-    HRTick++;
+    PROF_START(PROF_HRT_ISR);
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t sr = TIM2->SR & TIM2->DIER;
+
+    if (sr & TIM_SR_UIF) {
+        /* Counted before the flag clears - readers preempting see bit 0 meanwhile */
+        uint32_t epoch = (HRTEpoch >> 1) + 1;
+        HRTEpoch = (epoch << 1) | 1;
+        TIM2->SR = ~TIM_SR_UIF;
+        HRTEpoch = (epoch << 1);
+    }
+
+    /* Task delays */
+    for (uint32_t ch = 0; ch < HRT_N_WAIT; ch++) {
+        if (sr & (TIM_SR_CC2IF << ch)) {
+            TIM2->DIER &= ~(TIM_DIER_CC2IE << ch);
+            TIM2->SR = ~(TIM_SR_CC2IF << ch);
+            xSemaphoreGiveFromISR(HRTWaitSem[ch], &xHigherPriorityTaskWoken);
+        }
+    }
+
+    PROF_STOP(PROF_HRT_ISR);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 /* Get time */
 HRTime_t HRT_GetTick(void)
 {
-    return HRTick;
+    return TIM2->CNT;
+}
+
+/* Get time - 64 bit */
+HRTime64_t HRT_GetTick64(void)
+{
+    uint32_t epoch, tick, wrap;
+
+    /* Lock free - reread if the ISR counted a wrap meanwhile */
+    do {
+        epoch = HRTEpoch;
+        tick = TIM2->CNT;
+        wrap = TIM2->SR & TIM_SR_UIF;
+    } while (epoch != HRTEpoch);
+
+    /* Wrap not counted yet - ISR masked or pending, the counter has restarted */
+    if (wrap && !(epoch & 1) && (tick < 0x80000000))
+        epoch += 2;
+
+    return (((HRTime64_t) (epoch >> 1)) << 32) | tick;
+}
+
+/* Set wall clock anchor - RTC seconds (Sys_GetTime) now */
+void HRT_SetWallClock(uint32_t Secs)
+{
+    uint32_t seq = HRTAnchorSeq;
+    HRT_Anchor_t *anchor = &HRTAnchor[((seq >> 1) + 1) & 1];
+
+    /* Single writer - readers use the other half meanwhile */
+    anchor->Tick = HRT_GetTick64();
+    anchor->Secs = Secs;
+    HRTAnchorSeq = seq + 1;
+    __DMB();
+    HRTAnchorSeq = seq + 2;
+}
+
+/* Convert 64 bit time to wall clock - RTC seconds, Usecs past the second if not NULL */
+uint32_t HRT_ToWallClock(HRTime64_t Tick, uint32_t *Usecs)
+{
+    HRT_Anchor_t anchor;
+    uint32_t seq;
+
+    do {
+        seq = HRTAnchorSeq;
+        anchor = HRTAnchor[(seq >> 1) & 1];
+        __DMB();
+    } while ((seq & 1) || (seq != HRTAnchorSeq));
+
+    int64_t delta = (int64_t) (Tick - anchor.Tick);
+    int64_t secs = delta / 1000000;
+    int64_t usecs = delta % 1000000;
+    /* Floor for times before the anchor */
+    if (usecs < 0) {
+        secs--;
+        usecs += 1000000;
+    }
+
+    if (Usecs != NULL)
+        *Usecs = (uint32_t) usecs;
+    return (uint32_t) (anchor.Secs + secs);
 }
 
-/* Delay (usecs) */
+/* Delay (usecs) - spins, sleeps before the scheduler, blocks in tasks */
 void HRT_Delay(uint32_t Delay)
 {
-    HRTime_t tickStart = HRT_GetTick();
-    
-    /* Min 5 usec and Max 1 min of delay */
+    /* Min 5 usec of delay */
     if(Delay < 5)
         Delay = 5;
-    if(Delay > (60 * 1000 * 1000))
-        Delay = (60 * 1000 * 1000);
     
-    while((HRT_GetTick() - tickStart) < Delay) {}
+    HRTime64_t tickEnd = HRT_GetTick64() + Delay;
+    
+    if((Delay >= HRT_SPIN_MAX) && (__get_IPSR() == 0)) {
+        BaseType_t state = xTaskGetSchedulerState();
+        if(state == taskSCHEDULER_NOT_STARTED)
+            HRT_DelaySleep(tickEnd);
+        else if(state == taskSCHEDULER_RUNNING)
+            HRT_DelayBlock(tickEnd);
+    }
+    
+    /* Short delays, ISR, scheduler suspended and any remainder */
+    while(HRT_GetTick64() < tickEnd) {}
 }
 
 /* Check timeout */
@@ -106,13 +289,13 @@ bool HRT_IsTimedOut(uint32_t tickStart, uint32_t Timeout)
 /* Pause timer */
 void HRT_Pause(void)
 {
-    PAL_NVIC_DisableIRQ(TIM2_IRQn);
+    TIM2->CR1 &= ~TIM_CR1_CEN;
 }
 
 /* Resume timer */
 void HRT_Resume(void)
 {
-    PAL_NVIC_EnableIRQ(TIM2_IRQn);
+    TIM2->CR1 |= TIM_CR1_CEN;
 }
 
 /******************************** End of File *********************************/
@@ -14,15 +14,22 @@
 
 /* Types */
 typedef uint32_t HRTime_t;
+typedef uint64_t HRTime64_t;
 
 /* Function Prototypes */
 /* Init */
 void HRT_Init(void);
-/* Increment */
-void HRT_IncTick(void);
 /* Get time */
 HRTime_t HRT_GetTick(void);
-/* Delay (usecs) */
+/* ISR - counter wrapped (once every ~71 mins) or a delay ended, CC1 is the timer wheel */
+void HRT_ISR(void);
+/* Get time - 64 bit */
+HRTime64_t HRT_GetTick64(void);
+/* Set wall clock anchor - RTC seconds (Sys_GetTime) now */
+void HRT_SetWallClock(uint32_t Secs);
+/* Convert 64 bit time to wall clock - RTC seconds, Usecs past the second if not NULL */
+uint32_t HRT_ToWallClock(HRTime64_t Tick, uint32_t *Usecs);
+/* Delay (usecs) - spins, sleeps before the scheduler, blocks in tasks */
 void HRT_Delay(uint32_t Delay);
 /* Check timeout */
 bool HRT_IsTimedOut(uint32_t tickStart, uint32_t Timeout);
@@ -8,6 +8,8 @@
 /* Includes */
 #include "PAL.h"
 #include "Error.h"
+#include "TWheel.h"
+#include "Prof.h"
 
 /* Macros */
 /* Board mapping */
@@ -96,6 +98,13 @@ static void PAL_ConfigClocks(void)
     	Error_Handler(ERROR_BOOTUP_CLOCK_INIT);
     }
 
+    /* Select HSI16 as I2C3 clock source */
+    /* Independent of the system clock, timing is calculated from it */
+    PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_I2C3;
+    PeriphClkInitStruct.I2c3ClockSelection  = RCC_I2C3CLKSOURCE_HSI;
+    if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK)
+        Error_Handler(ERROR_BOOTUP_CLOCK_INIT);
+
 	/* Select PCLK1 as USART2 clock source */
 	PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_USART2;
 	PeriphClkInitStruct.RTCClockSelection = RCC_USART2CLKSOURCE_PCLK1;
@@ -340,6 +349,16 @@ void PAL_ConfigGPIOStage2(void)
 	GPIO_InitStruct.Alternate   = GPIO_AF12_SDMMC1;
 	HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
 
+	/** Power **/
+
+	/* PD3 - CHRG_STATUS, both edges */
+	memset(&GPIO_InitStruct, 0, sizeof(GPIO_InitStruct));
+	GPIO_InitStruct.Pin     = GPIO_PIN_3;
+	GPIO_InitStruct.Mode    = GPIO_MODE_IT_RISING_FALLING;
+	GPIO_InitStruct.Pull    = GPIO_PULLUP;
+	GPIO_InitStruct.Speed   = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
+
 	/** Bootloader **/
 
 	/* PC3 - BOOT0 */
@@ -453,6 +472,10 @@ void PAL_InitStage1(void)
 
     /* Configure HR Timer */
     HRT_Init();
+    TWheel_Init();
+
+    /* Profiling cycle counter */
+    Prof_Init();
 }
 
 /* Init Platform - Stage2 */
@@ -8,6 +8,7 @@
 /* Includes */
 #include "Power.h"
 #include "dI2C.h"
+#include "TWheel.h"
 #include "Error.h"
 
 /* Macros */
@@ -26,12 +27,46 @@
 /* /EXT_PWR */
 #define PWR_nEXT_PWR_PORT   (GPIOE)
 #define PWR_nEXT_PWR_PIN    (GPIO_PIN_6)
+/* CHRG_STATUS - open drain, low while charging */
+#define PWR_CHRG_STATUS_PORT    (GPIOD)
+#define PWR_CHRG_STATUS_PIN     (GPIO_PIN_3)
+#define PWR_CHRG_STATUS_ON      (GPIO_PIN_RESET)
+#define PWR_CHRG_STATUS_IRQn    (EXTI3_IRQn)
+
+/* Power I2C - gauges and charger are Fast mode parts */
+#define PWR_I2C_SPEED       (dI2C_SPEED_FAST)
+#define PWR_I2C_RISE_TIME   (300)   // nsecs, spec max
+#define PWR_I2C_FALL_TIME   (100)   // nsecs
+
+/* Gauge - BQ27441 standard commands */
+#define PWR_BQ_ADDR         (0x55 << 1)
+#define PWR_BQ_TEMP         (0x02)  // 0.1 K
+#define PWR_BQ_VOLT         (0x04)  // mV
+#define PWR_BQ_SOC          (0x1C)  // %
+
+/* Status cache - one job on the timer wheel */
+#define PWR_CACHE_TICK      (250)   // msecs
+#define PWR_CACHE_STALE_N   (4)     // Reads missed
+#define PWR_CHRG_RESAMPLE   (40)    // Ticks, backs up the edges
+/* Syscall safe - same as the I2C and timer ISRs writing the cache */
+#define PWR_IRQ_PRIO        (5)
 
 /* Use lookup table for battery profile */
 #undef USE_BAT_PROF_TABLE
 
 /* Types */
 
+/* Cache entry - written from the ISRs at PWR_IRQ_PRIO only, read lock-free */
+typedef struct {
+    uint8_t RegAddr;
+    uint32_t Period;            // Job ticks, 0 - on edges
+    uint32_t Due;               // Job ticks to the next read
+    volatile uint32_t Value;
+    volatile uint32_t Time;     // Job tick of the last good read
+    volatile bool IsValid;
+    uint8_t Raw[2];
+} Pwr_CacheEnt_t;
+
 /* Externs */
 
 /* Function Declarations */
@@ -39,7 +74,22 @@
 /* Global Variables */
 I2C_HandleTypeDef hPwrI2C;
 
-
+/* Static Variables */
+static bool PwrBusReady = false;
+static volatile bool PwrCacheGauge = false;
+static bool PwrCacheRun = false;
+static Pwr_CacheEnt_t PwrCache[PWR_N_FLD] = {
+    {PWR_BQ_TEMP,   4},     // 1 sec
+    {PWR_BQ_VOLT,   2},     // 500 msecs
+    {PWR_BQ_SOC,    20},    // 5 secs
+    {0,             0},     // CHRG_STATUS edges
+};
+static volatile uint32_t PwrCacheTick = 0;
+static uint32_t PwrCachePending = 0;
+static dI2C_Req_t PwrCacheReq[PWR_N_FLD];
+static TWheel_Timer_t PwrCacheTmr;
+
+/* Private Functions */
 
 /* Get /EXT_PWR status */
 static bool IsExtPowerPresent(void)
@@ -50,8 +100,100 @@ static bool IsExtPowerPresent(void)
         return true;
 }
 
+/* Put field in the cache - from the cache ISRs */
+static void Power_CachePut(Pwr_Field_t Field, uint32_t Value)
+{
+    Pwr_CacheEnt_t *ent = &PwrCache[Field];
+
+    ent->Value = Value;
+    ent->Time = PwrCacheTick;
+    ent->IsValid = true;
+}
+
+/* Sample CHRG_STATUS */
+static void Power_CacheChrg(void)
+{
+    Power_CachePut(PWR_FLD_CHARGING,
+            ((PWR_CHRG_STATUS_ON == PAL_GetIO(PWR_CHRG_STATUS_PORT, PWR_CHRG_STATUS_PIN)) ? 1 : 0));
+}
+
+/* Gauge read done - from the I2C ISR */
+static void Power_CacheCB(StdReturn_t Result, void *Arg)
+{
+    Pwr_Field_t fld = (Pwr_Field_t)(uintptr_t)Arg;
+    Pwr_CacheEnt_t *ent = &PwrCache[fld];
+
+    /* Last good value stays, it turns stale */
+    if(Result == RET_OK)
+        Power_CachePut(fld, (uint32_t)(ent->Raw[0] | (ent->Raw[1] << 8)));
+    if(PwrCachePending > 0)
+        PwrCachePending--;
+}
+
+/* Cache job - from the timer ISR, the gauge reads due go as one batch */
+static void Power_CacheJob(void *Arg)
+{
+    uint32_t n = 0;
+
+    TWheel_Arm(&PwrCacheTmr, PWR_CACHE_TICK);
+    PwrCacheTick++;
+
+    if((PwrCacheTick % PWR_CHRG_RESAMPLE) == 0)
+        Power_CacheChrg();
+
+    if(!PwrCacheGauge)
+        return;
+
+    for(uint32_t i = 0; i < PWR_N_FLD; i++) {
+        Pwr_CacheEnt_t *ent = &PwrCache[i];
+
+        if(ent->Period == 0)
+            continue;
+        if(ent->Due > 0)
+            ent->Due--;
+        /* Last batch still on the bus - due reads wait a tick */
+        if((ent->Due > 0) || (PwrCachePending > 0))
+            continue;
+
+        ent->Due = ent->Period;
+        PwrCacheReq[n].Xfer.Op = dI2C_OP_RD;
+        PwrCacheReq[n].Xfer.DevAddr = PWR_BQ_ADDR;
+        PwrCacheReq[n].Xfer.RegAddr = ent->RegAddr;
+        PwrCacheReq[n].Xfer.Data = ent->Raw;
+        PwrCacheReq[n].Xfer.Size = sizeof(ent->Raw);
+        PwrCacheReq[n].Cb = Power_CacheCB;
+        PwrCacheReq[n].Arg = (void*)(uintptr_t)i;
+        n++;
+    }
+
+    /* Pending first - a batch may complete within the submit */
+    if(n > 0) {
+        PwrCachePending = n;
+        if(RET_OK != dI2C_Submit(&hPwrI2C, PwrCacheReq, n))
+            PwrCachePending = 0;
+    }
+}
+
 /* Public Functions */
 
+/* Start status cache - Gauge false keeps to CHRG_STATUS, a second call only updates Gauge */
+void Power_CacheStart(bool Gauge)
+{
+    PwrCacheGauge = Gauge;
+    if(PwrCacheRun)
+        return;
+    PwrCacheRun = true;
+    Power_CacheChrg();
+
+    /* CHRG_STATUS - both edges */
+    PAL_NVIC_SetPriority(PWR_CHRG_STATUS_IRQn, PWR_IRQ_PRIO);
+    PAL_NVIC_EnableIRQ(PWR_CHRG_STATUS_IRQn);
+
+    /* All fields are due on the first tick */
+    TWheel_InitCb(&PwrCacheTmr, Power_CacheJob, NULL);
+    TWheel_Arm(&PwrCacheTmr, PWR_CACHE_TICK);
+}
+
 /* Init - Stage1 */
 StdReturn_t Power_InitStage1(Pwr_Status_t *Status)
 {
@@ -74,9 +216,14 @@ StdReturn_t Power_InitStage1(Pwr_Status_t *Status)
     __HAL_RCC_I2C3_CLK_ENABLE();
 
     hPwrI2C.Instance             = I2C3;
-    /* Clock - 100KHz, Clock HIGH - 4us, Clock LOW - 5us,
-     * Data Hold Time - 500ns, Data Setup Time - 1250ns  */
-    hPwrI2C.Init.Timing          = 0x30420F13;//10KHz --> 0x3042C3C7;
+    /* Clock - from the HSI16 kernel clock */
+    stdRet = dI2C_CalcTiming(HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_I2C3), PWR_I2C_SPEED,
+            PWR_I2C_RISE_TIME, PWR_I2C_FALL_TIME, &hPwrI2C.Init.Timing);
+    if(stdRet != RET_OK)
+        return stdRet;
+#if (PWR_I2C_SPEED > dI2C_SPEED_FAST)
+    HAL_I2CEx_EnableFastModePlus(I2C_FASTMODEPLUS_I2C3);
+#endif
     hPwrI2C.Init.AddressingMode  = I2C_ADDRESSINGMODE_7BIT;
     hPwrI2C.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
     hPwrI2C.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
@@ -85,6 +232,7 @@ StdReturn_t Power_InitStage1(Pwr_Status_t *Status)
     stdRet = dI2C_Init(&hPwrI2C);
     if(stdRet != RET_OK)
         return stdRet;
+    PwrBusReady = true;
 
     /* Settle */
     HRT_Delay(100);
@@ -103,6 +251,12 @@ StdReturn_t Power_InitStage2(Pwr_Status_t *Status)
     HRT_Delay(100);
 
     HRT_Delay(100);
+
+    /* Gauge - on the bus from Stage1 */
+    if(PwrBusReady)
+        Status->BQ_Present = (RET_OK == dI2C_DeviceReady(&hPwrI2C, PWR_BQ_ADDR));
+    Power_CacheStart(Status->BQ_Present);
+
     return RET_OK;
 }
 
@@ -155,6 +309,35 @@ StdReturn_t Power_Up(void)
     return RET_OK;
 }
 
+/* Get cached field - lock-free, Value is the last good read, 0 if never read */
+Pwr_CacheStat_t Power_GetCached(Pwr_Field_t Field, uint32_t *Value)
+{
+    if((Field >= PWR_N_FLD) || (Value == NULL))
+        return PWR_CACHE_NONE;
+
+    Pwr_CacheEnt_t *ent = &PwrCache[Field];
+
+    /* Single words - no tearing */
+    *Value = ent->Value;
+    if(!ent->IsValid)
+        return PWR_CACHE_NONE;
+    if(ent->Period == 0)
+        return PWR_CACHE_FRESH;
+    if((PwrCacheTick - ent->Time) > (ent->Period * PWR_CACHE_STALE_N))
+        return PWR_CACHE_STALE;
+    return PWR_CACHE_FRESH;
+}
+
+/* ISR - CHRG_STATUS edge */
+void Power_ChrgStatusISR(void)
+{
+    if(__HAL_GPIO_EXTI_GET_IT(PWR_CHRG_STATUS_PIN) == RESET)
+        return;
+    __HAL_GPIO_EXTI_CLEAR_IT(PWR_CHRG_STATUS_PIN);
+
+    Power_CacheChrg();
+}
+
 
 
 
@@ -43,6 +43,22 @@ typedef struct {
     bool BQ_Present;
 } Pwr_Status_t;
 
+/* Cached battery fields - gauge fields in register order, adjacent reads merge */
+typedef enum {
+    PWR_FLD_TEMP = 0,       // 0.1 K
+    PWR_FLD_VOLTAGE,        // mV
+    PWR_FLD_LEVEL,          // %
+    PWR_FLD_CHARGING,       // CHRG_STATUS
+    PWR_N_FLD
+} Pwr_Field_t;
+
+/* Cached field state */
+typedef enum {
+    PWR_CACHE_NONE = 0,     // Never read
+    PWR_CACHE_STALE,        // Last good read, refreshes missed
+    PWR_CACHE_FRESH,
+} Pwr_CacheStat_t;
+
 /* Function Prototypes */
 /* Init - Stage1 */
 StdReturn_t Power_InitStage1(Pwr_Status_t *Status);
@@ -68,5 +84,11 @@ void Power_DisableOTGmode(void);
 StdReturn_t Power_BQGoldenDFI(Pwr_Status_t *Status);
 /* Update status */
 StdReturn_t Power_Status(Pwr_Status_t *Status);
+/* Start status cache - Gauge false keeps to CHRG_STATUS, a second call only updates Gauge */
+void Power_CacheStart(bool Gauge);
+/* Get cached field - lock-free, Value is the last good read, 0 if never read */
+Pwr_CacheStat_t Power_GetCached(Pwr_Field_t Field, uint32_t *Value);
+/* ISR - CHRG_STATUS edge */
+void Power_ChrgStatusISR(void);
 
 #endif /*** _POWER_H_ ***/
@@ -0,0 +1,84 @@
+/**
+ **  @file Prof.c
+ **  @brief Profiling probes - DWT cycle counter
+ **  @author JZJ
+ **
+ **/
+
+/* Includes */
+#include "Prof.h"
+
+/* Macros */
+
+/* Types */
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static Prof_Stat_t ProfStat[PROF_N_ENUM];
+
+/* Private Functions */
+
+/* Public Functions */
+
+/* Init - starts the cycle counter */
+void Prof_Init(void)
+{
+    Prof_Reset();
+
+    /* Trace enable, then the cycle counter */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/* Put cycles of a probe - safe from ISR */
+void Prof_Put(Prof_Probe_t Probe, uint32_t Cycles)
+{
+    if (Probe >= PROF_N_ENUM)
+        return;
+
+    Prof_Stat_t *stat = &ProfStat[Probe];
+
+    /* Probes run in tasks and ISRs */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if ((stat->Count == 0) || (Cycles < stat->Min))
+        stat->Min = Cycles;
+    if (Cycles > stat->Max)
+        stat->Max = Cycles;
+    stat->Sum += Cycles;
+    stat->Count++;
+
+    __set_PRIMASK(primask);
+}
+
+/* Get statistics of a probe */
+StdReturn_t Prof_Get(Prof_Probe_t Probe, Prof_Stat_t *Stat)
+{
+    if ((Probe >= PROF_N_ENUM) || (Stat == NULL))
+        return RET_ARGS_NOK;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *Stat = ProfStat[Probe];
+    __set_PRIMASK(primask);
+
+    return RET_OK;
+}
+
+/* Reset statistics */
+void Prof_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(ProfStat, 0, sizeof(ProfStat));
+    __set_PRIMASK(primask);
+}
+
+/******************************** End of File *********************************/
@@ -0,0 +1,69 @@
+/**
+ **  @file Prof.h
+ **  @brief Profiling probes - DWT cycle counter
+ **  @author JZJ
+ **
+ **/
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/* Includes */
+#include "PAL.h"
+
+/* Macros */
+
+/* Probes are compiled out of release builds */
+#ifndef NDEBUG
+#define PROF_ENABLE
+#endif
+
+#ifdef PROF_ENABLE
+/* Start probe - opens a scope local start count */
+#define PROF_START(Probe)   uint32_t ProfStart_##Probe = Prof_GetCycles()
+/* Stop probe - in the scope of its start */
+#define PROF_STOP(Probe)    Prof_Put((Probe), (Prof_GetCycles() - ProfStart_##Probe))
+#else
+#define PROF_START(Probe)
+#define PROF_STOP(Probe)
+#endif
+
+/* Types */
+
+/* Probes */
+typedef enum {
+    PROF_CMDUSB_PROCESS = 0,
+    PROF_CMDUSB_TX_READING,
+    PROF_CMDUSB_TX_ASCII,
+    PROF_USBI_RXCB,
+    PROF_DI2C_RDREG,
+    PROF_CRC8OS_CALC,
+    PROF_HRT_ISR,
+    PROF_N_ENUM
+} Prof_Probe_t;
+
+/* Probe statistics - cycles */
+typedef struct {
+    uint32_t Count;
+    uint32_t Min;
+    uint32_t Max;
+    uint64_t Sum;
+} Prof_Stat_t;
+
+/* Function Prototypes */
+/* Init - starts the cycle counter */
+void Prof_Init(void);
+/* Put cycles of a probe - safe from ISR */
+void Prof_Put(Prof_Probe_t Probe, uint32_t Cycles);
+/* Get statistics of a probe */
+StdReturn_t Prof_Get(Prof_Probe_t Probe, Prof_Stat_t *Stat);
+/* Reset statistics */
+void Prof_Reset(void);
+
+/* Get cycles */
+static inline uint32_t Prof_GetCycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+#endif /*** _PROF_H_ ***/
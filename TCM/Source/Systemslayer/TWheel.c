@@ -0,0 +1,253 @@
+/**
+ **  @file TWheel.c
+ **  @brief Timer wheel - deadlines on the HRT CC1 compare
+ **  @author JZJ
+ **
+ **  Hierarchical, 4 levels of 64 slots at 1 msec. Timers cascade to the level
+ **  below as their slot comes up. CC1 is set to the next slot holding timers
+ **  only, there is no periodic tick.
+ **
+ **/
+
+/* Includes */
+#include "TWheel.h"
+
+/* Macros */
+
+#define TWHEEL_N_LVL        (4)
+#define TWHEEL_LVL_BITS     (6)
+#define TWHEEL_N_SLOT       (1 << TWHEEL_LVL_BITS)
+#define TWHEEL_SLOT_MASK    (TWHEEL_N_SLOT - 1)
+
+/* Types */
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+static TWheel_Timer_t *TWheelSlot[TWHEEL_N_LVL][TWHEEL_N_SLOT];
+/* Slots holding timers */
+static uint64_t TWheelOcc[TWHEEL_N_LVL];
+/* Last tick run */
+static uint32_t TWheelNow = 0;
+
+/* Private Functions */
+
+/* Wheel ticks now */
+static inline uint32_t TWheel_Now(void)
+{
+    return (uint32_t) (HRT_GetTick64() / TWHEEL_TICK);
+}
+
+/* Link timer in the slot of its expiry */
+static void TWheel_Link(TWheel_Timer_t *Tmr)
+{
+    uint32_t delta = Tmr->Expiry - TWheelNow;
+    uint32_t lvl = 0;
+
+    while ((lvl < (TWHEEL_N_LVL - 1)) && (delta >= (1UL << (TWHEEL_LVL_BITS * (lvl + 1)))))
+        lvl++;
+
+    uint32_t slot = (Tmr->Expiry >> (TWHEEL_LVL_BITS * lvl)) & TWHEEL_SLOT_MASK;
+    Tmr->Lvl = (uint8_t) lvl;
+    Tmr->Slot = (uint8_t) slot;
+    Tmr->Prev = NULL;
+    Tmr->Next = TWheelSlot[lvl][slot];
+    if (Tmr->Next != NULL)
+        Tmr->Next->Prev = Tmr;
+    TWheelSlot[lvl][slot] = Tmr;
+    TWheelOcc[lvl] |= (1ULL << slot);
+}
+
+/* Unlink timer from its slot */
+static void TWheel_Unlink(TWheel_Timer_t *Tmr)
+{
+    if (Tmr->Prev != NULL)
+        Tmr->Prev->Next = Tmr->Next;
+    else
+        TWheelSlot[Tmr->Lvl][Tmr->Slot] = Tmr->Next;
+    if (Tmr->Next != NULL)
+        Tmr->Next->Prev = Tmr->Prev;
+
+    if (TWheelSlot[Tmr->Lvl][Tmr->Slot] == NULL)
+        TWheelOcc[Tmr->Lvl] &= ~(1ULL << Tmr->Slot);
+}
+
+/* Slots from From to the first holding timers */
+static inline uint32_t TWheel_Dist(uint64_t Occ, uint32_t From)
+{
+    uint64_t rot = (From == 0) ? Occ : ((Occ >> From) | (Occ << (TWHEEL_N_SLOT - From)));
+    return (uint32_t) __builtin_ctzll(rot);
+}
+
+/* Next tick with work - an expiry or a cascade */
+static bool TWheel_Next(uint32_t *Tick)
+{
+    bool found = false;
+
+    for (uint32_t lvl = 0; lvl < TWHEEL_N_LVL; lvl++) {
+        if (TWheelOcc[lvl] == 0)
+            continue;
+
+        uint32_t shift = TWHEEL_LVL_BITS * lvl;
+        uint32_t base = (TWheelNow >> shift) + 1;
+        uint32_t tick = (base + TWheel_Dist(TWheelOcc[lvl], (base & TWHEEL_SLOT_MASK))) << shift;
+        if (!found || ((int32_t) (tick - TWheelNow) < (int32_t) (*Tick - TWheelNow)))
+            *Tick = tick;
+        found = true;
+    }
+    return found;
+}
+
+/* Set CC1 to the next tick with work */
+static void TWheel_Program(void)
+{
+    uint32_t next;
+
+    if (!TWheel_Next(&next)) {
+        TIM2->DIER &= ~TIM_DIER_CC1IE;
+        return;
+    }
+
+    TIM2->CCR1 = next * TWHEEL_TICK;
+    TIM2->DIER |= TIM_DIER_CC1IE;
+
+    /* Passed while setting - the match would be a wrap away */
+    if ((int32_t) (TWheel_Now() - next) >= 0)
+        TIM2->EGR = TIM_EGR_CC1G;
+}
+
+/* Public Functions */
+
+/* Init */
+void TWheel_Init(void)
+{
+    memset(TWheelSlot, 0, sizeof(TWheelSlot));
+    memset(TWheelOcc, 0, sizeof(TWheelOcc));
+    TWheelNow = TWheel_Now();
+
+    /* CC1 frozen output compare - flag only */
+    TIM2->CCMR1 &= ~(TIM_CCMR1_CC1S | TIM_CCMR1_OC1M);
+    TIM2->DIER &= ~TIM_DIER_CC1IE;
+    TIM2->SR = ~TIM_SR_CC1IF;
+}
+
+/* ISR - CC1 match */
+void TWheel_ISR(void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    TWheel_Timer_t *tmr;
+    uint32_t next;
+
+    if (!(TIM2->SR & TIM2->DIER & TIM_SR_CC1IF))
+        return;
+    TIM2->SR = ~TIM_SR_CC1IF;
+
+    uint32_t now = TWheel_Now();
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    while (TWheel_Next(&next) && ((int32_t) (now - next) >= 0)) {
+        TWheelNow = next;
+
+        /* Higher levels first - their timers land below */
+        for (uint32_t lvl = (TWHEEL_N_LVL - 1); lvl > 0; lvl--) {
+            uint32_t shift = TWHEEL_LVL_BITS * lvl;
+            if (next & ((1UL << shift) - 1))
+                continue;
+            uint32_t slot = (next >> shift) & TWHEEL_SLOT_MASK;
+            while ((tmr = TWheelSlot[lvl][slot]) != NULL) {
+                TWheel_Unlink(tmr);
+                TWheel_Link(tmr);
+            }
+        }
+
+        /* Expired - callbacks may arm again, never into this slot */
+        uint32_t slot = next & TWHEEL_SLOT_MASK;
+        while ((tmr = TWheelSlot[0][slot]) != NULL) {
+            TWheel_Unlink(tmr);
+            tmr->Active = false;
+
+            taskEXIT_CRITICAL_FROM_ISR(mask);
+            if (tmr->Cb != NULL)
+                tmr->Cb(tmr->Arg);
+            else if (tmr->Task != NULL)
+                xTaskNotifyFromISR(tmr->Task, tmr->Bits, eSetBits, &xHigherPriorityTaskWoken);
+            mask = taskENTER_CRITICAL_FROM_ISR();
+        }
+    }
+
+    /* Nothing due up to now */
+    if ((int32_t) (now - TWheelNow) > 0)
+        TWheelNow = now;
+    TWheel_Program();
+
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* Init timer - callback on expiry */
+void TWheel_InitCb(TWheel_Timer_t *Tmr, TWheel_Cb_t Cb, void *Arg)
+{
+    memset(Tmr, 0, sizeof(TWheel_Timer_t));
+    Tmr->Cb = Cb;
+    Tmr->Arg = Arg;
+}
+
+/* Init timer - task notified with Bits on expiry */
+void TWheel_InitNotify(TWheel_Timer_t *Tmr, TaskHandle_t Task, uint32_t Bits)
+{
+    memset(Tmr, 0, sizeof(TWheel_Timer_t));
+    Tmr->Task = Task;
+    Tmr->Bits = Bits;
+}
+
+/* Arm timer (msecs) - rearms if active, safe from ISR */
+void TWheel_Arm(TWheel_Timer_t *Tmr, uint32_t Timeout)
+{
+    if (Timeout > TWHEEL_MAX_TIME)
+        Timeout = TWHEEL_MAX_TIME;
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    if (Tmr->Active)
+        TWheel_Unlink(Tmr);
+
+    /* Catch up while nothing is due - keeps short timeouts on the lowest level */
+    uint32_t now = TWheel_Now();
+    uint32_t next;
+    if (!TWheel_Next(&next) || ((int32_t) (next - now) > 0))
+        TWheelNow = now;
+
+    /* Next tick on, never early */
+    Tmr->Expiry = now + Timeout + 1;
+    TWheel_Link(Tmr);
+    Tmr->Active = true;
+    TWheel_Program();
+
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/* Cancel timer - safe from ISR */
+void TWheel_Cancel(TWheel_Timer_t *Tmr)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    if (Tmr->Active) {
+        TWheel_Unlink(Tmr);
+        Tmr->Active = false;
+        TWheel_Program();
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/* Is timer armed */
+bool TWheel_IsActive(TWheel_Timer_t *Tmr)
+{
+    return Tmr->Active;
+}
+
+/******************************** End of File *********************************/
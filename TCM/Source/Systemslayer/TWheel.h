@@ -0,0 +1,57 @@
+/**
+ **  @file TWheel.h
+ **  @brief Timer wheel - deadlines on the HRT CC1 compare
+ **  @author JZJ
+ **
+ **/
+
+#ifndef _TWHEEL_H_
+#define _TWHEEL_H_
+
+/* Includes */
+#include "PAL.h"
+#include "RTOS.h"
+
+/* Macros */
+
+/* Wheel tick */
+#define TWHEEL_TICK         (1000)              // 1 msec in usecs
+/* Longest timeout - 4 levels of 64 slots */
+#define TWHEEL_MAX_TIME     ((1UL << 24) - 1)   // msecs, ~4.6 hrs
+
+/* Types */
+
+/* Expiry callback - from the timer ISR */
+typedef void (*TWheel_Cb_t)(void *Arg);
+
+/* Timer - owned by the caller, linked in the wheel while active */
+typedef struct TWheel_Timer {
+    struct TWheel_Timer *Next;
+    struct TWheel_Timer *Prev;
+    uint32_t Expiry;        // Wheel ticks
+    uint8_t Lvl;
+    uint8_t Slot;
+    volatile bool Active;
+    TWheel_Cb_t Cb;
+    void *Arg;
+    TaskHandle_t Task;      // Notified, if no callback
+    uint32_t Bits;
+} TWheel_Timer_t;
+
+/* Function Prototypes */
+/* Init */
+void TWheel_Init(void);
+/* ISR - CC1 match */
+void TWheel_ISR(void);
+/* Init timer - callback on expiry */
+void TWheel_InitCb(TWheel_Timer_t *Tmr, TWheel_Cb_t Cb, void *Arg);
+/* Init timer - task notified with Bits on expiry */
+void TWheel_InitNotify(TWheel_Timer_t *Tmr, TaskHandle_t Task, uint32_t Bits);
+/* Arm timer (msecs) - rearms if active, safe from ISR */
+void TWheel_Arm(TWheel_Timer_t *Tmr, uint32_t Timeout);
+/* Cancel timer - safe from ISR */
+void TWheel_Cancel(TWheel_Timer_t *Tmr);
+/* Is timer armed */
+bool TWheel_IsActive(TWheel_Timer_t *Tmr);
+
+#endif /*** _TWHEEL_H_ ***/
@@ -13,12 +13,16 @@
 #include "USBi.h"
 #include "USBDev.h"
 #include "System.h"
+#include "COM.h"
+#include "Prof.h"
 
 //RV:#include "usbh_def.h"
 //RV:#include "usbh_core.h"
 
 /* Macros */
 
+/* Rx ring length - bytes */
+#define USBi_RXRING_LEN (512)
 
 /* Board mappings */
 /* ID */
@@ -47,6 +51,10 @@ extern PCD_HandleTypeDef hpcd;
 /* Static Variables */
 /* Mode */
 static uint8_t USBi_Mode = USBi_MODE_UNKNOWN;
+/* Rx ring - written from ISR, read by COM */
+static uint8_t USBi_RxRing[USBi_RXRING_LEN];
+static volatile uint32_t USBi_RxHead = 0;
+static volatile uint32_t USBi_RxTail = 0;
 
 /* Private Functions */
 
@@ -61,16 +69,22 @@ static void USBi_TxCmplt(void)
 /* RX callback */
 static void USBi_RxCB(uint8_t *Data, uint32_t Size)
 {
-    uint32_t bufLen = Size;
-    uint8_t *pData = Data;
-
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    for(uint32_t i = 0; i < bufLen; i++) {
-        if(pdFALSE == xQueueIsQueueFullFromISR(CmdUSBQ))
-            xQueueSendFromISR(CmdUSBQ, (void*)pData, &xHigherPriorityTaskWoken);
-        pData++;
+    PROF_START(PROF_USBI_RXCB);
+    uint32_t head = USBi_RxHead;
+    uint32_t next;
+
+    for(uint32_t i = 0; i < Size; i++) {
+        next = (head + 1) % USBi_RXRING_LEN;
+        /* Ring full - drop the rest */
+        if(next == USBi_RxTail)
+            break;
+        USBi_RxRing[head] = Data[i];
+        head = next;
     }
-    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    USBi_RxHead = head;
+
+    COM_RxNotifyFromISR(COM_PORT_USB);
+    PROF_STOP(PROF_USBI_RXCB);
 }
 
 /* Get DFP attach status */
@@ -204,6 +218,24 @@ StdReturn_t USBi_Tx(uint8_t *Data, uint32_t Size)
     return USBDev_Transmit(Data, Size);
 }
 
+/* Rx span - contiguous received bytes */
+uint32_t USBi_RxSpan(uint8_t **Data)
+{
+    uint32_t head = USBi_RxHead;
+    uint32_t tail = USBi_RxTail;
+
+    *Data = &USBi_RxRing[tail];
+    if(head >= tail)
+        return (head - tail);
+    return (USBi_RXRING_LEN - tail);
+}
+
+/* Rx consume */
+void USBi_RxConsume(uint32_t Len)
+{
+    USBi_RxTail = (USBi_RxTail + Len) % USBi_RXRING_LEN;
+}
+
 
 /* Get status */
 StdReturn_t USBi_GetStatus(USBi_Status_t *Status)
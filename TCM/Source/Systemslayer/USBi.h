@@ -43,6 +43,10 @@ StdReturn_t USBi_Disable(void);
 bool USBi_IsTxReady(void);
 /* TX */
 StdReturn_t USBi_Tx(uint8_t *Data, uint32_t Size);
+/* Rx span - contiguous received bytes */
+uint32_t USBi_RxSpan(uint8_t **Data);
+/* Rx consume */
+void USBi_RxConsume(uint32_t Len);
 /* Get status */
 StdReturn_t USBi_GetStatus(USBi_Status_t *Status);
 /* Get Mode */
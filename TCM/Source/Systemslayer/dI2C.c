@@ -8,13 +8,103 @@
 
 /* Includes */
 #include "dI2C.h"
+#include "Prof.h"
+#include "TWheel.h"
+#include "Tasks.h"
+
+#include "Error.h"
 
 /* Macros */
-#define dI2C_MAX_WAIT_TIME  (1000 * 1000) // 100 msec
+#define dI2C_MAX_WAIT_TIME  (100 * 1000) // 100 msecs, polled transfers
 #define TIMING_CLEAR_MASK   (0xF0FFFFFFU)  /* I2C TIMING clear register Mask */
 
+/* Syscall safe - the ISRs wake the caller */
+#define dI2C_IRQ_PRIO       (5)
+
+/* Interrupt driven transfer */
+#define dI2C_XFER_TIMEOUT   (50)    // 50 msecs, includes clock stretching
+#define dI2C_LOCK_TIME      (200)   // 200 msecs, bus held by other tasks
+
+/* Merged reads */
+#define dI2C_BURST_MAX      (64)
+
+/* Bus recovery - SCL half period (usecs), clocks to free SDA */
+#define dI2C_RCV_HALF_TIME  (5)
+#define dI2C_RCV_PULSES     (9)
+
+/* Timing - analog filter delay (nsecs), TIMINGR field limits */
+#define dI2C_AF_DELAY_MIN   (50)
+#define dI2C_AF_DELAY_MAX   (260)
+#define dI2C_PRESC_MAX      (16)
+#define dI2C_DEL_MAX        (16)
+#define dI2C_SCL_MAX        (256)
+
+/* Transfer interrupts */
+#define dI2C_IT_ALL         (I2C_CR1_TXIE | I2C_CR1_RXIE | I2C_CR1_TCIE | I2C_CR1_STOPIE | I2C_CR1_NACKIE | I2C_CR1_ERRIE)
+/* Bus errors */
+#define dI2C_ERR_ALL        (I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_OVR)
+
 /* Types */
 
+/* Transfer phase */
+typedef enum {
+    dI2C_PH_IDLE = 0,
+    dI2C_PH_REG,            // Register address
+    dI2C_PH_WR,
+    dI2C_PH_RD,
+    dI2C_PH_PROBE,          // Address only
+} dI2C_Phase_t;
+
+/* Bus mode limits (nsecs) - I2C spec, UM10204 */
+typedef struct {
+    uint32_t Speed;         // Hz
+    uint32_t RiseMax;
+    uint32_t FallMax;
+    uint32_t HdDatMin;      // Data hold
+    uint32_t VdDatMax;      // Data valid
+    uint32_t SuDatMin;      // Data setup
+    uint32_t LowMin;
+    uint32_t HighMin;
+} dI2C_Spec_t;
+
+/* Buses with interrupts routed to the driver */
+typedef struct {
+    I2C_TypeDef *Instance;
+    IRQn_Type EvIRQn;
+    IRQn_Type ErIRQn;
+    /* Pins - bus recovery */
+    GPIO_TypeDef *Port;
+    uint16_t SclPin;
+    uint16_t SdaPin;
+    uint8_t Alternate;
+} dI2C_Map_t;
+
+/* Bus context */
+typedef struct {
+    I2C_HandleTypeDef *hI2C;
+    const dI2C_Map_t *Map;
+    bool IsInit;
+    volatile bool IsRecoverDue;     // Queue holds till the recovery task frees the bus
+    volatile dI2C_Phase_t Phase;
+    /* Queue */
+    dI2C_Req_t *Head;
+    dI2C_Req_t *Tail;
+    /* Running batch */
+    dI2C_Req_t *Cur;
+    dI2C_Xfer_t Xfer;
+    uint32_t Count;
+    StdReturn_t Result;
+    uint8_t Burst[dI2C_BURST_MAX];
+    HRTime_t StartTick;
+    TWheel_Timer_t Tmr;
+    dI2C_Stat_t Stat;
+    /* Blocking callers */
+    SemaphoreHandle_t Lock;
+    StaticSemaphore_t LockBuf;
+    SemaphoreHandle_t Done;
+    StaticSemaphore_t DoneBuf;
+    volatile uint32_t SyncPending;
+} dI2C_Ctx_t;
 
 /* Externs */
 
@@ -23,7 +113,18 @@
 /* Global Variables */
 
 /* Static Variables */
-
+/* Bus recovery - task context, never with interrupts masked */
+static TaskHandle_t xI2CTaskHandle = NULL;
+static const dI2C_Map_t dI2C_Map[dI2C_N_BUS] = {
+    // Power - gauges and charger, PC0 - SCL, PC1 - SDA
+    {I2C3, I2C3_EV_IRQn, I2C3_ER_IRQn, GPIOC, GPIO_PIN_0, GPIO_PIN_1, GPIO_AF4_I2C3},
+};
+static dI2C_Ctx_t dI2C_Ctx[dI2C_N_BUS];
+static const dI2C_Spec_t dI2C_Spec[] = {
+    {dI2C_SPEED_STD,        1000,   300,    0,  3450,   250,    4700,   4000},
+    {dI2C_SPEED_FAST,       300,    300,    0,  900,    100,    1300,   600},
+    {dI2C_SPEED_FASTPLUS,   120,    120,    0,  450,    50,     500,    260},
+};
 
 /* Private Functions */
 
@@ -209,64 +310,8 @@ static StdReturn_t dI2C_WaitForReady(I2C_HandleTypeDef *hI2C)
     return dI2C_WaitOnFlag(hI2C, I2C_FLAG_BUSY, SET);
 }
 
-/* Public Functions */
-/* Init */
-StdReturn_t dI2C_Init(I2C_HandleTypeDef *hI2C)
-{
-    if(hI2C == NULL)
-        return RET_ARGS_NOK;
-
-    __HAL_I2C_DISABLE(hI2C);
-
-    /* TIMINGR */
-    hI2C->Instance->TIMINGR = hI2C->Init.Timing & TIMING_CLEAR_MASK;
-
-    /* CR2 */
-    hI2C->Instance->CR2 |= (I2C_CR2_AUTOEND | I2C_CR2_NACK);
-
-    /* CR1 */
-    hI2C->Instance->CR1 = (hI2C->Init.GeneralCallMode | hI2C->Init.NoStretchMode);
-
-    __HAL_I2C_ENABLE(hI2C);
-
-    return RET_OK;
-}
-
-/* DeInit */
-StdReturn_t dI2C_DeInit(I2C_HandleTypeDef *hI2C)
-{
-    if(hI2C == NULL)
-        return RET_ARGS_NOK;
-
-    __HAL_I2C_DISABLE(hI2C);
-
-     return RET_OK;
-}
-
-/* Enable */
-StdReturn_t dI2C_Enable(I2C_HandleTypeDef *hI2C)
-{
-    if(hI2C == NULL)
-        return RET_ARGS_NOK;
-
-    __HAL_I2C_ENABLE(hI2C);
-
-    return RET_OK;
-}
-
-/* Disable */
-StdReturn_t dI2C_Disable(I2C_HandleTypeDef *hI2C)
-{
-    if(hI2C == NULL)
-        return RET_ARGS_NOK;
-
-    __HAL_I2C_DISABLE(hI2C);
-
-    return RET_OK;
-}
-
-/* Write register */
-StdReturn_t dI2C_WrReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size)
+/* Write register - polled */
+static StdReturn_t dI2C_WrRegPoll(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size)
 {
     StdReturn_t stdRet;
 
@@ -324,8 +369,8 @@ StdReturn_t dI2C_WrReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr
     return RET_OK;
 }
 
-/* Read register */
-StdReturn_t dI2C_RdReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size)
+/* Read register - polled */
+static StdReturn_t dI2C_RdRegPoll(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size)
 {
     StdReturn_t stdRet;
 
@@ -381,8 +426,8 @@ StdReturn_t dI2C_RdReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr
     return RET_OK;
 }
 
-/* Device ready */
-StdReturn_t dI2C_DeviceReady(I2C_HandleTypeDef *hI2C, uint8_t DevAddr)
+/* Device ready - polled */
+static StdReturn_t dI2C_DeviceReadyPoll(I2C_HandleTypeDef *hI2C, uint8_t DevAddr)
 {
     StdReturn_t stdRet;
     uint32_t tickStart;
@@ -463,4 +508,809 @@ StdReturn_t dI2C_DeviceReady(I2C_HandleTypeDef *hI2C, uint8_t DevAddr)
 }
 
 
+/* Bus context - NULL when the bus has no interrupts routed */
+static dI2C_Ctx_t *dI2C_GetCtx(I2C_TypeDef *Instance)
+{
+    for(uint32_t i = 0; i < dI2C_N_BUS; i++) {
+        if(dI2C_Map[i].Instance == Instance)
+            return &dI2C_Ctx[i];
+    }
+    return NULL;
+}
+
+/* Check transfer */
+static StdReturn_t dI2C_ChkXfer(const dI2C_Xfer_t *Xfer)
+{
+    if(Xfer->Size > 255)
+        return RET_ARGS_NOK;
+    if((Xfer->Op != dI2C_OP_PROBE) && (Xfer->Data == NULL) && (Xfer->Size > 0))
+        return RET_ARGS_NOK;
+    return RET_OK;
+}
+
+/* Account transfer - in a critical section */
+static void dI2C_Account(dI2C_Ctx_t *Ctx, StdReturn_t Result)
+{
+    dI2C_Stat_t *stat = &Ctx->Stat;
+
+    stat->Xfers++;
+    if(Result == RET_NOK)
+        stat->Nacks++;
+    else if(Result == RET_TIMEDOUT)
+        stat->Timeouts++;
+    else if(Result == RET_HW_NOK)
+        stat->BusErrs++;
+}
+
+/* Account latency (usecs) of a transfer on the bus - in a critical section */
+static void dI2C_AccountLat(dI2C_Ctx_t *Ctx, uint32_t Latency)
+{
+    dI2C_Stat_t *stat = &Ctx->Stat;
+
+    if((stat->LatCount == 0) || (Latency < stat->LatMin))
+        stat->LatMin = Latency;
+    if(Latency > stat->LatMax)
+        stat->LatMax = Latency;
+    stat->LatSum += Latency;
+    stat->LatCount++;
+}
+
+/* Bus recovery - clocks out a device holding SDA, STOP, then init again. About 100 usecs,
+ * task context or before the scheduler only */
+static StdReturn_t dI2C_Recover(dI2C_Ctx_t *Ctx)
+{
+    const dI2C_Map_t *map = Ctx->Map;
+    GPIO_InitTypeDef GPIO_InitStruct;
+
+    Ctx->Stat.Recoveries++;
+    __HAL_I2C_DISABLE(Ctx->hI2C);
+
+    /* Pins as open drain outputs, released */
+    PAL_SetIO(map->Port, (map->SclPin | map->SdaPin));
+    memset(&GPIO_InitStruct, 0, sizeof(GPIO_InitStruct));
+    GPIO_InitStruct.Pin         = map->SclPin | map->SdaPin;
+    GPIO_InitStruct.Mode        = GPIO_MODE_OUTPUT_OD;
+    GPIO_InitStruct.Pull        = GPIO_PULLUP;
+    GPIO_InitStruct.Speed       = GPIO_SPEED_FREQ_VERY_HIGH;
+    HAL_GPIO_Init(map->Port, &GPIO_InitStruct);
+    HRT_Delay(dI2C_RCV_HALF_TIME);
+
+    /* Up to 9 clocks, till the device lets SDA go */
+    for(uint32_t i = 0; (i < dI2C_RCV_PULSES) && (GPIO_PIN_RESET == PAL_GetIO(map->Port, map->SdaPin)); i++) {
+        PAL_ResetIO(map->Port, map->SclPin);
+        HRT_Delay(dI2C_RCV_HALF_TIME);
+        PAL_SetIO(map->Port, map->SclPin);
+        HRT_Delay(dI2C_RCV_HALF_TIME);
+    }
+
+    /* STOP - SDA rises while SCL is high */
+    PAL_ResetIO(map->Port, map->SclPin);
+    HRT_Delay(dI2C_RCV_HALF_TIME);
+    PAL_ResetIO(map->Port, map->SdaPin);
+    HRT_Delay(dI2C_RCV_HALF_TIME);
+    PAL_SetIO(map->Port, map->SclPin);
+    HRT_Delay(dI2C_RCV_HALF_TIME);
+    PAL_SetIO(map->Port, map->SdaPin);
+    HRT_Delay(dI2C_RCV_HALF_TIME);
+
+    bool isFree = ((GPIO_PIN_SET == PAL_GetIO(map->Port, map->SclPin)) &&
+            (GPIO_PIN_SET == PAL_GetIO(map->Port, map->SdaPin)));
+
+    /* Pins back to the peripheral */
+    GPIO_InitStruct.Mode        = GPIO_MODE_AF_OD;
+    GPIO_InitStruct.Alternate   = map->Alternate;
+    HAL_GPIO_Init(map->Port, &GPIO_InitStruct);
+    dI2C_Init(Ctx->hI2C);
+
+    return (isFree ? RET_OK : RET_HW_NOK);
+}
+
+/* Start transfer of the batch - in a critical section */
+static StdReturn_t dI2C_Start(dI2C_Ctx_t *Ctx)
+{
+    I2C_HandleTypeDef *hI2C = Ctx->hI2C;
+    const dI2C_Xfer_t *xfer = &Ctx->Xfer;
+    uint8_t tmpData;
+
+    /* Bus held - after a timeout, or a device holding SDA. Recovered by the task */
+    if(Ctx->IsRecoverDue || (__HAL_I2C_GET_FLAG(hI2C, I2C_FLAG_BUSY) == SET)) {
+        Ctx->IsRecoverDue = true;
+        return RET_HW_NOK;
+    }
+
+    /* Readout */
+    while(__HAL_I2C_GET_FLAG(hI2C, I2C_FLAG_RXNE) == SET)
+        tmpData = (uint8_t)hI2C->Instance->RXDR;
+    (void)tmpData;
+    hI2C->Instance->ICR = (I2C_ICR_STOPCF | I2C_ICR_NACKCF | I2C_ICR_BERRCF | I2C_ICR_ARLOCF | I2C_ICR_OVRCF);
+
+    Ctx->Count = 0;
+    Ctx->Result = RET_OK;
+    Ctx->StartTick = HRT_GetTick();
+    TWheel_Arm(&Ctx->Tmr, dI2C_XFER_TIMEOUT);
+
+    hI2C->Instance->CR1 |= dI2C_IT_ALL;
+    if(xfer->Op == dI2C_OP_PROBE) {
+        Ctx->Phase = dI2C_PH_PROBE;
+        dI2C_TransferConfig(hI2C, xfer->DevAddr, 0, I2C_AUTOEND_MODE, I2C_GENERATE_START_WRITE);
+    } else {
+        /* Register first - restart for a read, reload for a write */
+        Ctx->Phase = dI2C_PH_REG;
+        dI2C_TransferConfig(hI2C, xfer->DevAddr, 1,
+                ((xfer->Op == dI2C_OP_RD) ? I2C_SOFTEND_MODE : I2C_RELOAD_MODE), I2C_GENERATE_START_WRITE);
+    }
+
+    return RET_OK;
+}
+
+/* Take the next batch off the queue - contiguous reads of a device merge into one burst */
+static void dI2C_Batch(dI2C_Ctx_t *Ctx)
+{
+    dI2C_Req_t *req = Ctx->Head;
+    dI2C_Req_t *last = req;
+    uint32_t size = req->Xfer.Size;
+
+    while((req->Xfer.Op == dI2C_OP_RD) && (last->Next != NULL)) {
+        const dI2C_Xfer_t *next = &last->Next->Xfer;
+
+        if((next->Op != dI2C_OP_RD) || (next->DevAddr != req->Xfer.DevAddr) ||
+                (next->RegAddr != (req->Xfer.RegAddr + size)) || ((size + next->Size) > dI2C_BURST_MAX))
+            break;
+        size += next->Size;
+        last = last->Next;
+    }
+
+    Ctx->Head = last->Next;
+    if(Ctx->Head == NULL)
+        Ctx->Tail = NULL;
+    last->Next = NULL;
+
+    Ctx->Cur = req;
+    Ctx->Xfer = req->Xfer;
+    if(last != req) {
+        Ctx->Xfer.Data = Ctx->Burst;
+        Ctx->Xfer.Size = size;
+    }
+}
+
+/* Complete the batch - scatter a burst, then callbacks */
+static void dI2C_Complete(dI2C_Ctx_t *Ctx, StdReturn_t Result)
+{
+    dI2C_Req_t *req = Ctx->Cur;
+    bool isBurst = (Ctx->Xfer.Data == Ctx->Burst);
+    uint32_t offset = 0;
+
+    Ctx->Cur = NULL;
+    while(req != NULL) {
+        /* Callback may queue the request again */
+        dI2C_Req_t *next = req->Next;
+
+        if(isBurst && (Result == RET_OK))
+            memcpy(req->Xfer.Data, &Ctx->Burst[offset], req->Xfer.Size);
+        offset += req->Xfer.Size;
+
+        req->Next = NULL;
+        req->Result = Result;
+        if(req->Cb != NULL)
+            req->Cb(Result, req->Arg);
+        req = next;
+    }
+}
+
+/* Run the queue - in a critical section. A held bus fails the batch, the rest wait for recovery */
+static void dI2C_Kick(dI2C_Ctx_t *Ctx)
+{
+    while(!Ctx->IsRecoverDue && (Ctx->Phase == dI2C_PH_IDLE) && (Ctx->Cur == NULL) && (Ctx->Head != NULL)) {
+        dI2C_Batch(Ctx);
+        if(dI2C_Start(Ctx) != RET_OK) {
+            dI2C_Account(Ctx, RET_HW_NOK);
+            dI2C_Complete(Ctx, RET_HW_NOK);
+        }
+    }
+
+    /* Task runs at the next switch - no yield from inside the critical section */
+    if(Ctx->IsRecoverDue && (xI2CTaskHandle != NULL))
+        vTaskNotifyGiveFromISR(xI2CTaskHandle, NULL);
+}
+
+/* Recover bus, then run the queue again - task context */
+static void dI2C_RecoverKick(dI2C_Ctx_t *Ctx)
+{
+    /* Running transfer ends first - its timer or ISR kicks again */
+    if((Ctx->Phase != dI2C_PH_IDLE) || (Ctx->Cur != NULL))
+        return;
+
+    StdReturn_t stdRet = dI2C_Recover(Ctx);
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    if(stdRet == RET_OK) {
+        Ctx->IsRecoverDue = false;
+    } else {
+        /* Still held - fail what waits, the next request tries again */
+        while(Ctx->Head != NULL) {
+            dI2C_Batch(Ctx);
+            dI2C_Account(Ctx, RET_HW_NOK);
+            dI2C_Complete(Ctx, RET_HW_NOK);
+        }
+    }
+    dI2C_Kick(Ctx);
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/* I2C Process - bus recovery off the ISRs and critical sections */
+static void dI2C_Task(void *Args)
+{
+    while(1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for(uint32_t i = 0; i < dI2C_N_BUS; i++) {
+            if(dI2C_Ctx[i].IsInit && dI2C_Ctx[i].IsRecoverDue)
+                dI2C_RecoverKick(&dI2C_Ctx[i]);
+        }
+    }
+}
+
+/* End transfer, then the next - safe from ISR */
+static void dI2C_Finish(dI2C_Ctx_t *Ctx, StdReturn_t Result)
+{
+    I2C_HandleTypeDef *hI2C = Ctx->hI2C;
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    if(Ctx->Phase == dI2C_PH_IDLE) {
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+        return;
+    }
+
+    Ctx->Phase = dI2C_PH_IDLE;
+    hI2C->Instance->CR1 &= ~dI2C_IT_ALL;
+    TWheel_Cancel(&Ctx->Tmr);
+
+    /* Clear Configuration Register 2 */
+    I2C_RESET_CR2(hI2C);
+    dI2C_FlushTXDR(hI2C);
+
+    dI2C_Account(Ctx, Result);
+    dI2C_AccountLat(Ctx, (HRT_GetTick() - Ctx->StartTick));
+    /* Bus state is unknown - recover before the next */
+    if(Result == RET_TIMEDOUT)
+        Ctx->IsRecoverDue = true;
+
+    dI2C_Complete(Ctx, Result);
+    dI2C_Kick(Ctx);
+
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/* Transfer timeout - from the timer ISR */
+static void dI2C_TmrCB(void *Arg)
+{
+    dI2C_Ctx_t *ctx = (dI2C_Ctx_t*)Arg;
+
+    if(ctx->Phase == dI2C_PH_IDLE)
+        return;
+
+    /* Release the bus, if the peripheral still owns it */
+    ctx->hI2C->Instance->CR1 &= ~dI2C_IT_ALL;
+    ctx->hI2C->Instance->CR2 |= I2C_CR2_STOP;
+    dI2C_Finish(ctx, RET_TIMEDOUT);
+}
+
+/* Queue requests in order, then run the queue - safe from ISR */
+static void dI2C_Enqueue(dI2C_Ctx_t *Ctx, dI2C_Req_t *Reqs, uint32_t N)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    for(uint32_t i = 0; i < N; i++) {
+        Reqs[i].Next = NULL;
+        Reqs[i].Result = RET_PROCESSING;
+        if(Ctx->Tail != NULL)
+            Ctx->Tail->Next = &Reqs[i];
+        else
+            Ctx->Head = &Reqs[i];
+        Ctx->Tail = &Reqs[i];
+    }
+    dI2C_Kick(Ctx);
+
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/* Withdraw request - fails the running batch holding it */
+static void dI2C_Abort(dI2C_Ctx_t *Ctx, dI2C_Req_t *Req)
+{
+    dI2C_Req_t *prev = NULL;
+    dI2C_Req_t *req;
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    for(req = Ctx->Head; req != NULL; prev = req, req = req->Next) {
+        if(req != Req)
+            continue;
+        if(prev != NULL)
+            prev->Next = req->Next;
+        else
+            Ctx->Head = req->Next;
+        if(Ctx->Tail == req)
+            Ctx->Tail = prev;
+        req->Next = NULL;
+        req->Result = RET_TIMEDOUT;
+        break;
+    }
+
+    if(req == NULL) {
+        for(req = Ctx->Cur; req != NULL; req = req->Next) {
+            if(req == Req) {
+                Ctx->hI2C->Instance->CR1 &= ~dI2C_IT_ALL;
+                Ctx->hI2C->Instance->CR2 |= I2C_CR2_STOP;
+                dI2C_Finish(Ctx, RET_TIMEDOUT);
+                break;
+            }
+        }
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/* Blocking requests done - from ISR */
+static void dI2C_SyncCB(StdReturn_t Result, void *Arg)
+{
+    dI2C_Ctx_t *ctx = (dI2C_Ctx_t*)Arg;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if((ctx->SyncPending > 0) && (--ctx->SyncPending == 0)) {
+        xSemaphoreGiveFromISR(ctx->Done, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+}
+
+/* Blocking requests - the caller sleeps till the ISR completes the last */
+static StdReturn_t dI2C_XferSync(dI2C_Ctx_t *Ctx, dI2C_Req_t *Reqs, uint32_t N)
+{
+    StdReturn_t stdRet = RET_OK;
+
+    if(pdTRUE != xSemaphoreTake(Ctx->Lock, pdMS_TO_TICKS(dI2C_LOCK_TIME)))
+        return RET_TIMEDOUT;
+
+    /* Give left by an aborted batch */
+    xSemaphoreTake(Ctx->Done, 0);
+
+    for(uint32_t i = 0; i < N; i++) {
+        Reqs[i].Cb = dI2C_SyncCB;
+        Reqs[i].Arg = Ctx;
+    }
+    Ctx->SyncPending = N;
+    dI2C_Enqueue(Ctx, Reqs, N);
+
+    /* Timer ends each transfer - this is a backstop, requests are on the caller's stack */
+    if(pdTRUE != xSemaphoreTake(Ctx->Done, pdMS_TO_TICKS(dI2C_LOCK_TIME))) {
+        for(uint32_t i = 0; i < N; i++)
+            dI2C_Abort(Ctx, &Reqs[i]);
+    }
+
+    for(uint32_t i = 0; i < N; i++) {
+        if(Reqs[i].Result != RET_OK) {
+            stdRet = Reqs[i].Result;
+            break;
+        }
+    }
+
+    xSemaphoreGive(Ctx->Lock);
+    return stdRet;
+}
+
+/* Bus context, if the caller may block on it */
+static dI2C_Ctx_t *dI2C_SyncCtx(I2C_HandleTypeDef *hI2C)
+{
+    dI2C_Ctx_t *ctx = dI2C_GetCtx(hI2C->Instance);
+
+    if((ctx == NULL) || !ctx->IsInit || (ctx->hI2C != hI2C))
+        return NULL;
+    /* Before the scheduler and in ISRs the transfer is polled */
+    if((__get_IPSR() != 0) || (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+        return NULL;
+    return ctx;
+}
+
+/* Is the queue of the bus running */
+static bool dI2C_IsXferActive(I2C_HandleTypeDef *hI2C)
+{
+    dI2C_Ctx_t *ctx = dI2C_GetCtx(hI2C->Instance);
+
+    return ((ctx != NULL) && ((ctx->Phase != dI2C_PH_IDLE) || (ctx->Head != NULL)));
+}
+
+/* Requests - polled */
+static StdReturn_t dI2C_XferPoll(I2C_HandleTypeDef *hI2C, dI2C_Req_t *Reqs, uint32_t N)
+{
+    StdReturn_t stdRet = RET_OK;
+    dI2C_Ctx_t *ctx = dI2C_GetCtx(hI2C->Instance);
+
+    if(dI2C_IsXferActive(hI2C))
+        return RET_ENV_NOK;
+    if((ctx != NULL) && (!ctx->IsInit || (ctx->hI2C != hI2C)))
+        ctx = NULL;
+
+    for(uint32_t i = 0; i < N; i++) {
+        dI2C_Xfer_t *xfer = &Reqs[i].Xfer;
+        HRTime_t tickStart = HRT_GetTick();
+
+        if(xfer->Op == dI2C_OP_WR)
+            Reqs[i].Result = dI2C_WrRegPoll(hI2C, xfer->DevAddr, xfer->RegAddr, xfer->Data, xfer->Size);
+        else if(xfer->Op == dI2C_OP_RD)
+            Reqs[i].Result = dI2C_RdRegPoll(hI2C, xfer->DevAddr, xfer->RegAddr, xfer->Data, xfer->Size);
+        else
+            Reqs[i].Result = dI2C_DeviceReadyPoll(hI2C, xfer->DevAddr);
+
+        if(ctx != NULL) {
+            UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+            dI2C_Account(ctx, Reqs[i].Result);
+            dI2C_AccountLat(ctx, (HRT_GetTick() - tickStart));
+            taskEXIT_CRITICAL_FROM_ISR(mask);
+
+            /* Release a stuck bus for the next - an ISR leaves it to the task */
+            if(Reqs[i].Result == RET_TIMEDOUT) {
+                if((__get_IPSR() == 0) || (xI2CTaskHandle == NULL)) {
+                    dI2C_Recover(ctx);
+                } else {
+                    ctx->IsRecoverDue = true;
+                    vTaskNotifyGiveFromISR(xI2CTaskHandle, NULL);
+                }
+            }
+        }
+
+        if((stdRet == RET_OK) && (Reqs[i].Result != RET_OK))
+            stdRet = Reqs[i].Result;
+    }
+    return stdRet;
+}
+
+/* Public Functions */
+/* Init */
+StdReturn_t dI2C_Init(I2C_HandleTypeDef *hI2C)
+{
+    if(hI2C == NULL)
+        return RET_ARGS_NOK;
+
+    __HAL_I2C_DISABLE(hI2C);
+
+    /* TIMINGR */
+    hI2C->Instance->TIMINGR = hI2C->Init.Timing & TIMING_CLEAR_MASK;
+
+    /* CR2 */
+    hI2C->Instance->CR2 |= (I2C_CR2_AUTOEND | I2C_CR2_NACK);
+
+    /* CR1 */
+    hI2C->Instance->CR1 = (hI2C->Init.GeneralCallMode | hI2C->Init.NoStretchMode);
+
+    __HAL_I2C_ENABLE(hI2C);
+
+    /* Interrupt driven, if the bus is routed to the driver */
+    dI2C_Ctx_t *ctx = dI2C_GetCtx(hI2C->Instance);
+    if((ctx != NULL) && !ctx->IsInit) {
+        const dI2C_Map_t *map = &dI2C_Map[ctx - dI2C_Ctx];
+
+        ctx->hI2C = hI2C;
+        ctx->Map = map;
+        ctx->Phase = dI2C_PH_IDLE;
+        ctx->Lock = xSemaphoreCreateMutexStatic(&ctx->LockBuf);
+        ctx->Done = xSemaphoreCreateBinaryStatic(&ctx->DoneBuf);
+        TWheel_InitCb(&ctx->Tmr, dI2C_TmrCB, ctx);
+
+        PAL_NVIC_SetPriority(map->EvIRQn, dI2C_IRQ_PRIO);
+        PAL_NVIC_EnableIRQ(map->EvIRQn);
+        PAL_NVIC_SetPriority(map->ErIRQn, dI2C_IRQ_PRIO);
+        PAL_NVIC_EnableIRQ(map->ErIRQn);
+
+        /* One task recovers all buses */
+        if(xI2CTaskHandle == NULL) {
+            static StaticTask_t xI2CTaskTCB;
+            static StackType_t uxI2CTaskStack[I2CTASK_STACKSZ];
+
+            xI2CTaskHandle = xTaskCreateStatic(dI2C_Task,
+                                               I2CTASK_NAME,
+                                               I2CTASK_STACKSZ,
+                                               NULL,
+                                               I2CTASK_PRIO,
+                                               uxI2CTaskStack,
+                                               &xI2CTaskTCB);
+            if(xI2CTaskHandle == NULL)
+                Error_Handler(ERROR_TASK_CREATE);
+        }
+        ctx->IsInit = true;
+    }
+
+    return RET_OK;
+}
+
+/* DeInit */
+StdReturn_t dI2C_DeInit(I2C_HandleTypeDef *hI2C)
+{
+    if(hI2C == NULL)
+        return RET_ARGS_NOK;
+
+    __HAL_I2C_DISABLE(hI2C);
+
+     return RET_OK;
+}
+
+/* Enable */
+StdReturn_t dI2C_Enable(I2C_HandleTypeDef *hI2C)
+{
+    if(hI2C == NULL)
+        return RET_ARGS_NOK;
+
+    __HAL_I2C_ENABLE(hI2C);
+
+    return RET_OK;
+}
+
+/* Disable */
+StdReturn_t dI2C_Disable(I2C_HandleTypeDef *hI2C)
+{
+    if(hI2C == NULL)
+        return RET_ARGS_NOK;
+
+    __HAL_I2C_DISABLE(hI2C);
+
+    return RET_OK;
+}
+
+/* Calc timing - TIMINGR closest to the bus speed (Hz) for the kernel clock (Hz) and rise/fall times (nsecs) */
+StdReturn_t dI2C_CalcTiming(uint32_t ClkFreq, uint32_t BusFreq, uint32_t RiseTime, uint32_t FallTime, uint32_t *Timing)
+{
+    const dI2C_Spec_t *spec = NULL;
+
+    if((Timing == NULL) || (ClkFreq == 0) || (BusFreq == 0))
+        return RET_ARGS_NOK;
+
+    for(uint32_t i = 0; i < (sizeof(dI2C_Spec) / sizeof(dI2C_Spec[0])); i++) {
+        if(BusFreq <= dI2C_Spec[i].Speed) {
+            spec = &dI2C_Spec[i];
+            break;
+        }
+    }
+    if((spec == NULL) || (RiseTime > spec->RiseMax) || (FallTime > spec->FallMax))
+        return RET_ARGS_NOK;
+
+    /* Picoseconds */
+    int64_t tClk = (1000000000000LL + (ClkFreq / 2)) / ClkFreq;
+    int64_t tBus = (1000000000000LL + (BusFreq / 2)) / BusFreq;
+    int64_t tRise = (int64_t)RiseTime * 1000;
+    int64_t tFall = (int64_t)FallTime * 1000;
+    int64_t tAfMin = dI2C_AF_DELAY_MIN * 1000;
+    int64_t tAfMax = dI2C_AF_DELAY_MAX * 1000;
+
+    /* SCL edges are seen through the analog filter and 2 kernel clocks of sync */
+    int64_t tSync = tAfMin + (2 * tClk);
+    int64_t sdaDelMin = tFall - ((int64_t)spec->HdDatMin * 1000) - tAfMin - (3 * tClk);
+    int64_t sdaDelMax = ((int64_t)spec->VdDatMax * 1000) - tRise - tAfMax - (4 * tClk);
+    int64_t sclDelMin = tRise + ((int64_t)spec->SuDatMin * 1000);
+    /* Edges and the analog filter spread close the data hold window at any kernel clock -
+     * FM+ at its 120 nsecs edge limits included */
+    if((sdaDelMin + (3 * tClk)) >= (sdaDelMax + (4 * tClk)))
+        return RET_ARGS_NOK;
+    /* Down to 80% of the speed */
+    int64_t tSclMax = (tBus * 5) / 4;
+
+    int64_t errBest = tSclMax;
+    bool isFound = false;
+
+    for(uint32_t presc = 0; presc < dI2C_PRESC_MAX; presc++) {
+        int64_t tPresc = (presc + 1) * tClk;
+        uint32_t sclDel, sdaDel;
+
+        /* Shortest data delays in spec */
+        for(sclDel = 0; sclDel < dI2C_DEL_MAX; sclDel++) {
+            if(((sclDel + 1) * tPresc) >= sclDelMin)
+                break;
+        }
+        for(sdaDel = 0; sdaDel < dI2C_DEL_MAX; sdaDel++) {
+            int64_t tSdaDel = ((sdaDel * (presc + 1)) + 1) * tClk;
+            if((tSdaDel >= sdaDelMin) && (tSdaDel <= sdaDelMax))
+                break;
+        }
+        if((sclDel == dI2C_DEL_MAX) || (sdaDel == dI2C_DEL_MAX))
+            continue;
+
+        for(uint32_t scll = 0; scll < dI2C_SCL_MAX; scll++) {
+            int64_t tLow = ((scll + 1) * tPresc) + tSync;
+            if((tLow < ((int64_t)spec->LowMin * 1000)) || (tClk >= ((tLow - tAfMin) / 4)))
+                continue;
+
+            /* Shortest high period meeting both the spec and the bus period */
+            int64_t tHighMin = MAX(((int64_t)spec->HighMin * 1000), (tBus - tLow - tRise - tFall));
+            int64_t h = (tHighMin > tSync) ? (((tHighMin - tSync) + tPresc - 1) / tPresc) - 1 : 0;
+            h = MAX(h, 0);
+            if(h >= dI2C_SCL_MAX)
+                continue;
+            int64_t tHigh = ((h + 1) * tPresc) + tSync;
+            int64_t tScl = tLow + tHigh + tRise + tFall;
+            if((tScl > tSclMax) || (tHigh <= tClk))
+                continue;
+
+            if((tScl - tBus) < errBest) {
+                errBest = tScl - tBus;
+                *Timing = (presc << I2C_TIMINGR_PRESC_Pos) | (sclDel << I2C_TIMINGR_SCLDEL_Pos) |
+                        (sdaDel << I2C_TIMINGR_SDADEL_Pos) | ((uint32_t)h << I2C_TIMINGR_SCLH_Pos) | scll;
+                isFound = true;
+            }
+        }
+    }
+
+    return (isFound ? RET_OK : RET_NOK);
+}
+
+
+/* Write register */
+StdReturn_t dI2C_WrReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size)
+{
+    dI2C_Req_t req = {.Xfer = {.Op = dI2C_OP_WR, .DevAddr = DevAddr, .RegAddr = RegAddr, .Data = Data, .Size = Size}};
+
+    return dI2C_XferBatch(hI2C, &req, 1);
+}
+
+/* Read register */
+StdReturn_t dI2C_RdReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size)
+{
+    dI2C_Req_t req = {.Xfer = {.Op = dI2C_OP_RD, .DevAddr = DevAddr, .RegAddr = RegAddr, .Data = Data, .Size = Size}};
+    StdReturn_t stdRet;
+
+    PROF_START(PROF_DI2C_RDREG);
+    stdRet = dI2C_XferBatch(hI2C, &req, 1);
+    PROF_STOP(PROF_DI2C_RDREG);
+
+    return stdRet;
+}
+
+/* Device ready */
+StdReturn_t dI2C_DeviceReady(I2C_HandleTypeDef *hI2C, uint8_t DevAddr)
+{
+    dI2C_Req_t req = {.Xfer = {.Op = dI2C_OP_PROBE, .DevAddr = DevAddr}};
+    StdReturn_t stdRet = RET_NOK;
+
+    if(hI2C == NULL)
+        return RET_ARGS_NOK;
+
+    /* Polled probe has its own trials */
+    if(dI2C_SyncCtx(hI2C) == NULL)
+        return dI2C_XferBatch(hI2C, &req, 1);
+
+    /* Address only, NACK is retried */
+    for(uint32_t numTrails = 5; numTrails > 0; numTrails--) {
+        stdRet = dI2C_XferBatch(hI2C, &req, 1);
+        if(stdRet != RET_NOK)
+            break;
+    }
+    return stdRet;
+}
+
+/* Blocking requests - queued together, contiguous reads merge, Cb is the driver's */
+StdReturn_t dI2C_XferBatch(I2C_HandleTypeDef *hI2C, dI2C_Req_t *Reqs, uint32_t N)
+{
+    StdReturn_t stdRet;
+
+    if((hI2C == NULL) || (Reqs == NULL) || (N == 0))
+        return RET_ARGS_NOK;
+    for(uint32_t i = 0; i < N; i++) {
+        stdRet = dI2C_ChkXfer(&Reqs[i].Xfer);
+        if(stdRet != RET_OK)
+            return stdRet;
+    }
+
+    dI2C_Ctx_t *ctx = dI2C_SyncCtx(hI2C);
+    if(ctx != NULL)
+        return dI2C_XferSync(ctx, Reqs, N);
+    return dI2C_XferPoll(hI2C, Reqs, N);
+}
+
+/* Submit requests - queued together, Cb of each from ISR on completion, Reqs are held till then */
+StdReturn_t dI2C_Submit(I2C_HandleTypeDef *hI2C, dI2C_Req_t *Reqs, uint32_t N)
+{
+    StdReturn_t stdRet;
+
+    if((hI2C == NULL) || (Reqs == NULL) || (N == 0))
+        return RET_ARGS_NOK;
+    for(uint32_t i = 0; i < N; i++) {
+        stdRet = dI2C_ChkXfer(&Reqs[i].Xfer);
+        if(stdRet != RET_OK)
+            return stdRet;
+    }
+
+    dI2C_Ctx_t *ctx = dI2C_GetCtx(hI2C->Instance);
+    if((ctx == NULL) || !ctx->IsInit || (ctx->hI2C != hI2C))
+        return RET_NO_IMPL;
+
+    dI2C_Enqueue(ctx, Reqs, N);
+    return RET_OK;
+}
+/* Get statistics of a bus */
+StdReturn_t dI2C_GetStat(uint32_t Bus, dI2C_Stat_t *Stat)
+{
+    if((Bus >= dI2C_N_BUS) || (Stat == NULL))
+        return RET_ARGS_NOK;
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    *Stat = dI2C_Ctx[Bus].Stat;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+
+    return RET_OK;
+}
+
+/* Reset statistics */
+void dI2C_ResetStat(void)
+{
+    for(uint32_t i = 0; i < dI2C_N_BUS; i++) {
+        UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+        memset(&dI2C_Ctx[i].Stat, 0, sizeof(dI2C_Stat_t));
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+    }
+}
+
+/* Event ISR */
+void dI2C_EV_ISR(I2C_TypeDef *Instance)
+{
+    dI2C_Ctx_t *ctx = dI2C_GetCtx(Instance);
+
+    if((ctx == NULL) || (ctx->Phase == dI2C_PH_IDLE)) {
+        Instance->CR1 &= ~dI2C_IT_ALL;
+        return;
+    }
+
+    I2C_HandleTypeDef *hI2C = ctx->hI2C;
+    dI2C_Xfer_t *xfer = &ctx->Xfer;
+    uint32_t isr = Instance->ISR;
+
+    if(isr & I2C_ISR_NACKF) {
+        /* Register phase is not on AUTOEND - STOP by hand */
+        Instance->ICR = I2C_ICR_NACKCF;
+        if(ctx->Phase == dI2C_PH_REG)
+            Instance->CR2 |= I2C_CR2_STOP;
+        ctx->Result = RET_NOK;
+        dI2C_FlushTXDR(hI2C);
+    } else if(isr & I2C_ISR_TXIS) {
+        if(ctx->Phase == dI2C_PH_REG)
+            Instance->TXDR = xfer->RegAddr;
+        else if(ctx->Count < xfer->Size)
+            Instance->TXDR = xfer->Data[ctx->Count++];
+        else
+            Instance->TXDR = 0x00U;
+    } else if(isr & I2C_ISR_RXNE) {
+        uint8_t data = (uint8_t)Instance->RXDR;
+        if(ctx->Count < xfer->Size)
+            xfer->Data[ctx->Count++] = data;
+    } else if(isr & I2C_ISR_TCR) {
+        /* Register sent - data follows without a restart */
+        ctx->Phase = dI2C_PH_WR;
+        dI2C_TransferConfig(hI2C, xfer->DevAddr, xfer->Size, I2C_AUTOEND_MODE, I2C_NO_STARTSTOP);
+    } else if(isr & I2C_ISR_TC) {
+        /* Register sent - restart to read */
+        ctx->Phase = dI2C_PH_RD;
+        dI2C_TransferConfig(hI2C, xfer->DevAddr, xfer->Size, I2C_AUTOEND_MODE, I2C_GENERATE_START_READ);
+    }
+
+    /* Done once the last byte is out of RXDR */
+    isr = Instance->ISR;
+    if((isr & I2C_ISR_STOPF) && !(isr & I2C_ISR_RXNE)) {
+        Instance->ICR = I2C_ICR_STOPCF;
+        if((ctx->Result == RET_OK) && (ctx->Phase != dI2C_PH_PROBE) && (ctx->Count != xfer->Size))
+            ctx->Result = RET_NOK;
+        dI2C_Finish(ctx, ctx->Result);
+    }
+}
+
+/* Error ISR */
+void dI2C_ER_ISR(I2C_TypeDef *Instance)
+{
+    dI2C_Ctx_t *ctx = dI2C_GetCtx(Instance);
+    uint32_t isr = Instance->ISR;
+
+    if(!(isr & dI2C_ERR_ALL))
+        return;
+    Instance->ICR = (I2C_ICR_BERRCF | I2C_ICR_ARLOCF | I2C_ICR_OVRCF);
+
+    /* Peripheral has released the bus */
+    if(ctx != NULL)
+        dI2C_Finish(ctx, RET_HW_NOK);
+}
+
 /******************************** End of File *********************************/
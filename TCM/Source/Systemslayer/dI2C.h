@@ -11,13 +11,64 @@
 
 /* Includes */
 #include "PAL.h"
+#include "RTOS.h"
 
 #include "stm32l4xx_hal_i2c.h"
 
 /* Macros */
 
+/* Bus speeds (Hz) */
+#define dI2C_SPEED_STD      (100000)
+#define dI2C_SPEED_FAST     (400000)
+#define dI2C_SPEED_FASTPLUS (1000000)   // Needs the FM+ pin drive, a kernel clock over 16MHz and tr + tf under 240 nsecs
+
+/* Buses driven from their interrupts - I2C3 */
+#define dI2C_N_BUS          (1)
+
 /* Types */
 
+/* Transfer operation */
+typedef enum {
+    dI2C_OP_WR = 0,         // Register write
+    dI2C_OP_RD,             // Register read
+    dI2C_OP_PROBE,          // Address only
+} dI2C_Op_t;
+
+/* Transfer - up to 255 bytes */
+typedef struct {
+    dI2C_Op_t Op;
+    uint8_t DevAddr;
+    uint8_t RegAddr;
+    uint8_t *Data;
+    uint32_t Size;
+} dI2C_Xfer_t;
+
+/* Bus statistics */
+typedef struct {
+    uint32_t Xfers;
+    uint32_t Nacks;
+    uint32_t Timeouts;
+    uint32_t BusErrs;
+    uint32_t Recoveries;
+    /* Transfers on the bus - usecs */
+    uint32_t LatCount;
+    uint32_t LatMin;
+    uint32_t LatMax;
+    uint64_t LatSum;
+} dI2C_Stat_t;
+
+/* Transfer done - from ISR */
+typedef void (*dI2C_Cb_t)(StdReturn_t Result, void *Arg);
+
+/* Request - held by the driver till completion */
+typedef struct dI2C_Req {
+    struct dI2C_Req *Next;  // Queue link
+    dI2C_Xfer_t Xfer;
+    dI2C_Cb_t Cb;           // May be NULL
+    void *Arg;
+    volatile StdReturn_t Result;
+} dI2C_Req_t;
+
 /* Function Prototypes */
 /* Init */
 StdReturn_t dI2C_Init(I2C_HandleTypeDef *hI2C);
@@ -27,12 +78,27 @@ StdReturn_t dI2C_DeInit(I2C_HandleTypeDef *hI2C);
 StdReturn_t dI2C_Enable(I2C_HandleTypeDef *hI2C);
 /* Disable */
 StdReturn_t dI2C_Disable(I2C_HandleTypeDef *hI2C);
+/* Calc timing - TIMINGR closest to the bus speed (Hz) for the kernel clock (Hz) and rise/fall times (nsecs).
+ * RET_ARGS_NOK - speed and edges unsupported at any clock, RET_NOK - none at this kernel clock */
+StdReturn_t dI2C_CalcTiming(uint32_t ClkFreq, uint32_t BusFreq, uint32_t RiseTime, uint32_t FallTime, uint32_t *Timing);
 /* Write register */
 StdReturn_t dI2C_WrReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size);
 /* Read register */
 StdReturn_t dI2C_RdReg(I2C_HandleTypeDef *hI2C, uint8_t DevAddr, uint8_t RegAddr, uint8_t *Data, uint32_t Size);
 /* Device ready */
 StdReturn_t dI2C_DeviceReady(I2C_HandleTypeDef *hI2C, uint8_t DevAddr);
+/* Blocking requests - queued together, contiguous reads merge, Cb is the driver's */
+StdReturn_t dI2C_XferBatch(I2C_HandleTypeDef *hI2C, dI2C_Req_t *Reqs, uint32_t N);
+/* Submit requests - queued together, Cb of each from ISR on completion, Reqs are held till then */
+StdReturn_t dI2C_Submit(I2C_HandleTypeDef *hI2C, dI2C_Req_t *Reqs, uint32_t N);
+/* Get statistics of a bus */
+StdReturn_t dI2C_GetStat(uint32_t Bus, dI2C_Stat_t *Stat);
+/* Reset statistics */
+void dI2C_ResetStat(void);
+/* Event ISR */
+void dI2C_EV_ISR(I2C_TypeDef *Instance);
+/* Error ISR */
+void dI2C_ER_ISR(I2C_TypeDef *Instance);
 
 #endif /*** _dI2C_H_ ***/
  
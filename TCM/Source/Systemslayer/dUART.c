@@ -0,0 +1,697 @@
+/**
+ **  @file dUART.c
+ **  @brief UART DMA driver
+ **  @author JZJ
+ **
+ **/
+
+/* Includes */
+#include "dUART.h"
+
+/* Macros */
+
+/* Bits per character - 8N1 */
+#define dUART_BITS_PER_CHAR (10)
+/* Margin on top of the expected transfer time (usecs) */
+#define dUART_TX_MARGIN     (1000)
+/* Stall deadline - usecs to RTOS ticks, plus one for tick granularity */
+#define dUART_TX_TICKS(us)  (pdMS_TO_TICKS(((us) + 999) / 1000) + 1)
+/* DMA interrupt priority - must be within RTOS syscall range */
+#define dUART_DMA_IRQ_PRIO  (6)
+/* Oversampling - clocks per bit */
+#define dUART_OVERSAMPLING  (16)
+/* Max wait for Tx to drain before changing baud rate (usecs) */
+#define dUART_TC_TIMEOUT    (100 * 1000)
+/* Max baud rate error - percent */
+#define dUART_BAUD_MAXERR   (2)
+/* Frames queued at once - Tx waits for room past this */
+#define dUART_TXFRAME_MAX   (64)
+/* Line held idle after an aborted block, so the far end drops the cut frame */
+#define dUART_TX_ABORT_GAP  (20) // 20 msecs
+
+/* Types */
+
+/* Board mapping - NULL channel where DMA is not used */
+typedef struct {
+    USART_TypeDef *Instance;
+    IRQn_Type IRQn;
+    bool BaudCtrl;                  // Baud rate set here, PCLK1 kernel clock
+    DMA_Channel_TypeDef *TxDMAChannel;
+    uint32_t TxDMARequest;
+    IRQn_Type TxDMAIRQn;
+    uint8_t *TxRing;
+    DMA_Channel_TypeDef *RxDMAChannel;
+    uint32_t RxDMARequest;
+    IRQn_Type RxDMAIRQn;
+    uint8_t *RxRing;
+} dUART_Map_t;
+
+/* Port context */
+typedef struct {
+    bool Started;
+    USART_TypeDef *Instance;
+    uint32_t BaudRate;
+    uint32_t ByteTime;              // usecs per character
+    DMA_HandleTypeDef hTxDMA;
+    uint8_t *TxRing;
+    volatile uint32_t TxHead;       // Next byte to write
+    volatile uint32_t TxTail;       // First byte of the block in flight
+    volatile uint32_t TxUsed;       // Bytes queued, including in flight
+    volatile uint32_t TxInFlight;   // Bytes handed to DMA
+    uint32_t TxQueued;              // Bytes queued, running count
+    uint32_t TxDone;                // Bytes released, running count
+    uint32_t TxFrameStart[dUART_TXFRAME_MAX]; // Running count at the start of each queued frame
+    uint32_t TxFrameFirst;          // Oldest queued frame
+    volatile uint32_t TxFrames;     // Frames queued, including in flight
+    bool TxHold;                    // Line held idle after an abort
+    TickType_t TxHoldStart;
+    TickType_t TxStart;
+    TickType_t TxTimeout;
+    SemaphoreHandle_t TxSpaceSem;
+    StaticSemaphore_t TxSpaceSemStruct;
+    dUART_TxStats_t Stats;
+    DMA_HandleTypeDef hRxDMA;
+    uint8_t *RxRing;
+    volatile uint32_t RxTail;       // Next byte to read
+    volatile uint32_t RxHead;       // DMA write position when last seen
+    volatile uint32_t RxWritten;    // Bytes written by DMA, running count
+    uint32_t RxRead;                // Bytes consumed, running count
+    dUART_RxCB_t RxCB;
+    uint32_t RxErrors;
+    uint32_t RxOverruns;            // Unread data overwritten by DMA
+} dUART_Ctx_t;
+
+/* Externs */
+
+/* Function Declarations */
+
+/* Global Variables */
+
+/* Static Variables */
+/* Rings */
+static uint8_t dUART_TCMTxRing[dUART_TXRING_LEN];
+static uint8_t dUART_AxM1RxRing[dUART_RXRING_LEN];
+static uint8_t dUART_AxM2RxRing[dUART_RXRING_LEN];
+
+static const dUART_Map_t dUART_Map[dUART_PORT_N_ENUM] = {
+    /* TCM - UART4, Tx DMA */
+    [dUART_PORT_TCM] = {
+        .Instance = UART4, .IRQn = UART4_IRQn, .BaudCtrl = true,
+        .TxDMAChannel = DMA1_Channel4, .TxDMARequest = DMA_REQUEST_UART4_TX,
+        .TxDMAIRQn = DMA1_Channel4_IRQn, .TxRing = dUART_TCMTxRing,
+    },
+    /* AxM1 - LPUART1, Rx DMA */
+    [dUART_PORT_AxM1] = {
+        .Instance = LPUART1, .IRQn = LPUART1_IRQn,
+        .RxDMAChannel = DMA1_Channel2, .RxDMARequest = DMA_REQUEST_LPUART1_RX,
+        .RxDMAIRQn = DMA1_Channel2_IRQn, .RxRing = dUART_AxM1RxRing,
+    },
+    /* AxM2 - USART1, Rx DMA */
+    [dUART_PORT_AxM2] = {
+        .Instance = USART1, .IRQn = USART1_IRQn,
+        .RxDMAChannel = DMA1_Channel3, .RxDMARequest = DMA_REQUEST_USART1_RX,
+        .RxDMAIRQn = DMA1_Channel3_IRQn, .RxRing = dUART_AxM2RxRing,
+    },
+};
+
+static dUART_Ctx_t dUART_Ctx[dUART_PORT_N_ENUM];
+
+/* Private Functions */
+
+/* Start DMA on the next contiguous block - interrupts masked */
+static void dUART_TxKick(dUART_Ctx_t *Ctx)
+{
+    if ((Ctx->TxInFlight != 0) || (Ctx->TxUsed == 0))
+        return;
+
+    /* Gap after an abort - restarted from the stall check */
+    if (Ctx->TxHold) {
+        if ((xTaskGetTickCountFromISR() - Ctx->TxHoldStart) < pdMS_TO_TICKS(dUART_TX_ABORT_GAP))
+            return;
+        Ctx->TxHold = false;
+    }
+
+    /* Up to the end of the ring, the wrapped part follows on completion */
+    uint32_t len = MIN(Ctx->TxUsed, (dUART_TXRING_LEN - Ctx->TxTail));
+
+    Ctx->TxInFlight = len;
+    Ctx->TxStart = xTaskGetTickCountFromISR();
+    Ctx->TxTimeout = dUART_TX_TICKS((len * Ctx->ByteTime * 2) + dUART_TX_MARGIN);
+
+    if (HAL_OK != HAL_DMA_Start_IT(&Ctx->hTxDMA, (uint32_t)&Ctx->TxRing[Ctx->TxTail],
+            (uint32_t)&Ctx->Instance->TDR, len)) {
+        Ctx->TxInFlight = 0;
+        return;
+    }
+    SET_BIT(Ctx->Instance->CR3, USART_CR3_DMAT);
+}
+
+/* Drop the oldest queued frame - interrupts masked */
+static inline void dUART_TxFramePop(dUART_Ctx_t *Ctx)
+{
+    Ctx->TxFrameFirst = (Ctx->TxFrameFirst + 1) % dUART_TXFRAME_MAX;
+    Ctx->TxFrames--;
+}
+
+/* Start of the frame after the oldest - interrupts masked */
+static inline uint32_t dUART_TxFrameNext(dUART_Ctx_t *Ctx)
+{
+    if (Ctx->TxFrames > 1)
+        return Ctx->TxFrameStart[(Ctx->TxFrameFirst + 1) % dUART_TXFRAME_MAX];
+    return Ctx->TxQueued;
+}
+
+/* Release the block in flight and start the next - interrupts masked */
+static void dUART_TxRelease(dUART_Ctx_t *Ctx, bool Done)
+{
+    uint32_t len = Ctx->TxInFlight;
+    uint32_t end = Ctx->TxDone + len;
+
+    CLEAR_BIT(Ctx->Instance->CR3, USART_CR3_DMAT);
+
+    if (Done) {
+        Ctx->Stats.TxBytes += len;
+        /* Frames sent out in full */
+        while ((Ctx->TxFrames > 0) && ((int32_t)(dUART_TxFrameNext(Ctx) - end) <= 0))
+            dUART_TxFramePop(Ctx);
+    } else {
+        Ctx->Stats.TxStalls++;
+        /* Every frame the block reached is dropped whole - the unsent rest of a cut
+         * frame never follows on the wire, the idle gap lets the far end drop its head */
+        while ((Ctx->TxFrames > 0) && ((int32_t)(Ctx->TxFrameStart[Ctx->TxFrameFirst] - end) < 0)) {
+            dUART_TxFramePop(Ctx);
+            Ctx->Stats.TxDropped++;
+        }
+        len = ((Ctx->TxFrames > 0) ? Ctx->TxFrameStart[Ctx->TxFrameFirst] : Ctx->TxQueued) - Ctx->TxDone;
+        Ctx->TxHold = true;
+        Ctx->TxHoldStart = xTaskGetTickCountFromISR();
+    }
+
+    Ctx->TxTail = (Ctx->TxTail + len) % dUART_TXRING_LEN;
+    Ctx->TxUsed -= len;
+    Ctx->TxDone += len;
+    Ctx->TxInFlight = 0;
+
+    dUART_TxKick(Ctx);
+}
+
+/* Set byte time from baud rate */
+static inline void dUART_SetByteTime(dUART_Ctx_t *Ctx, uint32_t BaudRate)
+{
+    Ctx->BaudRate = BaudRate;
+    Ctx->ByteTime = ((dUART_BITS_PER_CHAR * 1000 * 1000) + BaudRate - 1) / BaudRate;
+}
+
+/* Wait for the last character to leave the shift register */
+static StdReturn_t dUART_WaitTC(USART_TypeDef *Uart)
+{
+    HRTime_t tickStart = HRT_GetTick();
+    while (!(Uart->ISR & USART_ISR_TC)) {
+        if (HRT_IsTimedOut(tickStart, dUART_TC_TIMEOUT))
+            return RET_TIMEDOUT;
+    }
+
+    return RET_OK;
+}
+
+/* FIFO on with 1/8 thresholds - only writable while disabled, interrupts masked */
+static inline void dUART_FifoConfig(USART_TypeDef *Uart)
+{
+    MODIFY_REG(Uart->CR3, (USART_CR3_TXFTCFG | USART_CR3_RXFTCFG),
+            (UART_TXFIFO_THRESHOLD_1_8 | UART_RXFIFO_THRESHOLD_1_8));
+    SET_BIT(Uart->CR1, USART_CR1_FIFOEN);
+}
+
+/* Tx complete callback */
+static void dUART_TxDMACmplt(DMA_HandleTypeDef *hDMA)
+{
+    dUART_Ctx_t *ctx = (dUART_Ctx_t*)hDMA->Parent;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    dUART_TxRelease(ctx, true);
+
+    xSemaphoreGiveFromISR(ctx->TxSpaceSem, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* Tx error callback */
+static void dUART_TxDMAError(DMA_HandleTypeDef *hDMA)
+{
+    dUART_Ctx_t *ctx = (dUART_Ctx_t*)hDMA->Parent;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    dUART_TxRelease(ctx, false);
+
+    xSemaphoreGiveFromISR(ctx->TxSpaceSem, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* Advance the written count to the DMA position - interrupts masked */
+static void dUART_RxTrack(dUART_Ctx_t *Ctx)
+{
+    /* Seen at least every half ring by the HT/TC interrupts, so never laps unseen */
+    uint32_t head = dUART_RXRING_LEN - __HAL_DMA_GET_COUNTER(&Ctx->hRxDMA);
+    if (head >= dUART_RXRING_LEN)
+        head = 0;
+
+    Ctx->RxWritten += (head + dUART_RXRING_LEN - Ctx->RxHead) % dUART_RXRING_LEN;
+    Ctx->RxHead = head;
+}
+
+/* Rx DMA half/full transfer callback */
+static void dUART_RxDMAEvt(DMA_HandleTypeDef *hDMA)
+{
+    dUART_Ctx_t *ctx = (dUART_Ctx_t*)hDMA->Parent;
+
+    dUART_RxTrack(ctx);
+
+    if (ctx->RxCB != NULL)
+        ctx->RxCB();
+}
+
+/* Rx DMA error callback */
+static void dUART_RxDMAError(DMA_HandleTypeDef *hDMA)
+{
+    dUART_Ctx_t *ctx = (dUART_Ctx_t*)hDMA->Parent;
+
+    ctx->RxErrors++;
+}
+
+/* Public Functions */
+
+/* Init */
+StdReturn_t dUART_Init(dUART_Port_t Port, uint32_t BaudRate)
+{
+    if ((Port >= dUART_PORT_N_ENUM) || (BaudRate == 0))
+        return RET_ARGS_NOK;
+
+    const dUART_Map_t *map = &dUART_Map[Port];
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+
+    ctx->Instance = map->Instance;
+
+    /* Baud rate and FIFO */
+    StdReturn_t stdRet = dUART_SetBaudRate(Port, BaudRate);
+    if (stdRet != RET_OK)
+        return stdRet;
+
+    /* No Tx DMA on this port */
+    if (map->TxDMAChannel == NULL)
+        return RET_OK;
+
+    /* Clocks */
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    /* Tx DMA */
+    ctx->hTxDMA.Instance                 = map->TxDMAChannel;
+    ctx->hTxDMA.Init.Request             = map->TxDMARequest;
+    ctx->hTxDMA.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    ctx->hTxDMA.Init.PeriphInc           = DMA_PINC_DISABLE;
+    ctx->hTxDMA.Init.MemInc              = DMA_MINC_ENABLE;
+    ctx->hTxDMA.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    ctx->hTxDMA.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    ctx->hTxDMA.Init.Mode                = DMA_NORMAL;
+    ctx->hTxDMA.Init.Priority            = DMA_PRIORITY_MEDIUM;
+    if (HAL_OK != HAL_DMA_Init(&ctx->hTxDMA))
+        return RET_HW_NOK;
+
+    ctx->TxRing = map->TxRing;
+    ctx->hTxDMA.Parent = ctx;
+    ctx->hTxDMA.XferCpltCallback = dUART_TxDMACmplt;
+    ctx->hTxDMA.XferErrorCallback = dUART_TxDMAError;
+
+    /* Signalled on every completion, Tx waits on it for room */
+    if (ctx->TxSpaceSem == NULL)
+        ctx->TxSpaceSem = xSemaphoreCreateBinaryStatic(&ctx->TxSpaceSemStruct);
+    if (ctx->TxSpaceSem == NULL)
+        return RET_NOK;
+
+    ctx->TxHead = 0;
+    ctx->TxTail = 0;
+    ctx->TxUsed = 0;
+    ctx->TxInFlight = 0;
+    ctx->TxQueued = 0;
+    ctx->TxDone = 0;
+    ctx->TxFrameFirst = 0;
+    ctx->TxFrames = 0;
+    ctx->TxHold = false;
+    memset(&ctx->Stats, 0, sizeof(ctx->Stats));
+
+    /* Interrupt config */
+    PAL_NVIC_SetPriority(map->TxDMAIRQn, dUART_DMA_IRQ_PRIO);
+    PAL_NVIC_EnableIRQ(map->TxDMAIRQn);
+
+    ctx->Started = true;
+
+    return RET_OK;
+}
+
+/* Is baud rate supported */
+bool dUART_IsBaudSupported(dUART_Port_t Port, uint32_t BaudRate)
+{
+    if ((Port >= dUART_PORT_N_ENUM) || (BaudRate < dUART_BAUD_MIN))
+        return false;
+
+    /* AxM links are configured by AxMi */
+    if (!dUART_Map[Port].BaudCtrl)
+        return false;
+
+    /* At least one kernel clock per oversample */
+    uint32_t clk = HAL_RCC_GetPCLK1Freq();
+    if (BaudRate > (clk / dUART_OVERSAMPLING))
+        return false;
+
+    /* Integer divider must land close enough to the requested rate */
+    uint32_t brr = (clk + (BaudRate / 2)) / BaudRate;
+    uint32_t actual = clk / brr;
+    uint32_t err = (actual > BaudRate) ? (actual - BaudRate) : (BaudRate - actual);
+    if ((err * 100) > (BaudRate * dUART_BAUD_MAXERR))
+        return false;
+
+    return true;
+}
+
+/* Set baud rate - enables FIFO, waits for pending Tx to drain */
+StdReturn_t dUART_SetBaudRate(dUART_Port_t Port, uint32_t BaudRate)
+{
+    if (!dUART_IsBaudSupported(Port, BaudRate))
+        return RET_ARGS_NOK;
+
+    USART_TypeDef *uart = dUART_Map[Port].Instance;
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+    uint32_t clk = HAL_RCC_GetPCLK1Freq();
+
+    if (RET_OK != dUART_WaitTC(uart))
+        return RET_TIMEDOUT;
+
+    taskENTER_CRITICAL();
+    /* FIFO and BRR are only writable while disabled */
+    CLEAR_BIT(uart->CR1, USART_CR1_UE);
+    dUART_FifoConfig(uart);
+    CLEAR_BIT(uart->CR1, USART_CR1_OVER8);
+    uart->BRR = (clk + (BaudRate / 2)) / BaudRate;
+    SET_BIT(uart->CR1, USART_CR1_UE);
+    taskEXIT_CRITICAL();
+
+    dUART_SetByteTime(ctx, BaudRate);
+
+    return RET_OK;
+}
+
+/* Get baud rate */
+uint32_t dUART_GetBaudRate(dUART_Port_t Port)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return 0;
+
+    return dUART_Ctx[Port].BaudRate;
+}
+
+/* Queue a frame for Tx - waits up to Wait ticks for room */
+StdReturn_t dUART_Tx(dUART_Port_t Port, uint8_t *Data, uint32_t Size, TickType_t Wait)
+{
+    if ((Port >= dUART_PORT_N_ENUM) || (Data == NULL) || (Size == 0) || (Size > dUART_TXRING_LEN))
+        return RET_ARGS_NOK;
+
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+    if (!ctx->Started || (dUART_Map[Port].TxDMAChannel == NULL))
+        return RET_ENV_NOK;
+
+    TickType_t tickStart = xTaskGetTickCount();
+
+    while (1) {
+        /* Supervise the block in flight before queuing behind it */
+        dUART_TxCheck(Port);
+
+        taskENTER_CRITICAL();
+        if (((dUART_TXRING_LEN - ctx->TxUsed) >= Size) && (ctx->TxFrames < dUART_TXFRAME_MAX)) {
+            /* Copy, wrapping at the end of the ring */
+            uint32_t first = MIN(Size, (dUART_TXRING_LEN - ctx->TxHead));
+            memcpy(&ctx->TxRing[ctx->TxHead], Data, first);
+            memcpy(&ctx->TxRing[0], &Data[first], (Size - first));
+            ctx->TxHead = (ctx->TxHead + Size) % dUART_TXRING_LEN;
+            ctx->TxUsed += Size;
+
+            /* Frame bounds - a stalled block is dropped to the end of its frame */
+            ctx->TxFrameStart[(ctx->TxFrameFirst + ctx->TxFrames) % dUART_TXFRAME_MAX] = ctx->TxQueued;
+            ctx->TxFrames++;
+            ctx->TxQueued += Size;
+
+            ctx->Stats.TxFrames++;
+            if (ctx->TxUsed > ctx->Stats.TxMaxPending)
+                ctx->Stats.TxMaxPending = ctx->TxUsed;
+
+            dUART_TxKick(ctx);
+            taskEXIT_CRITICAL();
+            return RET_OK;
+        }
+        taskEXIT_CRITICAL();
+
+        /* Wait for a completion to free room */
+        TickType_t elapsed = xTaskGetTickCount() - tickStart;
+        if ((elapsed >= Wait) || (pdFALSE == xSemaphoreTake(ctx->TxSpaceSem, (Wait - elapsed)))) {
+            ctx->Stats.TxDropped++;
+            return RET_BUF_FULL;
+        }
+    }
+}
+
+/* Get free room in Tx ring - bytes */
+uint32_t dUART_GetTxRoom(dUART_Port_t Port)
+{
+    if ((Port >= dUART_PORT_N_ENUM) || !dUART_Ctx[Port].Started)
+        return 0;
+
+    return (dUART_TXRING_LEN - dUART_Ctx[Port].TxUsed);
+}
+
+/* Is Tx idle - nothing queued or in flight */
+bool dUART_IsTxIdle(dUART_Port_t Port)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return false;
+
+    return (dUART_Ctx[Port].TxUsed == 0);
+}
+
+/* Check for stalled transfers */
+void dUART_TxCheck(dUART_Port_t Port)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return;
+
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+
+    taskENTER_CRITICAL();
+    /* Abort a block that took longer than its wire time allows */
+    if ((ctx->TxInFlight != 0) && ((xTaskGetTickCount() - ctx->TxStart) > ctx->TxTimeout)) {
+        HAL_DMA_Abort(&ctx->hTxDMA);
+        dUART_TxRelease(ctx, false);
+    }
+    /* Resume once the gap after an abort has passed */
+    dUART_TxKick(ctx);
+    taskEXIT_CRITICAL();
+}
+
+/* Get Tx statistics */
+StdReturn_t dUART_GetTxStats(dUART_Port_t Port, dUART_TxStats_t *Stats)
+{
+    if ((Port >= dUART_PORT_N_ENUM) || (Stats == NULL))
+        return RET_ARGS_NOK;
+
+    taskENTER_CRITICAL();
+    *Stats = dUART_Ctx[Port].Stats;
+    taskEXIT_CRITICAL();
+
+    return RET_OK;
+}
+
+/* Reset Tx statistics */
+void dUART_ResetTxStats(dUART_Port_t Port)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return;
+
+    taskENTER_CRITICAL();
+    memset(&dUART_Ctx[Port].Stats, 0, sizeof(dUART_TxStats_t));
+    taskEXIT_CRITICAL();
+}
+
+/* Start circular Rx - replaces the per-byte interrupt, enables FIFO */
+StdReturn_t dUART_RxStart(dUART_Port_t Port, dUART_RxCB_t RxCB)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return RET_ARGS_NOK;
+
+    const dUART_Map_t *map = &dUART_Map[Port];
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+    USART_TypeDef *uart = map->Instance;
+
+    if (map->RxDMAChannel == NULL)
+        return RET_NO_IMPL;
+
+    /* FIFO - the rate stays as AxMi set it */
+    if (RET_OK != dUART_WaitTC(uart))
+        return RET_TIMEDOUT;
+    taskENTER_CRITICAL();
+    CLEAR_BIT(uart->CR1, USART_CR1_UE);
+    dUART_FifoConfig(uart);
+    SET_BIT(uart->CR1, USART_CR1_UE);
+    taskEXIT_CRITICAL();
+
+    /* Clocks */
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    /* Rx DMA - runs forever, the ring is read behind it */
+    ctx->hRxDMA.Instance                 = map->RxDMAChannel;
+    ctx->hRxDMA.Init.Request             = map->RxDMARequest;
+    ctx->hRxDMA.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    ctx->hRxDMA.Init.PeriphInc           = DMA_PINC_DISABLE;
+    ctx->hRxDMA.Init.MemInc              = DMA_MINC_ENABLE;
+    ctx->hRxDMA.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    ctx->hRxDMA.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    ctx->hRxDMA.Init.Mode                = DMA_CIRCULAR;
+    ctx->hRxDMA.Init.Priority            = DMA_PRIORITY_HIGH;
+    if (HAL_OK != HAL_DMA_Init(&ctx->hRxDMA))
+        return RET_HW_NOK;
+
+    ctx->Instance = uart;
+    ctx->RxRing = map->RxRing;
+    ctx->RxTail = 0;
+    ctx->RxHead = 0;
+    ctx->RxWritten = 0;
+    ctx->RxRead = 0;
+    ctx->RxErrors = 0;
+    ctx->RxOverruns = 0;
+    ctx->RxCB = RxCB;
+    ctx->hRxDMA.Parent = ctx;
+    ctx->hRxDMA.XferHalfCpltCallback = dUART_RxDMAEvt;
+    ctx->hRxDMA.XferCpltCallback = dUART_RxDMAEvt;
+    ctx->hRxDMA.XferErrorCallback = dUART_RxDMAError;
+
+    /* No per-byte interrupt */
+    CLEAR_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+    CLEAR_BIT(uart->CR3, USART_CR3_RXFTIE);
+
+    if (HAL_OK != HAL_DMA_Start_IT(&ctx->hRxDMA, (uint32_t)&uart->RDR,
+            (uint32_t)ctx->RxRing, dUART_RXRING_LEN))
+        return RET_HW_NOK;
+    SET_BIT(uart->CR3, (USART_CR3_DMAR | USART_CR3_EIE));
+
+    /* Idle line marks the end of a burst shorter than half the ring */
+    WRITE_REG(uart->ICR, USART_ICR_IDLECF);
+    SET_BIT(uart->CR1, USART_CR1_IDLEIE);
+
+    /* Interrupt config */
+    PAL_NVIC_SetPriority(map->RxDMAIRQn, dUART_DMA_IRQ_PRIO);
+    PAL_NVIC_EnableIRQ(map->RxDMAIRQn);
+    PAL_NVIC_SetPriority(map->IRQn, dUART_DMA_IRQ_PRIO);
+    PAL_NVIC_EnableIRQ(map->IRQn);
+
+    return RET_OK;
+}
+
+/* Rx span - contiguous received bytes on the ring */
+uint32_t dUART_RxSpan(dUART_Port_t Port, uint8_t **Data)
+{
+    if ((Port >= dUART_PORT_N_ENUM) || (dUART_Ctx[Port].RxRing == NULL))
+        return 0;
+
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+
+    taskENTER_CRITICAL();
+    dUART_RxTrack(ctx);
+
+    /* Reader fell a full ring behind - what is left is mixed old and new, resync to the head */
+    uint32_t used = ctx->RxWritten - ctx->RxRead;
+    if (used > dUART_RXRING_LEN) {
+        ctx->RxOverruns++;
+        ctx->RxRead = ctx->RxWritten;
+        ctx->RxTail = ctx->RxHead;
+        used = 0;
+    }
+    uint32_t tail = ctx->RxTail;
+    taskEXIT_CRITICAL();
+
+    *Data = &ctx->RxRing[tail];
+    return MIN(used, (dUART_RXRING_LEN - tail));
+}
+
+/* Rx consume */
+void dUART_RxConsume(dUART_Port_t Port, uint32_t Len)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return;
+
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+
+    taskENTER_CRITICAL();
+    ctx->RxTail = (ctx->RxTail + Len) % dUART_RXRING_LEN;
+    ctx->RxRead += Len;
+    taskEXIT_CRITICAL();
+}
+
+/* Get Rx error count */
+uint32_t dUART_GetRxErrors(dUART_Port_t Port)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return 0;
+
+    return dUART_Ctx[Port].RxErrors;
+}
+
+/* Get Rx overrun count - ring lapped before it was read */
+uint32_t dUART_GetRxOverruns(dUART_Port_t Port)
+{
+    if (Port >= dUART_PORT_N_ENUM)
+        return 0;
+
+    return dUART_Ctx[Port].RxOverruns;
+}
+
+/* INTR - Tx DMA */
+void dUART_TxDMA_ISR(dUART_Port_t Port)
+{
+    HAL_DMA_IRQHandler(&dUART_Ctx[Port].hTxDMA);
+}
+
+/* INTR - Rx DMA */
+void dUART_RxDMA_ISR(dUART_Port_t Port)
+{
+    /* Shared handler may run before Rx is started */
+    if (dUART_Ctx[Port].RxRing == NULL)
+        return;
+
+    HAL_DMA_IRQHandler(&dUART_Ctx[Port].hRxDMA);
+}
+
+/* INTR - UART, idle line and errors */
+void dUART_ISR(dUART_Port_t Port)
+{
+    dUART_Ctx_t *ctx = &dUART_Ctx[Port];
+    USART_TypeDef *uart = dUART_Map[Port].Instance;
+
+    /* Shared handler may run before Rx is started */
+    if (ctx->RxRing == NULL)
+        return;
+
+    uint32_t isr = READ_REG(uart->ISR);
+
+    /* Errors - clear and keep receiving */
+    if (isr & (USART_ISR_ORE | USART_ISR_FE | USART_ISR_NE | USART_ISR_PE)) {
+        WRITE_REG(uart->ICR, (USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF | USART_ICR_PECF));
+        ctx->RxErrors++;
+    }
+
+    /* Idle line - hand over what has arrived */
+    if (isr & USART_ISR_IDLE) {
+        WRITE_REG(uart->ICR, USART_ICR_IDLECF);
+        dUART_RxTrack(ctx);
+        if (ctx->RxCB != NULL)
+            ctx->RxCB();
+    }
+}
+
+/******************************** End of File *********************************/
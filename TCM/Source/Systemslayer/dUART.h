@@ -0,0 +1,86 @@
+/**
+ **  @file dUART.h
+ **  @brief UART DMA driver
+ **  @author JZJ
+ **
+ **/
+
+#ifndef _dUART_H_
+#define _dUART_H_
+
+/* Includes */
+#include "PAL.h"
+#include "RTOS.h"
+
+/* Macros */
+
+/* Tx ring length - bytes */
+#define dUART_TXRING_LEN    (1024)
+/* Rx ring length - bytes, must hold the data arriving between two reads */
+#define dUART_RXRING_LEN    (512)
+
+/* Baud rates */
+#define dUART_BAUD_DEFAULT  (115200)
+#define dUART_BAUD_MIN      (9600)
+
+/* Types */
+
+/* Ports - DFG (USART2) stays on its own driver at a fixed 115200, it has no rate negotiation */
+typedef enum {
+    dUART_PORT_TCM = 0,
+    dUART_PORT_AxM1,
+    dUART_PORT_AxM2,
+    dUART_PORT_N_ENUM,
+} dUART_Port_t;
+
+/* Tx statistics */
+typedef struct {
+    uint32_t TxFrames;      // Frames queued
+    uint32_t TxBytes;       // Bytes completed by DMA
+    uint32_t TxDropped;     // Frames dropped - ring full after wait, or cut by a stall
+    uint32_t TxStalls;      // Transfers aborted - exceeded expected time
+    uint32_t TxMaxPending;  // High water mark of the ring (bytes)
+} dUART_TxStats_t;
+
+/* Rx callback - from ISR, data available */
+typedef void (*dUART_RxCB_t)(void);
+
+/* Function Prototypes */
+/* Init */
+StdReturn_t dUART_Init(dUART_Port_t Port, uint32_t BaudRate);
+/* Set baud rate - enables FIFO, waits for pending Tx to drain */
+StdReturn_t dUART_SetBaudRate(dUART_Port_t Port, uint32_t BaudRate);
+/* Get baud rate */
+uint32_t dUART_GetBaudRate(dUART_Port_t Port);
+/* Is baud rate supported */
+bool dUART_IsBaudSupported(dUART_Port_t Port, uint32_t BaudRate);
+/* Queue a frame for Tx - waits up to Wait ticks for room */
+StdReturn_t dUART_Tx(dUART_Port_t Port, uint8_t *Data, uint32_t Size, TickType_t Wait);
+/* Get free room in Tx ring - bytes */
+uint32_t dUART_GetTxRoom(dUART_Port_t Port);
+/* Is Tx idle - nothing queued or in flight */
+bool dUART_IsTxIdle(dUART_Port_t Port);
+/* Check for stalled transfers */
+void dUART_TxCheck(dUART_Port_t Port);
+/* Get Tx statistics */
+StdReturn_t dUART_GetTxStats(dUART_Port_t Port, dUART_TxStats_t *Stats);
+/* Reset Tx statistics */
+void dUART_ResetTxStats(dUART_Port_t Port);
+/* Start circular Rx - replaces the per-byte interrupt, enables FIFO */
+StdReturn_t dUART_RxStart(dUART_Port_t Port, dUART_RxCB_t RxCB);
+/* Rx span - contiguous received bytes on the ring */
+uint32_t dUART_RxSpan(dUART_Port_t Port, uint8_t **Data);
+/* Rx consume */
+void dUART_RxConsume(dUART_Port_t Port, uint32_t Len);
+/* Get Rx error count */
+uint32_t dUART_GetRxErrors(dUART_Port_t Port);
+/* Get Rx overrun count - ring lapped before it was read */
+uint32_t dUART_GetRxOverruns(dUART_Port_t Port);
+/* INTR - Tx DMA */
+void dUART_TxDMA_ISR(dUART_Port_t Port);
+/* INTR - Rx DMA, called from the AxMi DMA1 channel 2/3 handlers */
+void dUART_RxDMA_ISR(dUART_Port_t Port);
+/* INTR - UART idle line and errors, called from the AxMi LPUART1/USART1 handlers once Rx is started */
+void dUART_ISR(dUART_Port_t Port);
+
+#endif /*** _dUART_H_ ***/
@@ -0,0 +1,191 @@
+/**
+ *  @file LogBinDec.c
+ *  @brief Reference decoder of binary logs - host side
+ *  @author JZJ
+ *
+ *  Build: cc -O2 -o LogBinDec LogBinDec.c -lm
+ *  Usage: LogBinDec <log file>  - CSV of source, time (msecs) and reading on stdout
+ *
+ *  Raw logs carry no per record time, the time column is then blank.
+ *  Encoded blocks failing their CRC are reported on stderr and skipped.
+ **/
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/* Macros */
+
+/* Log header - see LogBin.h */
+#define LOGBIN_MAGIC        (0x424D4354)    // "TCMB"
+#define LOGBIN_HDR_LEN      (44)
+#define LOGBIN_REC_LEN      (5)
+
+#define LOGBIN_ENC_RAW      (0)
+#define LOGBIN_ENC_DELTA    (1)
+
+#define LOGBIN_BLK_SYNC     (0x4B42)        // "BK"
+#define LOGBIN_BLK_HDR_LEN  (24)
+#define LOGBIN_BLK_DATA_MAX (512)
+
+/* Static Variables */
+static uint32_t CRC32Table[256];
+
+/* Private Functions */
+
+/* Get values - little endian */
+static uint16_t GetValUINT16(const uint8_t *Buf)
+{
+    return (uint16_t) (Buf[0] | (Buf[1] << 8));
+}
+static uint32_t GetValUINT32(const uint8_t *Buf)
+{
+    return (uint32_t) Buf[0] | ((uint32_t) Buf[1] << 8) | ((uint32_t) Buf[2] << 16) | ((uint32_t) Buf[3] << 24);
+}
+static float GetValFLT32(const uint8_t *Buf)
+{
+    uint32_t val = GetValUINT32(Buf);
+    float f;
+    memcpy(&f, &val, sizeof(f));
+    return f;
+}
+
+/* CRC32 - reflected 0xEDB88320, as CRC32.c */
+static void CRC32_Setup(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (uint32_t b = 0; b < 8; b++)
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320u) : (crc >> 1);
+        CRC32Table[i] = crc;
+    }
+}
+static uint32_t CRC32_Calc(const uint8_t *Buf, uint32_t Len, uint32_t CRC)
+{
+    while (Len--)
+        CRC = CRC32Table[(CRC ^ *Buf++) & 0xFF] ^ (CRC >> 8);
+    return CRC;
+}
+
+/* Raw records */
+static void Dec_Raw(const uint8_t *Data, size_t Len)
+{
+    for (size_t off = 0; (off + LOGBIN_REC_LEN) <= Len; off += LOGBIN_REC_LEN)
+        printf("%u,,%.9g\n", Data[off], GetValFLT32(&Data[off + 1]));
+}
+
+/* Encoded block - returns false on a bad block */
+static int Dec_Block(const uint8_t *Blk, size_t Avail, size_t *Used)
+{
+    if (Avail < LOGBIN_BLK_HDR_LEN)
+        return 0;
+
+    uint32_t count = GetValUINT16(&Blk[4]);
+    uint32_t len = GetValUINT16(&Blk[6]);
+    if ((len > LOGBIN_BLK_DATA_MAX) || ((LOGBIN_BLK_HDR_LEN + len) > Avail))
+        return 0;
+
+    uint32_t crc = CRC32_Calc(Blk, (LOGBIN_BLK_HDR_LEN - 4), 0xFFFFFFFFu);
+    crc = ~CRC32_Calc(&Blk[LOGBIN_BLK_HDR_LEN], len, crc);
+    if (crc != GetValUINT32(&Blk[20]))
+        return 0;
+
+    uint32_t src = Blk[2];
+    uint32_t time = GetValUINT32(&Blk[8]);
+    int64_t q = (int32_t) GetValUINT32(&Blk[12]);
+    float step = GetValFLT32(&Blk[16]);
+    const uint8_t *p = &Blk[LOGBIN_BLK_HDR_LEN];
+    const uint8_t *end = p + len;
+
+    printf("%u,%u,%.9g\n", src, time, (double) ((float) q * step));
+    for (uint32_t i = 1; i < count; i++) {
+        uint64_t zz = 0;
+        uint32_t shift = 0;
+        while ((p < end) && (*p & 0x80)) {
+            zz |= (uint64_t) (*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        if (p == end)
+            return 0;
+        zz |= (uint64_t) (*p++) << shift;
+        q += (int64_t) (zz >> 1) ^ -(int64_t) (zz & 1);
+        /* Samples of the block share its start time */
+        printf("%u,%u,%.9g\n", src, time, (double) ((float) q * step));
+    }
+
+    *Used = LOGBIN_BLK_HDR_LEN + len;
+    return 1;
+}
+
+/* Encoded blocks - resynchronizes on the next sync after a bad block */
+static void Dec_Delta(const uint8_t *Data, size_t Len)
+{
+    size_t off = 0;
+    uint32_t bad = 0;
+
+    while ((off + LOGBIN_BLK_HDR_LEN) <= Len) {
+        size_t used;
+        if ((GetValUINT16(&Data[off]) == LOGBIN_BLK_SYNC) && Dec_Block(&Data[off], (Len - off), &used)) {
+            off += used;
+            continue;
+        }
+        if (GetValUINT16(&Data[off]) == LOGBIN_BLK_SYNC)
+            fprintf(stderr, "bad block at %zu\n", (size_t) (LOGBIN_HDR_LEN + off));
+        bad++;
+        off++;
+    }
+    if (bad > 0)
+        fprintf(stderr, "%u bytes skipped\n", bad);
+}
+
+/* Public Functions */
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <log file>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc((size_t) size + 1);
+    if ((buf == NULL) || (fread(buf, 1, (size_t) size, f) != (size_t) size)) {
+        fprintf(stderr, "read failed\n");
+        return 1;
+    }
+    fclose(f);
+
+    if ((size < LOGBIN_HDR_LEN) || (GetValUINT32(&buf[0]) != LOGBIN_MAGIC)) {
+        fprintf(stderr, "not a log file\n");
+        return 1;
+    }
+
+    uint32_t hdrLen = GetValUINT16(&buf[6]);
+    uint32_t enc = buf[10];
+    fprintf(stderr, "period %u ms, resolution %u, encoding %u, units %.8s -> %.8s\n",
+            GetValUINT32(&buf[12]), GetValUINT32(&buf[16]), enc, (char*) &buf[28], (char*) &buf[36]);
+
+    CRC32_Setup();
+    printf("src,time_ms,reading\n");
+    if (enc == LOGBIN_ENC_RAW)
+        Dec_Raw(&buf[hdrLen], (size_t) (size - hdrLen));
+    else if (enc == LOGBIN_ENC_DELTA)
+        Dec_Delta(&buf[hdrLen], (size_t) (size - hdrLen));
+    else
+        fprintf(stderr, "unknown encoding %u\n", enc);
+
+    free(buf);
+    return 0;
+}
+
+/******************************** End of File *********************************/